@@ -0,0 +1,23 @@
+/* four-step FFT of very long transforms in a mapped array, see bigfft.c */
+
+#include <fftw3.h>
+
+struct BIGFFT {
+  long long n;		/* transform length, n1*n2 */
+  int n1;		/* column length, columns are n2 apart */
+  int n2;		/* row length, rows are contiguous */
+  int block;		/* columns gathered at a time in the first pass */
+  int nthreads;
+  fftwf_plan pcol;	/* block transforms of n1, on a gathered block */
+  fftwf_plan prow;	/* one transform of n2, in place in a row */
+  float **buf;		/* one gather buffer per thread, 2*block*n1 */
+  double **tw;		/* twiddle recurrences per thread, 4*block */
+};
+
+int bigfft_split( long long, int *, int * );
+struct BIGFFT *bigfft_create( long long, long long, int, unsigned int );
+void bigfft_execute( struct BIGFFT *, float * );
+void bigfft_power( struct BIGFFT *, float *, int, float * );
+float *bigfft_map( long long, char * );
+void bigfft_unmap( float *, long long );
+void bigfft_free( struct BIGFFT * );
@@ -0,0 +1,4 @@
+
+/* CRC32C (Castagnoli) block checksums, see crc32c.c */
+
+unsigned int crc32c( unsigned int, unsigned char *, size_t );
@@ -0,0 +1,22 @@
+/* FFTW planner effort, persistent wisdom and spectrum helpers, see fftutil.c */
+
+#include <fftw3.h>
+
+/* -L choices for a transform length with large prime factors */
+#define FFT_EXACT  0	/* use fsamp/freqres as given */
+#define FFT_RES    1	/* move freqres to the nearest fast length */
+#define FFT_PAD    2	/* zero pad up to the next fast length */
+
+int fft_effort( char *, unsigned int * );
+char *fft_effort_name( unsigned int );
+void fft_wisdom_load( void );
+void fft_wisdom_save( void );
+float *fft_hann( int );
+void fft_power_sum( float *, int, int, float * );
+void fft_power_sum2( float *, int, int, float *, float * );
+void fft_cross_sum( float *, float *, int, int, float *, float * );
+int fft_lenmode( char *, int * );
+int fft_maxfactor( int );
+char *fft_factors( int );
+int fft_fastlen( int, int );
+double fft_time( fftwf_plan, float *, int, int );
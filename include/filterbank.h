@@ -0,0 +1,28 @@
+/* SIGPROC filterbank output of -t spectra, see filterbank.c */
+
+struct FBANK {
+  /* set by the caller */
+  int nbits;		/* 32 (float), 16 or 8 (unsigned counts) */
+  int bin;		/* bins summed into one channel */
+  int dB;		/* 10 log10 of the channel powers */
+  int header;		/* SIGPROC header, else bare rows */
+  /* set by fb_setup */
+  int nifs;		/* spectra per row */
+  int fftlen;		/* bins per input spectrum */
+  int i0;		/* first bin of the band */
+  int nchans;		/* channels per spectrum */
+  double fch1, foff;	/* channel 0 and spacing, MHz */
+  double tsamp;		/* s between rows */
+  double zero, scale;	/* counts = zero + scale * value, from the first row */
+  int scaled;
+  float *chan;		/* one row of channels */
+  void *row;		/* and as written */
+  long long hdrlen;	/* bytes before the first row */
+  long long rowbytes;
+};
+
+int fb_parse( char *, int *, int * );
+void fb_setup( struct FBANK *, int, int, double, double, float, float, double );
+long long fb_header( struct FBANK *, FILE *, char * );
+int fb_write( struct FBANK *, float *, FILE * );
+void fb_describe( struct FBANK *, FILE * );
@@ -1,15 +1,44 @@
 
 struct MULTIFILE {
-  long long max;
-  long long cur_off;
-  int cur_file;
-  int max_file;
-  int fd[ 500 ]; /* biggest thing we could support is 2GIGS * 500 (TERABYTE) */
+  long long max;     /* size of each file */
+  long long cur_off; /* bytes written to the current file */
+  int cur_file;      /* number of the current file */
+  int max_file;      /* limit on the number of files, 0 for none */
+  int fd;            /* current file, -1 until it is needed */
+  unsigned int openpar;
+  int mask;
   char name[256];
+  FILE *crcfp;       /* checksum sidecar, see multi_crc() */
 };
 
 int multi_config_maxfilesize( long long );
 struct MULTIFILE *multi_open( char *, unsigned int, int, int ); 
 int multi_close( struct MULTIFILE *);
-int multi_write( struct MULTIFILE *, char *, int );
+ssize_t multi_write( struct MULTIFILE *, char *, size_t );
+int multi_crc( struct MULTIFILE * );
+int multi_unlink( char * );
+int multi_drain( void );
 
+/* read side: a recording set data*.NNN seen as one 64-bit stream */
+
+struct MULTIREAD {
+  char name[256];       /* prefix of the set, or the single file */
+  int nfiles;
+  int *fd;
+  long long *start;     /* stream offset of each file, start[nfiles] = size */
+  long long pos;        /* position for multi_read */
+  long long ahead;      /* readahead requested up to here */
+  int seekable;         /* 0 for stdin or a pipe */
+  char *win;            /* current multi_map window */
+  size_t winlen;
+  int winmapped;        /* window is mmap'ed, else malloc'ed */
+};
+
+struct MULTIREAD *multi_ropen( char *, int );
+int multi_rclose( struct MULTIREAD * );
+long long multi_pread( struct MULTIREAD *, char *, long long, long long );
+long long multi_read( struct MULTIREAD *, char *, long long );
+long long multi_lseek( struct MULTIREAD *, long long, int );
+long long multi_size( struct MULTIREAD * );
+int multi_ident( struct MULTIREAD *, char *, int );
+char *multi_map( struct MULTIREAD *, long long, long long );
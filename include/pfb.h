@@ -0,0 +1,13 @@
+/* polyphase filterbank front end for the FFT tools, see pfb.c */
+
+struct PFB {
+  int nchan;		/* channels, the FFT length */
+  int ntaps;		/* taps per channel */
+  char window[16];	/* window of the prototype filter */
+  float *coeff;		/* prototype filter, ntaps*nchan */
+};
+
+struct PFB *pfb_create( int, int, char * );
+int pfb_parse( char *, int *, char * );
+void pfb_fold( struct PFB *, float **, float *, int );
+void pfb_free( struct PFB * );
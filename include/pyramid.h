@@ -0,0 +1,34 @@
+/* integration pyramid cache of -t spectra, see pyramid.c */
+
+#define PYRLEVELS 48
+#define PYRKEY    3072
+
+struct PYRHDR {
+  char magic[8];
+  int complete;		/* every level written */
+  int nspec, fftlen;	/* a record is nspec spectra of fftlen bins */
+  int nlevels;
+  long long sum;	/* transforms in a level 0 record */
+  double tsum;		/* s of data in a level 0 record */
+  double t0;		/* s of input skipped before record 0 */
+  double f0, df;	/* Hz of bin 0, and bin spacing */
+  long long count[PYRLEVELS];	/* records at level k, 2^k level 0 records each */
+  long long offset[PYRLEVELS];	/* bytes from the start of the file to level k */
+  char key[PYRKEY];	/* spec_key of the run that wrote it */
+};
+
+struct PYR {
+  struct PYRHDR h;
+  char name[1024];
+  char tmp[1040];	/* written here, renamed when complete */
+  FILE *fp;
+  char *map;		/* the complete file */
+  size_t maplen;
+};
+
+int pyr_open( struct PYR *, char *, char * );
+void pyr_create( struct PYR *, char *, char *, int, int, long long, double, double, double, double );
+int pyr_add( struct PYR *, float * );
+void pyr_finish( struct PYR * );
+int pyr_sum( struct PYR *, long long, long long, float * );
+void pyr_close( struct PYR * );
@@ -0,0 +1,13 @@
+/* result cache of repeated analysis runs, see rcache.c */
+
+struct RCACHE {
+  char name[1024];	/* entry of this run */
+  char tmp[1040];	/* written here, renamed when complete */
+  char *key;		/* program, parameters and input identity */
+  FILE *out;		/* output being recorded, NULL if it cannot be */
+  int fd;		/* and open for reading it back */
+  long long start;	/* offset of this run's output in out */
+};
+
+int rc_open( struct RCACHE *, char *, char *, FILE * );
+void rc_store( struct RCACHE * );
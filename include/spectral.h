@@ -0,0 +1,79 @@
+/* N-stream spectral engine behind pfs_fft and pfs_fft_2, see spectral.c */
+
+/* -k, how the spectra of several input streams are combined */
+#define SPEC_SUM       0	/* one spectrum, the powers of all streams added */
+#define SPEC_SEPARATE  1	/* one power spectrum per stream */
+#define SPEC_CROSS     2	/* per stream, then Re and Im of each pair a<b */
+#define SPEC_STOKES    3	/* I, Q, U, V of the two channels of one input */
+
+struct SPEC_STREAM {
+  char *name;		/* file, recording set prefix, or - for stdin */
+  int mode;		/* sampling mode, as -m */
+  int chan;		/* 1 or 2, for dual pol modes */
+  float skip;		/* seconds skipped at the start */
+  /* set by spec_setup */
+  struct MULTIREAD *mf;
+  float smpwd;		/* complex samples in a 4 byte word */
+  long bufsize;		/* bytes per transform */
+  long nskipbytes;
+  int shared;		/* unpacks the previous stream's data, -k stokes */
+};
+
+struct SPEC {
+  /* set by the front end */
+  int nstreams;
+  struct SPEC_STREAM *stream;
+  int combine;		/* SPEC_SUM, SPEC_SEPARATE, SPEC_CROSS or SPEC_STOKES */
+  double fsamp;		/* MHz */
+  double freqres;	/* Hz; after spec_setup, the output bin spacing */
+  int downsample;
+  long long sum;	/* transforms per output */
+  int timeseries;	/* keep going until EOF */
+  int invert, hanning, dcoffset;
+  double dcoffi, dcoffq;
+  int dcfix;		/* replace the zero frequency bin by its neighbours */
+  int real;		/* real samples, modes 16 and 32 */
+  double foff;		/* and their frequency offset, Hz */
+  int zoom;		/* transform only the freqmin,freqmax band */
+  float freqmin, freqmax;
+  int pfbtaps;		/* polyphase filterbank, 0 for none */
+  char pfbwindow[16];
+  int fastlen;		/* FFT_EXACT, FFT_RES or FFT_PAD */
+  int nthreads;
+  unsigned int effort;	/* FFTW planner flags */
+  char *chebfile;	/* Chebyshev coefficients, - for none */
+  float rmsmin, rmsmax;	/* scale to sigmas over this band, Hz */
+  float skthresh;	/* -K, spectral kurtosis flags beyond this many sigmas, 0 for none */
+  int skzero;		/* and zero the flagged bins */
+  float membudget;	/* -M, MB for one transform's buffers, 0 for half the memory */
+  char *scratchdir;	/* -M, where long transforms spill, NULL for $TMPDIR */
+
+  /* set by spec_setup */
+  int fftlen;		/* bins per output spectrum */
+  int datalen;		/* samples per transform before zero padding */
+  int nspec;		/* spectra per output */
+  int degree;		/* of the Chebyshev window, 0 for none */
+  double resolution;	/* of the data, Hz */
+  double freqwas;	/* resolution asked for */
+  double fcenter;	/* frequency of bin fftlen/2 */
+  long long nsums;	/* outputs the inputs hold, -1 if unknown */
+  double tplan;		/* measured seconds per transform */
+  unsigned char *flags;	/* -K, bins flagged in the last spec_next, one bit each */
+  int flagbytes;	/* (fftlen+7)/8 */
+  int nflagged;		/* bins flagged in the last spec_next */
+  int longfft;		/* four-step transforms, 1 in memory, 2 on scratch; 0 none */
+};
+
+int spec_combine( char *, int * );
+int spec_stream( char *, struct SPEC_STREAM * );
+int spec_sk( char *, float *, int * );
+FILE *spec_flagfile( struct SPEC *, char * );
+int spec_budget( char *, float *, char ** );
+int spec_key( struct SPEC *, char *, int );
+void spec_setup( struct SPEC * );
+void spec_describe( struct SPEC *, FILE * );
+void spec_start( struct SPEC * );
+float *spec_next( struct SPEC * );
+void spec_done( struct SPEC *, float * );
+void spec_finish( struct SPEC * );
+double spec_freq( struct SPEC *, int );
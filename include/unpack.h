@@ -15,3 +15,8 @@ void unpack_pfs_4c8b_rcp (unsigned char *buf, char *rcp, int bufsize);
 void unpack_pfs_4c8b_lcp (unsigned char *buf, char *lcp, int bufsize);
 void unpack_pfs_4c8b_rcp_sb (unsigned char *buf, char *rcp, int bufsize);
 void unpack_pfs_4c8b_lcp_sb (unsigned char *buf, char *lcp, int bufsize);
+
+void split_pfs_4c2b (unsigned char *buf, unsigned char *rcp, unsigned char *lcp, int bufsize);
+void split_pfs_4c4b (unsigned char *buf, unsigned char *rcp, unsigned char *lcp, int bufsize);
+void requant_pfs_2c8b_2c4b (unsigned char *buf, unsigned char *outbuf, int bufsize, float step);
+void requant_pfs_2c8b_2c2b (unsigned char *buf, unsigned char *outbuf, int bufsize, float thresh);
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fftw3.h>
+
+#include "bigfft.h"
+
+/*
+  Four-step FFT for transforms too long to plan and hold as one array,
+  10^8 points and up.  The n = n1*n2 points are seen as n1 rows of n2,
+  sample n2' + n2*n1' in row n1', column n2'.  The transform is done in
+  place in two passes over the array:
+
+    1. the n2 columns are transformed (length n1), block columns at a
+       time gathered into a buffer that stays in cache, and multiplied
+       by the twiddle factors w^(n2' k1) on the way back, w = e^(-2 pi i/n);
+    2. the n1 rows are transformed (length n2), each in place.
+
+  Bin k1 + n1*k2 of the transform is then at k2 + n2*k1, i.e. the result
+  is the transpose of natural order.  bigfft_power undoes this while it
+  detects, block rows at a time, so the powers come out in bin order and
+  no separate transpose pass is needed.  Columns, rows and blocks are
+  shared round robin among nthreads threads.
+
+  The array can be anonymous memory or a scratch file, see bigfft_map;
+  every pass reads and writes it in runs of block points, so a file
+  backed array is paged in large pieces.
+
+  usage:  f = bigfft_create( n, blockbytes, nthreads, effort );
+          x = bigfft_map( 2*n, dir );          n complex samples
+          fill x, bigfft_execute( f, x );
+          bigfft_power( f, x, shift, sum );    adds |X|^2 to sum[n]
+          bigfft_unmap( x, 2*n ); bigfft_free( f );
+*/
+
+#define BIGMINLEN   16		/* shortest useful column */
+#define BIGMINBLOCK 8		/* columns per block, one cache line of points */
+
+struct BIGARG {
+  struct BIGFFT *f;
+  float *data;
+  float *sum;
+  int shift;
+  int t;			/* thread number */
+  int pass;			/* 1, 2, or 0 for bigfft_power */
+};
+
+/* n1 <= n2, the largest divisor of n up to sqrt(n); -1 if too small */
+
+int bigfft_split( n, n1, n2 )
+long long n;
+int *n1, *n2;
+{
+  long long d;
+
+  for( d = (long long)sqrt( (double)n ); d >= BIGMINLEN; d-- )
+    if( n % d == 0 ) {
+      *n1 = d;
+      *n2 = n / d;
+      return(0);
+    }
+  return(-1);
+}
+
+struct BIGFFT *bigfft_create( n, blockbytes, nthreads, effort )
+long long n;
+long long blockbytes;		/* gather buffer per thread, bytes */
+int nthreads;
+unsigned int effort;
+{
+  struct BIGFFT *f;
+  fftwf_complex *row;
+  long long b;
+  int t;
+
+  if( !(f = (struct BIGFFT *)calloc( 1, sizeof(struct BIGFFT) )) )
+    return( NULL );
+  if( bigfft_split( n, &f->n1, &f->n2 ) < 0 ) {
+    free( f );
+    return( NULL );
+  }
+  f->n = n;
+  f->nthreads = nthreads < 1 ? 1 : nthreads;
+  b = blockbytes / (2 * sizeof(float) * f->n1);
+  if( b < BIGMINBLOCK ) b = BIGMINBLOCK;
+  if( b > f->n2 ) b = f->n2;
+  f->block = b;
+
+  f->buf = (float **)calloc( f->nthreads, sizeof(float *) );
+  f->tw = (double **)calloc( f->nthreads, sizeof(double *) );
+  row = (fftwf_complex *)fftwf_malloc( f->n2 * sizeof(fftwf_complex) );
+  if( !f->buf || !f->tw || !row ) {
+    fprintf( stderr, "Malloc error\n" );
+    exit(1);
+  }
+  for( t = 0; t < f->nthreads; t++ ) {
+    f->buf[t] = (float *)fftwf_malloc( 2 * (size_t)f->block * f->n1 * sizeof(float) );
+    f->tw[t] = (double *)malloc( 4 * f->block * sizeof(double) );
+    if( !f->buf[t] || !f->tw[t] ) {
+      fprintf( stderr, "Malloc error\n" );
+      exit(1);
+    }
+  }
+
+  /* the gather buffers are aligned alike; rows of the array are not */
+  f->pcol = fftwf_plan_many_dft( 1, &f->n1, f->block,
+				 (fftwf_complex *)f->buf[0], NULL, f->block, 1,
+				 (fftwf_complex *)f->buf[0], NULL, f->block, 1,
+				 FFTW_FORWARD, effort );
+  f->prow = fftwf_plan_many_dft( 1, &f->n2, 1, row, NULL, 1, f->n2, row, NULL, 1, f->n2,
+				 FFTW_FORWARD, effort | FFTW_UNALIGNED );
+  fftwf_free( row );
+  return( f );
+}
+
+/* pass 1 on the blocks of thread a->t: gather, transform, twiddle, scatter */
+
+static void bigfft_columns( a )
+struct BIGARG *a;
+{
+  struct BIGFFT *f = a->f;
+  float *buf = f->buf[a->t];
+  double *cr = f->tw[a->t], *ci = cr + f->block;
+  double *sr = ci + f->block, *si = sr + f->block;
+  double x, y;
+  float *p;
+  long long c0;
+  int nb = f->block, n1 = f->n1, n2 = f->n2;
+  int c, j, k;
+
+  for( c0 = (long long)a->t * nb; c0 < n2; c0 += (long long)f->nthreads * nb ) {
+    c = n2 - c0 < nb ? n2 - c0 : nb;
+    for( k = 0; k < n1; k++ )
+      memcpy( &buf[2*(long long)k*nb], &a->data[2*(c0 + (long long)n2*k)], 2 * c * sizeof(float) );
+    fftwf_execute_dft( f->pcol, (fftwf_complex *)buf, (fftwf_complex *)buf );
+
+    /* w^(column k1), by recurrence down each column, in double */
+    for( j = 0; j < c; j++ ) {
+      cr[j] = 1;
+      ci[j] = 0;
+      sr[j] = cos( 2 * M_PI * (double)(c0 + j) / (double)f->n );
+      si[j] = -sin( 2 * M_PI * (double)(c0 + j) / (double)f->n );
+    }
+    for( k = 0; k < n1; k++ ) {
+      p = &buf[2*(long long)k*nb];
+      for( j = 0; j < c; j++ ) {
+	x = p[2*j];
+	y = p[2*j+1];
+	p[2*j]   = x * cr[j] - y * ci[j];
+	p[2*j+1] = x * ci[j] + y * cr[j];
+	x = cr[j] * sr[j] - ci[j] * si[j];
+	ci[j] = cr[j] * si[j] + ci[j] * sr[j];
+	cr[j] = x;
+      }
+    }
+
+    for( k = 0; k < n1; k++ )
+      memcpy( &a->data[2*(c0 + (long long)n2*k)], &buf[2*(long long)k*nb], 2 * c * sizeof(float) );
+  }
+}
+
+/* pass 2 on the rows of thread a->t, in place */
+
+static void bigfft_rows( a )
+struct BIGARG *a;
+{
+  struct BIGFFT *f = a->f;
+  fftwf_complex *row;
+  long long k;
+
+  for( k = a->t; k < f->n1; k += f->nthreads ) {
+    row = (fftwf_complex *)&a->data[2 * f->n2 * k];
+    fftwf_execute_dft( f->prow, row, row );
+  }
+}
+
+/* detection of the blocks of thread a->t, transposed back to bin order */
+
+static void bigfft_detect( a )
+struct BIGARG *a;
+{
+  struct BIGFFT *f = a->f;
+  float *pw = f->buf[a->t];	/* block rows of n1 powers */
+  float *d, *s, *p;
+  long long r0, k, h, m;
+  int nb = f->block, n1 = f->n1, n2 = f->n2;
+  int c, i, j, l;
+
+  h = a->shift ? f->n/2 : 0;
+  for( r0 = (long long)a->t * nb; r0 < n2; r0 += (long long)f->nthreads * nb ) {
+    c = n2 - r0 < nb ? n2 - r0 : nb;
+    for( i = 0; i < n1; i++ ) {
+      d = &a->data[2*(r0 + (long long)n2*i)];
+      for( j = 0; j < c; j++ )
+	pw[(long long)j*n1 + i] = d[2*j]*d[2*j] + d[2*j+1]*d[2*j+1];
+    }
+
+    /* bins k2*n1 to k2*n1+n1-1, moved up by h, wrapping at most once */
+    for( j = 0; j < c; j++ ) {
+      p = &pw[(long long)j*n1];
+      k = ((r0 + j) * n1 + h) % f->n;
+      m = f->n - k < n1 ? f->n - k : n1;
+      s = &a->sum[k];
+      for( l = 0; l < m; l++ )
+	s[l] += p[l];
+      for( s = a->sum; l < n1; l++ )
+	s[l - m] += p[l];
+    }
+  }
+}
+
+static void *bigfft_thread( arg )
+void *arg;
+{
+  struct BIGARG *a = (struct BIGARG *)arg;
+
+  if( a->pass == 1 )
+    bigfft_columns( a );
+  else if( a->pass == 2 )
+    bigfft_rows( a );
+  else
+    bigfft_detect( a );
+  return( NULL );
+}
+
+/* runs one pass on all threads, the last one in the caller */
+
+static void bigfft_run( f, data, sum, shift, pass )
+struct BIGFFT *f;
+float *data, *sum;
+int shift, pass;
+{
+  pthread_t *tid;
+  struct BIGARG *a;
+  int t;
+
+  tid = (pthread_t *)malloc( f->nthreads * sizeof(pthread_t) );
+  a = (struct BIGARG *)malloc( f->nthreads * sizeof(struct BIGARG) );
+  if( !tid || !a ) {
+    fprintf( stderr, "Malloc error\n" );
+    exit(1);
+  }
+  for( t = 0; t < f->nthreads; t++ ) {
+    a[t].f = f;
+    a[t].data = data;
+    a[t].sum = sum;
+    a[t].shift = shift;
+    a[t].t = t;
+    a[t].pass = pass;
+    if( t < f->nthreads - 1 && pthread_create( &tid[t], NULL, bigfft_thread, &a[t] ) ) {
+      perror( "pthread_create" );
+      exit(1);
+    }
+  }
+  bigfft_thread( &a[f->nthreads - 1] );
+  for( t = 0; t < f->nthreads - 1; t++ )
+    pthread_join( tid[t], NULL );
+  free( tid );
+  free( a );
+}
+
+/* transforms the n complex samples of data in place, result transposed */
+
+void bigfft_execute( f, data )
+struct BIGFFT *f;
+float *data;
+{
+  bigfft_run( f, data, NULL, 0, 1 );
+  bigfft_run( f, data, NULL, 0, 2 );
+}
+
+/* adds the power of each bin of a transformed array to sum, in bin
+   order, with zero frequency moved to bin n/2 if shift is set */
+
+void bigfft_power( f, data, shift, sum )
+struct BIGFFT *f;
+float *data;
+int shift;
+float *sum;
+{
+  bigfft_run( f, data, sum, shift, 0 );
+}
+
+/* nfloats of zeroed scratch: anonymous memory if dir is NULL, else an
+   unlinked file in dir, so it is gone when the program ends */
+
+float *bigfft_map( nfloats, dir )
+long long nfloats;
+char *dir;
+{
+  char name[1024];
+  size_t len = nfloats * sizeof(float);
+  void *p;
+  int fd;
+
+  if( !dir ) {
+    p = mmap( NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+    return( p == MAP_FAILED ? NULL : (float *)p );
+  }
+  snprintf( name, sizeof(name), "%s/pfs_scratchXXXXXX", dir );
+  if( (fd = mkstemp( name )) < 0 )
+    return( NULL );
+  unlink( name );
+  if( ftruncate( fd, len ) < 0 ) {
+    close( fd );
+    return( NULL );
+  }
+  p = mmap( NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 );
+  close( fd );
+  return( p == MAP_FAILED ? NULL : (float *)p );
+}
+
+void bigfft_unmap( p, nfloats )
+float *p;
+long long nfloats;
+{
+  munmap( p, nfloats * sizeof(float) );
+}
+
+void bigfft_free( f )
+struct BIGFFT *f;
+{
+  int t;
+
+  fftwf_destroy_plan( f->pcol );
+  fftwf_destroy_plan( f->prow );
+  for( t = 0; t < f->nthreads; t++ ) {
+    fftwf_free( f->buf[t] );
+    free( f->tw[t] );
+  }
+  free( f->buf );
+  free( f->tw );
+  free( f );
+}
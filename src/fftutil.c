@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <fftw3.h>
+
+#include "fftutil.h"
+
+/*
+  FFTW planner effort and a wisdom file shared by the FFT tools.
+
+  Our transform lengths are fsamp/freqres, often odd sizes for which
+  FFTW_ESTIMATE picks a slow plan.  Measuring is expensive, so the
+  wisdom is kept in $PFS_WISDOM, or ~/.pfs_wisdom, and each (length,
+  alignment, effort) is planned once and then reused by later runs.
+
+  usage:  fft_effort( "measure", &flags );     from -P
+          fft_wisdom_load();
+          p = fftwf_plan_dft_1d( n, in, out, FFTW_FORWARD, flags );
+          fft_wisdom_save();
+*/
+
+static struct {
+  char *name;
+  unsigned int flags;
+} efforts[] = {
+  { "estimate",   FFTW_ESTIMATE },
+  { "measure",    FFTW_MEASURE },
+  { "patient",    FFTW_PATIENT },
+  { "exhaustive", FFTW_EXHAUSTIVE },
+  { NULL, 0 }
+};
+
+/* planner flags for an effort name, any unique prefix; -1 if unknown */
+
+int fft_effort( name, flags )
+char *name;
+unsigned int *flags;
+{
+  int i;
+
+  for( i=0; efforts[i].name; i++ )
+    if( strncasecmp( name, efforts[i].name, strlen(name) ) == 0 ) {
+      *flags = efforts[i].flags;
+      return(0);
+    }
+  return(-1);
+}
+
+char *fft_effort_name( flags )
+unsigned int flags;
+{
+  int i;
+
+  for( i=0; efforts[i].name; i++ )
+    if( efforts[i].flags == flags )
+      return( efforts[i].name );
+  return( "unknown" );
+}
+
+static char *wisdom_file()
+{
+  static char name[512];
+  char *p;
+
+  if( (p = getenv( "PFS_WISDOM" )) && *p )
+    return( p );
+  if( !(p = getenv( "HOME" )) )
+    return( NULL );
+  snprintf( name, sizeof(name), "%s/.pfs_wisdom", p );
+  return( name );
+}
+
+/* a missing file is not an error, there is just nothing to reuse yet */
+
+void fft_wisdom_load()
+{
+  char *name;
+
+  if( (name = wisdom_file()) && access( name, R_OK ) == 0 )
+    if( !fftwf_import_wisdom_from_filename( name ) )
+      fprintf( stderr, "Ignoring unreadable FFTW wisdom in %s\n", name );
+}
+
+/*
+  export to a temporary file and rename it, so that runs finishing at
+  the same time never leave a half written file behind.
+*/
+
+void fft_wisdom_save()
+{
+  char tmp[600];
+  char *name;
+
+  if( !(name = wisdom_file()) )
+    return;
+  snprintf( tmp, sizeof(tmp), "%s.%d", name, (int)getpid() );
+  if( !fftwf_export_wisdom_to_filename( tmp ) || rename( tmp, name ) < 0 ) {
+    fprintf( stderr, "Could not save FFTW wisdom to %s\n", name );
+    unlink( tmp );
+  }
+}
+
+/*
+  Hann weights for len samples, computed once per run rather than with
+  a cos() for every sample of every transform.  same values as the old
+  per-sample expression, so output does not change.
+*/
+
+float *fft_hann( len )
+int len;
+{
+  float *w;
+  double scale;
+  int i;
+
+  if( !(w = (float *)malloc( len * sizeof(float) )) )
+    return( NULL );
+  scale = 1.0/(double)(len - 1);
+  for( i=0; i<len; i++ )
+    w[i] = (float)(0.5 - 0.5 * cos( 2 * M_PI * (double)i * scale ));
+  return( w );
+}
+
+/*
+  detects a transform of len complex samples and adds the power to sum,
+  with zero frequency moved to bin len/2 if shift is set.  one pass over
+  the transform instead of swap, detect, then add; the two halves are
+  plain loops that the compiler vectorizes.  for odd len the negative
+  frequencies are the last len/2 bins, which the old swap of the two
+  halves of the array got wrong.
+*/
+
+void fft_power_sum( data, len, shift, sum )
+float *data;
+int len;
+int shift;
+float *sum;
+{
+  float *lo, *hi;
+  int i, h, m;
+
+  h = shift ? len/2 : 0;	/* bins moved to the front */
+  m = len - h;
+  lo = sum + h;			/* bins 0..m-1 land here */
+  hi = data + 2*m;		/* and bins m..len-1 at the front */
+
+  for( i=0; i<m; i++ )
+    lo[i] += data[2*i]*data[2*i] + data[2*i+1]*data[2*i+1];
+  for( i=0; i<h; i++ )
+    sum[i] += hi[2*i]*hi[2*i] + hi[2*i+1]*hi[2*i+1];
+}
+
+/*
+  as fft_power_sum, also adding the squared power to sum2, for the
+  spectral kurtosis of the sum
+*/
+
+void fft_power_sum2( data, len, shift, sum, sum2 )
+float *data;
+int len;
+int shift;
+float *sum, *sum2;
+{
+  float *lo, *hi, *lo2, p;
+  int i, h, m;
+
+  h = shift ? len/2 : 0;
+  m = len - h;
+  lo = sum + h;
+  lo2 = sum2 + h;
+  hi = data + 2*m;
+
+  for( i=0; i<m; i++ ) {
+    p = data[2*i]*data[2*i] + data[2*i+1]*data[2*i+1];
+    lo[i] += p;
+    lo2[i] += p*p;
+  }
+  for( i=0; i<h; i++ ) {
+    p = hi[2*i]*hi[2*i] + hi[2*i+1]*hi[2*i+1];
+    sum[i] += p;
+    sum2[i] += p*p;
+  }
+}
+
+/*
+  adds the cross spectrum a times conjugate b of two transforms of len
+  complex samples to re and im, bins moved as in fft_power_sum.
+*/
+
+void fft_cross_sum( a, b, len, shift, re, im )
+float *a, *b;
+int len;
+int shift;
+float *re, *im;
+{
+  int i, k, h;
+
+  h = shift ? len/2 : 0;
+  k = len - h;			/* bin at the front of the output */
+  for( i=0; i<len; i++ ) {
+    if( k == len ) k = 0;
+    re[i] += a[2*k]*b[2*k] + a[2*k+1]*b[2*k+1];
+    im[i] += a[2*k+1]*b[2*k] - a[2*k]*b[2*k+1];
+    k++;
+  }
+}
+
+/*
+  Transform lengths.  FFTW is fast for lengths whose prime factors are
+  all small; a length of fsamp/freqres with a large prime factor can be
+  many times slower than a neighbouring 2^a 3^b 5^c 7^d length, so the
+  tools report the factors and can move to such a length with -L.
+*/
+
+int fft_lenmode( name, mode )
+char *name;
+int *mode;
+{
+  if( strcmp( name, "res" ) == 0 )
+    *mode = FFT_RES;
+  else if( strcmp( name, "pad" ) == 0 )
+    *mode = FFT_PAD;
+  else
+    return(-1);
+  return(0);
+}
+
+int fft_maxfactor( n )
+int n;
+{
+  int f, max = 1;
+
+  for( f=2; f*f<=n; f++ )
+    while( n % f == 0 ) {
+      max = f;
+      n /= f;
+    }
+  if( n > 1 )
+    max = n;
+  return( max );
+}
+
+/* "2^4 * 3 * 7919", in a static buffer */
+
+char *fft_factors( n )
+int n;
+{
+  static char buf[256];
+  int f, e, len = 0;
+
+  buf[0] = 0;
+  for( f=2; n>1; f++ ) {
+    if( f*f > n )
+      f = n;
+    for( e=0; n % f == 0; e++ )
+      n /= f;
+    if( e == 0 )
+      continue;
+    len += snprintf( buf+len, sizeof(buf)-len, "%s%d", len ? " * " : "", f );
+    if( e > 1 )
+      len += snprintf( buf+len, sizeof(buf)-len, "^%d", e );
+  }
+  if( !len )
+    snprintf( buf, sizeof(buf), "1" );
+  return( buf );
+}
+
+/* the 7-smooth length nearest n, or the smallest one >= n if up is set */
+
+int fft_fastlen( n, up )
+int n;
+int up;
+{
+  int d;
+
+  if( n < 1 )
+    return( 1 );
+  for( d=0; ; d++ ) {
+    if( fft_maxfactor( n + d ) <= 7 )
+      return( n + d );
+    if( !up && d < n && fft_maxfactor( n - d ) <= 7 )
+      return( n - d );
+  }
+}
+
+/*
+  seconds per transform for a plan computing ntrans transforms, timed
+  over a few executions on zeroed input of nfloats floats.  the input
+  array is left zeroed.
+*/
+
+double fft_time( p, in, nfloats, ntrans )
+fftwf_plan p;
+float *in;
+int nfloats;
+int ntrans;
+{
+  struct timespec t0, t1;
+  double dt;
+  int n;
+
+  memset( in, 0, nfloats * sizeof(float) );
+  fftwf_execute( p );
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( n=1; ; n++ ) {
+    fftwf_execute( p );
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    dt = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+    if( n >= 10 || dt > 0.1 )
+      break;
+  }
+  return( dt / n / ntrans );
+}
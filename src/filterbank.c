@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "filterbank.h"
+
+/*
+  Dynamic spectra as SIGPROC filterbank files.  The header is the usual
+  list of keywords (fch1, foff, nchans, nbits, nifs, tsamp, ...) between
+  HEADER_START and HEADER_END, and is followed by one row per -t record:
+  nifs spectra of nchans channels, each nbits wide.  Rows are all the
+  same size, so time sample t of spectrum s, channel c is at byte
+
+      hdrlen + t*rowbytes + (s*nchans + c)*nbits/8
+
+  and a reader can mmap any range of time, or of channels at a stride,
+  knowing only the header.
+
+  The channels are the bins of a frequency band (the -x band, else all)
+  summed bin at a time, then optionally in dB.  16 and 8 bit output is
+  unsigned counts, mean of the first row at a quarter of full scale and
+  FBSIGMAS rms of it across full scale, clipped; the mapping stays fixed
+  so rows can be compared.
+
+  usage:  fb_parse( "8,4", &fb.nbits, &fb.bin );        from -w
+          fb_setup( &fb, fftlen, nspec, f0, df, fmin, fmax, tsamp );
+          fb_header( &fb, fp, source );                 if fb.header
+          fb_write( &fb, spectra, fp );                 each record
+*/
+
+#define FBSIGMAS 16		/* rms across the full scale of counts */
+
+/* "nbits[,bin]" */
+
+int fb_parse( arg, nbits, bin )
+char *arg;
+int *nbits, *bin;
+{
+  char *p;
+
+  *bin = 1;
+  *nbits = atoi( arg );
+  if( *nbits != 32 && *nbits != 16 && *nbits != 8 )
+    return(-1);
+  if( (p = strchr( arg, ',' )) && (*bin = atoi( p + 1 )) < 1 )
+    return(-1);
+  return(0);
+}
+
+/* bins i of nifs spectra of fftlen are at f0 + i*df Hz; the band is
+   fmin to fmax Hz, everything if both are 0 */
+
+void fb_setup( fb, fftlen, nifs, f0, df, fmin, fmax, tsamp )
+struct FBANK *fb;
+int fftlen, nifs;
+double f0, df;
+float fmin, fmax;
+double tsamp;
+{
+  float freq;
+  int i, i1;
+
+  fb->fftlen = fftlen;
+  fb->nifs = nifs;
+  fb->i0 = 0;
+  i1 = fftlen - 1;
+  if( fmin != 0 || fmax != 0 ) {
+    /* as the text output selects them */
+    for( fb->i0 = 0; fb->i0 < fftlen; fb->i0++ )
+      if( (freq = f0 + fb->i0 * df) >= fmin )
+	break;
+    for( i1 = fftlen - 1; i1 >= 0; i1-- )
+      if( (freq = f0 + i1 * df) <= fmax )
+	break;
+  }
+  fb->nchans = (i1 - fb->i0 + 1) / fb->bin;
+  if( fb->nchans < 1 ) {
+    fprintf( stderr, "No whole channel of %d bins in the band\n", fb->bin );
+    exit(1);
+  }
+  fb->foff = df * fb->bin / 1e6;
+  fb->fch1 = (f0 + (fb->i0 + (fb->bin - 1) / 2.0) * df) / 1e6;
+  fb->tsamp = tsamp;
+  fb->rowbytes = (long long)fb->nifs * fb->nchans * fb->nbits / 8;
+  fb->hdrlen = 0;
+  fb->scaled = fb->nbits == 32;
+
+  fb->chan = (float *)malloc( fb->nifs * fb->nchans * sizeof(float) );
+  fb->row = malloc( fb->rowbytes );
+  if( !fb->chan || !fb->row ) {
+    fprintf( stderr, "Malloc error\n" );
+    exit(1);
+  }
+  for( i = 0; i < fb->nifs * fb->nchans; i++ )
+    fb->chan[i] = 0;
+}
+
+static long long fb_string( fp, s )
+FILE *fp;
+char *s;
+{
+  int len = strlen( s );
+
+  fwrite( &len, sizeof(int), 1, fp );
+  fwrite( s, 1, len, fp );
+  return( sizeof(int) + len );
+}
+
+static long long fb_int( fp, key, value )
+FILE *fp;
+char *key;
+int value;
+{
+  return( fb_string( fp, key ) + fwrite( &value, 1, sizeof(int), fp ));
+}
+
+static long long fb_double( fp, key, value )
+FILE *fp;
+char *key;
+double value;
+{
+  return( fb_string( fp, key ) + fwrite( &value, 1, sizeof(double), fp ));
+}
+
+/* writes the header, returns its length; tstart is not known and is 0 */
+
+long long fb_header( fb, fp, source )
+struct FBANK *fb;
+FILE *fp;
+char *source;
+{
+  long long n;
+
+  n = fb_string( fp, "HEADER_START" );
+  n += fb_string( fp, "rawdatafile" ) + fb_string( fp, source );
+  n += fb_string( fp, "source_name" ) + fb_string( fp, source );
+  n += fb_int( fp, "machine_id", 0 );
+  n += fb_int( fp, "telescope_id", 0 );
+  n += fb_int( fp, "data_type", 1 );		/* filterbank */
+  n += fb_double( fp, "fch1", fb->fch1 );
+  n += fb_double( fp, "foff", fb->foff );
+  n += fb_int( fp, "nchans", fb->nchans );
+  n += fb_int( fp, "nbits", fb->nbits );
+  n += fb_int( fp, "nifs", fb->nifs );
+  n += fb_double( fp, "tstart", 0.0 );
+  n += fb_double( fp, "tsamp", fb->tsamp );
+  n += fb_string( fp, "HEADER_END" );
+  fb->hdrlen = n;
+  return( n );
+}
+
+/* the mean and rms of the first row, 3.5 sigma outliers excluded, set
+   the counts */
+
+static void fb_scale( fb )
+struct FBANK *fb;
+{
+  double s, s2, mean, rms, lim;
+  int i, j, n, len = fb->nifs * fb->nchans;
+
+  mean = 0;
+  lim = HUGE_VAL;
+  rms = 0;
+  for( j = 0; j < 2; j++ ) {
+    s = s2 = 0;
+    n = 0;
+    for( i = 0; i < len; i++ )
+      if( fabs( fb->chan[i] - mean ) <= lim ) {
+	s += fb->chan[i];
+	s2 += fb->chan[i] * fb->chan[i];
+	n++;
+      }
+    if( n == 0 )
+      break;
+    mean = s / n;
+    rms = sqrt( s2 / n - mean * mean );
+    lim = 3.5 * rms;
+  }
+  fb->scale = rms > 0 ? (1 << fb->nbits) / (FBSIGMAS * rms) : 1;
+  fb->zero = (1 << fb->nbits) / 4 - fb->scale * mean;
+  fb->scaled = 1;
+}
+
+/* writes one row from nifs spectra of fftlen bins; returns -1 on error */
+
+int fb_write( fb, spectra, fp )
+struct FBANK *fb;
+float *spectra;
+FILE *fp;
+{
+  unsigned short *u16 = (unsigned short *)fb->row;
+  unsigned char *u8 = (unsigned char *)fb->row;
+  float *p, *c = fb->chan;
+  double v, max;
+  int s, i, k;
+
+  for( s = 0; s < fb->nifs; s++ ) {
+    p = &spectra[(long long)s * fb->fftlen + fb->i0];
+    if( fb->bin == 1 )
+      memcpy( c, p, fb->nchans * sizeof(float) );
+    else
+      for( i = 0; i < fb->nchans; i++, p += fb->bin ) {
+	c[i] = 0;
+	for( k = 0; k < fb->bin; k++ )
+	  c[i] += p[k];
+      }
+    if( fb->dB )
+      for( i = 0; i < fb->nchans; i++ )
+	c[i] = 10*log10( c[i] );
+    c += fb->nchans;
+  }
+
+  if( fb->nbits == 32 )
+    return( fwrite( fb->chan, fb->rowbytes, 1, fp ) == 1 ? 0 : -1 );
+
+  if( !fb->scaled )
+    fb_scale( fb );
+  max = (1 << fb->nbits) - 1;
+  for( i = 0; i < fb->nifs * fb->nchans; i++ ) {
+    v = rint( fb->zero + fb->scale * fb->chan[i] );
+    v = v < 0 ? 0 : v > max ? max : v;
+    if( fb->nbits == 16 )
+      u16[i] = v;
+    else
+      u8[i] = v;
+  }
+  return( fwrite( fb->row, fb->rowbytes, 1, fp ) == 1 ? 0 : -1 );
+}
+
+void fb_describe( fb, fp )
+struct FBANK *fb;
+FILE *fp;
+{
+  fprintf( fp, "%-31s: %d x %d, %d bits\n", "Filterbank spectra x channels", fb->nifs, fb->nchans, fb->nbits );
+  fprintf( fp, "%-31s: %.9f, %.9f MHz\n", "Filterbank fch1, foff", fb->fch1, fb->foff );
+  if( fb->bin > 1 )
+    fprintf( fp, "%-31s: %d\n", "Bins per channel", fb->bin );
+  fprintf( fp, "%-31s: %lld\n", "Bytes per row", fb->rowbytes );
+}
@@ -1,21 +1,31 @@
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/vfs.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #include "multifile.h"
+#include "crc32c.h"
 
 #ifndef O_LARGEFILE
 #define O_LARGEFILE 0
 #endif
 
-/* a layer to supprt multiple file writes */
-
-#define TERABYTE 500
+/* a layer to supprt multiple file writes, and reads of the result */
 
 #define TENGIGS 10000000000LL
 #define TWOGIGS  (0x7fffffff)
 
+static int multi_next();
+static void multi_later();
+
 static struct MULITCONST {
   long long maxfilesize;
   int largefile;
@@ -35,6 +45,14 @@ long long max;
     multi.maxfilesize = max;
 }
 
+/*
+  files other than the first are opened only when the data reaches them,
+  and finished files are closed by a background thread so that neither
+  costs the writer any time.  the first file is opened right away so that
+  O_EXCL and permission problems show up at multi_open.  nfiles limits
+  the number of files, 0 for no limit.
+*/
+
 struct MULTIFILE *multi_open( prefix, openpar, mask, nfiles )
 char *prefix;
 unsigned int openpar;
@@ -42,100 +60,602 @@ int mask;
 int nfiles;
 {
   struct MULTIFILE *m;
-  char filename[256];
-  struct statfs fs;
-  long long avail, inc;
-  int fd, n;
 
   m = (struct MULTIFILE *)malloc(sizeof(struct MULTIFILE));
   bzero( m, sizeof(struct MULTIFILE));
+  strncpy( m->name, prefix, sizeof(m->name)-1 );
+  m->openpar = openpar;
+  m->mask = mask;
+  m->max_file = nfiles;
+  m->max = multi.maxfilesize;
+  m->fd = -1;
 
-  for( n=0; n<nfiles; n++ ) {
-    strncpy( m->name, prefix, sizeof(m->name) );
-    sprintf( filename, "%s.%03d", prefix, n );
-   
-    if( (fd = open( filename, openpar|multi.largefile, mask ))<0 ) {
-      perror("open"); 
-      free(m);
-      return(NULL);
-    }
-    m->fd[ m->max_file++ ] = fd;
+  if( multi_next(m) < 0 ) {
+    free(m);
+    return(NULL);
   }
-  m->max = multi.maxfilesize;
   return(m);
 }
 
-multi_close(m)
+/* open file number cur_file */
+
+static int multi_next(m)
 struct MULTIFILE *m;
 {
-  int i;
-  char name[256];
-
-  for( i=m->cur_file; i<m->max_file; i++ )
-     close( m->fd[ i ] );
+  char filename[300];
 
-  for( i=m->cur_file+1; i<m->max_file; i++ ) {
-      sprintf( name, "%s.%03d", m->name, i );
-      if( unlink( name ) < 0 )
-        perror("removing file");
-      printf("removing unused file: %s\n", name );
+  if( m->max_file > 0 && m->cur_file >= m->max_file )
+    return(-1);
+  sprintf( filename, "%s.%03d", m->name, m->cur_file );
+  if( (m->fd = open( filename, m->openpar|multi.largefile, m->mask ))<0 ) {
+    perror( filename ); 
+    return(-1);
   }
+  m->cur_off = 0;
+  return(0);
+}
+
+multi_close(m)
+struct MULTIFILE *m;
+{
+  if( m->fd >= 0 )
+    multi_later( m->fd, NULL );
+
+  if( m->crcfp )
+    fclose( m->crcfp );
   
   free(m);
   return(0);
 }
 
 /*
-  make the interface just like write
-  cant have len > TWOGIGS
+  keep a CRC32C of every block written in the sidecar file prefix.crc,
+  one line per block: file number, offset in that file, length, crc.
+  a block that crosses a file boundary is recorded as one piece per file
+  so each line can be checked against a single file.  pfs_verify reads it.
+*/
+
+int multi_crc(m)
+struct MULTIFILE *m;
+{
+  char name[300];
+
+  sprintf( name, "%s.crc", m->name );
+  if( (m->crcfp = fopen( name, "w" )) == NULL ) {
+    perror("multi_crc");
+    return(-1);
+  }
+  fprintf( m->crcfp, "# pfs crc32c file offset length crc\n");
+  return(0);
+}
+
+static void multi_crc_piece( m, buf, len )
+struct MULTIFILE *m;
+char *buf;
+size_t len;
+{
+  fprintf( m->crcfp, "%03d %lld %lld %08x\n", m->cur_file, m->cur_off, 
+	   (long long)len, crc32c( 0, (unsigned char *)buf, len ));
+  fflush( m->crcfp );
+}
+
+/*
+  make the interface just like write.  any length, a write may run
+  through as many files as it needs.  returns the number of bytes
+  written, short if the file limit is reached, -1 on error.
 */
 
-int multi_write(m, buf, len )
+ssize_t multi_write(m, buf, len )
 struct MULTIFILE *m;
 char *buf;
+size_t len;
+{
+  size_t done, want;
+  ssize_t n, got;
+
+  for( done=0; done<len; ) {
+    if( m->cur_off >= m->max ) {
+      multi_later( m->fd, NULL );
+      m->fd = -1;
+      m->cur_file++;
+    }
+    if( m->fd < 0 && multi_next(m) < 0 )
+      return( done ? done : -1 );
+
+    want = len - done;
+    if( want > m->max - m->cur_off )
+      want = m->max - m->cur_off;
+
+    for( got=0; got<want; got+=n )
+      if((n = write( m->fd, &buf[done+got], want-got )) <= 0 ) {
+        perror( "multi_write");
+        return(-1);
+      }
+    if( m->crcfp )
+      multi_crc_piece( m, &buf[done], want );
+
+    m->cur_off += want;
+    done += want;
+  }
+  return(done);
+}
+
+/*
+  background closes and unlinks.  closing a file with a lot of dirty
+  pages, or unlinking a big one, can take a long time on some file
+  systems; a single thread does them in order.  multi_drain() waits
+  until all of them are done, call it before exiting.
+*/
+
+struct LATER {
+  int fd;
+  char *path;
+  struct LATER *next;
+};
+
+static struct {
+  struct LATER *head, *tail;
+  int busy;
+  int started;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t proc;
+} later = { NULL, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void *multi_reaper( arg )
+void *arg;
+{
+  struct LATER *l;
+
+  pthread_mutex_lock( &later.lock );
+  while( 1 ) {
+    while( !later.head )
+      pthread_cond_wait( &later.cond, &later.lock );
+    l = later.head;
+    if( !(later.head = l->next) )
+      later.tail = NULL;
+    later.busy = 1;
+    pthread_mutex_unlock( &later.lock );
+
+    if( l->fd >= 0 )
+      close( l->fd );
+    if( l->path ) {
+      unlink( l->path );
+      free( l->path );
+    }
+    free( l );
+
+    pthread_mutex_lock( &later.lock );
+    later.busy = 0;
+    pthread_cond_broadcast( &later.cond );
+  }
+  return(NULL);
+}
+
+static void multi_later( fd, path )
+int fd;
+char *path;
+{
+  struct LATER *l;
+
+  l = (struct LATER *)malloc(sizeof(struct LATER));
+  l->fd = fd;
+  l->path = path ? strdup(path) : NULL;
+  l->next = NULL;
+
+  pthread_mutex_lock( &later.lock );
+  if( !later.started ) {
+    if( pthread_create( &later.proc, NULL, multi_reaper, NULL )) {
+      /* no thread, do it here */
+      pthread_mutex_unlock( &later.lock );
+      if( fd >= 0 )
+        close( fd );
+      if( path )
+        unlink( path );
+      free( l->path );
+      free( l );
+      return;
+    }
+    pthread_detach( later.proc );
+    later.started = 1;
+  }
+  if( later.tail )
+    later.tail->next = l;
+  else
+    later.head = l;
+  later.tail = l;
+  pthread_cond_broadcast( &later.cond );
+  pthread_mutex_unlock( &later.lock );
+}
+
+int multi_unlink( path )
+char *path;
+{
+  multi_later( -1, path );
+  return(0);
+}
+
+int multi_drain()
+{
+  pthread_mutex_lock( &later.lock );
+  while( later.head || later.busy )
+    pthread_cond_wait( &later.cond, &later.lock );
+  pthread_mutex_unlock( &later.lock );
+  return(0);
+}
+
+/*
+  read side.  multi_ropen( name, span ) opens
+
+    "-"                stdin, read sequentially
+    name               that file alone, or with span set, that file and
+                       the ones following it if name ends in .NNN
+    prefix             when prefix itself does not exist but prefix.000
+                       does, the whole recording set
+
+  and presents the files as one stream.  reads that cross a file boundary
+  go straight into the caller's buffer, one pread per file.
+*/
+
+#define READAHEAD (16*1024*1024)
+
+/* closes the n files opened so far and frees m */
+
+static struct MULTIREAD *multi_rfail( m, n )
+struct MULTIREAD *m;
+int n;
+{
+  while( n-- > 0 )
+    close( m->fd[n] );
+  free( m->fd );
+  free( m->start );
+  free( m );
+  return(NULL);
+}
+
+struct MULTIREAD *multi_ropen( name, span )
+char *name;
+int span;
+{
+  struct MULTIREAD *m;
+  struct stat st;
+  char filename[300];
+  char *p;
+  int fd, n, first, digits;
+
+  m = (struct MULTIREAD *)malloc(sizeof(struct MULTIREAD));
+  bzero( m, sizeof(struct MULTIREAD));
+  strncpy( m->name, name, sizeof(m->name)-1 );
+  m->fd = (int *)malloc( sizeof(int) );
+  m->start = (long long *)malloc( 2*sizeof(long long) );
+  m->start[0] = 0;
+
+  if( strcmp( name, "-" ) == 0 ) {
+    m->fd[0] = 0;
+    m->nfiles = 1;
+    m->start[1] = -1;
+    return(m);
+  }
+
+  /* find the first file and where the numbering continues */
+  first = -1;
+  if( access( name, F_OK ) != 0 ) {
+    sprintf( filename, "%s.000", name );
+    if( access( filename, F_OK ) != 0 ) {
+      perror( name );
+      return( multi_rfail( m, 0 ));
+    }
+    first = 0;
+  } else if( span && (p = strrchr( m->name, '.' )) ) {
+    for( digits=0; isdigit(p[1+digits]); digits++ )
+      ;
+    if( digits == 3 && p[4] == 0 ) {
+      first = atoi( p+1 );
+      *p = 0;
+    }
+  }
+
+  for( n=0; ; n++ ) {
+    if( first < 0 )
+      strcpy( filename, name );
+    else
+      sprintf( filename, "%s.%03d", m->name, first+n );
+    if( (fd = open( filename, O_RDONLY|O_LARGEFILE )) < 0 ) {
+      if( n > 0 )
+        break;
+      perror( filename );
+      return( multi_rfail( m, n ));
+    }
+    fstat( fd, &st );
+    m->fd = (int *)realloc( m->fd, (n+1)*sizeof(int) );
+    m->start = (long long *)realloc( m->start, (n+2)*sizeof(long long) );
+    m->fd[n] = fd;
+    m->start[n+1] = m->start[n] + st.st_size;
+    if( !S_ISREG( st.st_mode )) {
+      m->start[n+1] = -1;
+      n++;
+      break;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+    if( first < 0 ) {
+      n++;
+      break;
+    }
+  }
+  m->nfiles = n;
+  m->seekable = m->start[n] >= 0;
+  return(m);
+}
+
+int multi_rclose(m)
+struct MULTIREAD *m;
+{
+  int i;
+
+  multi_map( m, 0, 0 );
+  for( i=0; i<m->nfiles; i++ )
+    if( m->fd[i] != 0 )
+      close( m->fd[i] );
+  free( m->fd );
+  free( m->start );
+  free( m );
+  return(0);
+}
+
+/* size of the stream in bytes, -1 if it can't be known */
+
+long long multi_size(m)
+struct MULTIREAD *m;
+{
+  return( m->start[m->nfiles] );
+}
+
+/* appends device, inode, size and modification time of each file to
+   buf, a string of len bytes, so a later run can tell the same data;
+   -1 for stdin or a pipe, or if buf is too short */
+
+int multi_ident( m, buf, len )
+struct MULTIREAD *m;
+char *buf;
 int len;
 {
-  long long off, wrt;
-  int wlen, retlenlast, retlen;
+  struct stat st;
+  int i, n;
+
+  if( !m->seekable )
+    return(-1);
+  for( i=0; i<m->nfiles; i++ ) {
+    if( fstat( m->fd[i], &st ) < 0 )
+      return(-1);
+    n = strlen( buf );
+    if( snprintf( buf+n, len-n, "%llx:%llx:%lld:%ld.%09ld;", (long long)st.st_dev,
+		  (long long)st.st_ino, (long long)st.st_size, (long)st.st_mtim.tv_sec,
+		  (long)st.st_mtim.tv_nsec ) >= len-n )
+      return(-1);
+  }
+  return(0);
+}
+
+/* index of the file holding stream offset off: the last one starting at
+   or before it.  m is not written, so threads may share one MULTIREAD */
+
+static int multi_find( m, off )
+struct MULTIREAD *m;
+long long off;
+{
+  int lo = 0, hi = m->nfiles-1, k;
+
+  while( lo < hi ) {
+    k = (lo + hi + 1) / 2;
+    if( off >= m->start[k] )
+      lo = k;
+    else
+      hi = k-1;
+  }
+  return(lo);
+}
+
+long long multi_pread( m, buf, len, off )
+struct MULTIREAD *m;
+char *buf;
+long long len;
+long long off;
+{
+  long long got, want;
+  ssize_t n = 0;
+  int k;
+
+  if( !m->seekable ) {
+    if( off != m->pos ) {
+      errno = ESPIPE;
+      return(-1);
+    }
+    for( got=0; got<len; got+=n )
+      if( (n = read( m->fd[0], &buf[got], len-got )) <= 0 )
+        break;
+    return( n < 0 && got == 0 ? -1 : got );
+  }
+
+  for( got=0; got<len && off+got < m->start[m->nfiles]; got+=n ) {
+    k = multi_find( m, off+got );
+    want = m->start[k+1] - (off+got);
+    if( want > len-got )
+      want = len-got;
+    if( (n = pread( m->fd[k], &buf[got], want, off+got - m->start[k] )) <= 0 ) {
+      if( n < 0 && got == 0 )
+        return(-1);
+      break;
+    }
+  }
+  return(got);
+}
 
-   off = m->cur_off + len;
-   retlen = 0;
-   retlenlast = 0;
+/* hint the kernel to fetch [off, off+len), across file boundaries */
 
-   /* printf("called multi_write %d\n", len );  */
-   if( m->cur_file >= m->max_file )
-     return(-1);
+static void multi_advise( m, off, len )
+struct MULTIREAD *m;
+long long off;
+long long len;
+{
+#ifdef POSIX_FADV_WILLNEED
+  long long n;
+  int k;
 
-   if( off > m->max ) {
-     wlen = m->max - m->cur_off; 
+  while( len > 0 && off < m->start[m->nfiles] ) {
+    k = multi_find( m, off );
+    n = m->start[k+1] - off;
+    if( n > len )
+      n = len;
+    posix_fadvise( m->fd[k], off - m->start[k], n, POSIX_FADV_WILLNEED );
+    off += n;
+    len -= n;
+  }
+#endif
+}
 
+long long multi_read( m, buf, len )
+struct MULTIREAD *m;
+char *buf;
+long long len;
+{
+  long long n, want;
 
-     /* printf( "big writing %d bytes at off %ld file %d, fd %d\n", wlen, off, 
-	m->cur_file, m->fd[m->cur_file]); */
+  if( (n = multi_pread( m, buf, len, m->pos )) > 0 )
+    m->pos += n;
 
+  /* keep the next reads in flight, including the start of the next file */
+  if( m->seekable ) {
+    want = 2*len > READAHEAD ? 2*len : READAHEAD;
+    if( m->ahead < m->pos + want/2 ) {
+      if( m->ahead < m->pos )
+        m->ahead = m->pos;
+      multi_advise( m, m->ahead, m->pos + want - m->ahead );
+      m->ahead = m->pos + want;
+    }
+  }
+  return(n);
+}
 
-     if((retlenlast = write( m->fd[m->cur_file], buf, wlen )) != wlen ) {
-       perror( "multi_write");
-       return(-1);
-     }
-     m->cur_off = 0;
-     wlen = len - wlen;
-     /* printf(" closing file %d, fd %d\n", m->cur_file, m->fd[m->cur_file]); */
-     /* close( m->fd[m->cur_file]); */
-     if( ++m->cur_file >= m->max_file )
-        return(retlenlast);
-   } else
-    wlen = len;
+long long multi_lseek( m, off, whence )
+struct MULTIREAD *m;
+long long off;
+int whence;
+{
+  char skip[65536];
+  long long n;
 
-   /* printf( "writing %d bytes at file %d, off %ld, fd %d\n", wlen, off,
-      m->cur_file, m->fd[m->cur_file]); */
+  if( whence == SEEK_CUR )
+    off += m->pos;
+  else if( whence == SEEK_END ) {
+    if( !m->seekable ) {
+      errno = ESPIPE;
+      return(-1);
+    }
+    off += m->start[m->nfiles];
+  }
+  if( off < 0 ) {
+    errno = EINVAL;
+    return(-1);
+  }
 
-  if((retlen = write( m->fd[m->cur_file], &buf[retlenlast], wlen )) != wlen) {
-     perror( "multi_write");
-     return(-1);
+  /* a pipe can only skip forward */
+  if( !m->seekable ) {
+    if( off < m->pos ) {
+      errno = ESPIPE;
+      return(-1);
+    }
+    while( m->pos < off ) {
+      n = off - m->pos > sizeof(skip) ? sizeof(skip) : off - m->pos;
+      if( (n = multi_pread( m, skip, n, m->pos )) <= 0 )
+        return(-1);
+      m->pos += n;
+    }
+    return(m->pos);
   }
 
-  m->cur_off += wlen;
-  return(retlen+retlenlast);
+  m->pos = off;
+  m->ahead = off;
+  return(m->pos);
 }
 
+/*
+  return a pointer to bytes [off, off+len) of the stream, valid until the
+  next multi_map or multi_rclose.  the window is mmap'ed from the files; a
+  window across a file boundary is still one mapping when the earlier files
+  are a multiple of the page size, otherwise (and for pipes) it is read into
+  a buffer.  returns NULL past the end of the stream.  len 0 releases it.
+*/
+
+char *multi_map( m, off, len )
+struct MULTIREAD *m;
+long long off;
+long long len;
+{
+  long long page, foff, delta, piece, at, need;
+  char *base, *p;
+  int k, k0, aligned;
+
+  if( m->win ) {
+    if( m->winmapped )
+      munmap( m->win, m->winlen );
+    else
+      free( m->win );
+    m->win = NULL;
+  }
+  if( len <= 0 )
+    return(NULL);
+  if( m->seekable && off+len > m->start[m->nfiles] )
+    return(NULL);
+
+  page = sysconf(_SC_PAGESIZE);
+  if( m->seekable ) {
+    k0 = multi_find( m, off );
+    foff = off - m->start[k0];
+    delta = foff % page;
+
+    aligned = 1;
+    for( k=k0+1; k<m->nfiles && m->start[k] < off+len; k++ )
+      if( (m->start[k] - m->start[k0]) % page )
+        aligned = 0;
+
+    if( aligned ) {
+      need = delta + len;
+      m->winlen = (need + page-1) / page * page;
+      base = mmap( NULL, m->winlen, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+      if( base != MAP_FAILED ) {
+        for( at=0, k=k0; at < need; at += piece, k++ ) {
+          piece = (m->start[k+1] - m->start[k]) - (foff - delta);
+          if( piece > (long long)m->winlen - at )
+            piece = m->winlen - at;
+          p = mmap( base+at, piece, PROT_READ, MAP_SHARED|MAP_FIXED, m->fd[k], 
+		    foff - delta );
+          if( p == MAP_FAILED )
+            break;
+          foff = delta = 0;
+        }
+        if( at >= need ) {
+          m->win = base;
+          m->winmapped = 1;
+          return( base + (need - len) );
+        }
+        munmap( base, m->winlen );
+      }
+    }
+  }
+
+  /* fall back to a copy */
+  if( !(m->win = (char *)malloc( len )))
+    return(NULL);
+  m->winlen = len;
+  m->winmapped = 0;
+  if( multi_pread( m, m->win, len, off ) != len ) {
+    free( m->win );
+    m->win = NULL;
+    return(NULL);
+  }
+  if( !m->seekable )
+    m->pos += len;
+  return( m->win );
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pfb.h"
+
+/*
+  Critically sampled polyphase filterbank.  A spectrum of nchan channels
+  is computed from ntaps consecutive blocks of nchan samples: each block
+  is weighted by its section of a prototype low-pass filter (a windowed
+  sinc ntaps*nchan long, cutoff at the channel spacing), the blocks are
+  summed, and the sum goes through the usual FFT.  Successive spectra
+  start one block apart, so the data are read once and the FFT count is
+  unchanged; the fold costs ntaps multiply-adds per sample.  Compared to
+  the FFT of one block, the channels are flat-topped and a strong carrier
+  leaks orders of magnitude less into distant channels.
+
+  usage:  pfb_parse( "8,hamming", &ntaps, window );    from -B
+          f = pfb_create( fftlen, ntaps, window );
+          blk[p] = block p, oldest first, p < ntaps
+          pfb_fold( f, blk, fftinbuf, 2 );            2 complex, 1 real
+*/
+
+#define PFBTAPS 4		/* default taps per channel */
+
+static double pfb_window( name, x )
+char *name;
+double x;			/* 0 to 1 across the filter */
+{
+  if( strcmp( name, "rect" ) == 0 )
+    return( 1.0 );
+  if( strcmp( name, "hann" ) == 0 )
+    return( 0.5 - 0.5*cos( 2*M_PI*x ));
+  if( strcmp( name, "blackman" ) == 0 )
+    return( 0.42 - 0.5*cos( 2*M_PI*x ) + 0.08*cos( 4*M_PI*x ));
+  if( strcmp( name, "nuttall" ) == 0 )
+    return( 0.355768 - 0.487396*cos( 2*M_PI*x ) + 0.144232*cos( 4*M_PI*x )
+	    - 0.012604*cos( 6*M_PI*x ));
+  return( 0.54 - 0.46*cos( 2*M_PI*x ));		/* hamming */
+}
+
+/* "taps[,window]", window one of hamming, hann, blackman, nuttall, rect */
+
+int pfb_parse( arg, ntaps, window )
+char *arg;
+int *ntaps;
+char *window;
+{
+  char *p;
+
+  *ntaps = PFBTAPS;
+  strcpy( window, "hamming" );
+  if( *arg && *arg != ',' && (*ntaps = atoi( arg )) < 1 )
+    return(-1);
+  if( (p = strchr( arg, ',' )) ) {
+    p++;
+    if( strcmp( p, "hamming" ) && strcmp( p, "hann" ) && strcmp( p, "blackman" )
+	&& strcmp( p, "nuttall" ) && strcmp( p, "rect" ))
+      return(-1);
+    strcpy( window, p );
+  }
+  return(0);
+}
+
+struct PFB *pfb_create( nchan, ntaps, window )
+int nchan;
+int ntaps;
+char *window;
+{
+  struct PFB *f;
+  double c, x, sum;
+  int len, i;
+
+  len = nchan * ntaps;
+  f = (struct PFB *)malloc( sizeof(struct PFB) );
+  if( !f || !(f->coeff = (float *)malloc( len * sizeof(float) )) ) {
+    fprintf( stderr, "Malloc error\n" );
+    exit(1);
+  }
+  f->nchan = nchan;
+  f->ntaps = ntaps;
+  strncpy( f->window, window, sizeof(f->window)-1 );
+  f->window[sizeof(f->window)-1] = 0;
+
+  /* 
+     sinc with its first zeros one block from the center, so that a
+     channel is as wide as the channel spacing
+  */
+  c = (len - 1) / 2.0;
+  sum = 0;
+  for( i=0; i<len; i++ ) {
+    x = (i - c) / nchan;
+    f->coeff[i] = (x == 0 ? 1 : sin( M_PI*x ) / (M_PI*x)) 
+      * pfb_window( window, len > 1 ? (double)i / (len - 1) : 0.5 );
+    sum += f->coeff[i];
+  }
+
+  /* unit weight per block on average, so powers compare to a plain FFT */
+  for( i=0; i<len; i++ )
+    f->coeff[i] *= nchan / sum;
+
+  return( f );
+}
+
+/* 
+  weight and sum ntaps blocks of nchan samples into out, ncomp numbers
+  per sample (2 complex, 1 real)
+*/
+
+void pfb_fold( f, blk, out, ncomp )
+struct PFB *f;
+float **blk;
+float *out;
+int ncomp;
+{
+  float *c, *x;
+  int p, j;
+
+  memset( out, 0, ncomp * f->nchan * sizeof(float) );
+  for( p=0; p<f->ntaps; p++ ) {
+    c = &f->coeff[p * f->nchan];
+    x = blk[p];
+    if( ncomp == 2 )
+      for( j=0; j<f->nchan; j++ ) {
+	out[2*j]   += c[j] * x[2*j];
+	out[2*j+1] += c[j] * x[2*j+1];
+      }
+    else
+      for( j=0; j<f->nchan; j++ )
+	out[j] += c[j] * x[j];
+  }
+}
+
+void pfb_free( f )
+struct PFB *f;
+{
+  if( f ) {
+    free( f->coeff );
+    free( f );
+  }
+}
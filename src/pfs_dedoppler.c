@@ -0,0 +1,698 @@
+/*******************************************************************************
+*  program pfs_dedoppler
+*  $Id$
+*  This program searches the dynamic spectra written by pfs_fft_2 -t, in
+*  HDF5 (-h) or binary form, for narrowband signals whose frequency drifts
+*  linearly with time.
+*
+*  usage:
+*  	pfs_dedoppler [-n spectra per search]
+*		      [-s SNR threshold]
+*		      [-D maximum drift rate (Hz/s)]
+*		      [-i feed]
+*		      [-c channels[,feeds] -r frequency resolution (Hz)
+*		       -T time between spectra (s) [-F center frequency (Hz)]]
+*		      [-j threads]
+*		      [-o outfile] infile
+*
+*  input:
+*       the input parameters are typed in as command line arguments
+*	the -n argument specifies how many consecutive spectra are summed
+*			along each drift line, a power of 2 (default 16);
+*			the input is searched in successive groups of that
+*			many spectra, read as they come, and a short last
+*			group is ignored
+*	the -s argument specifies the SNR above which a drift line is
+*			reported (default 10)
+*	the -D argument limits the drift rates searched, either sign
+*			(default, and at most, one channel per spectrum)
+*	the -i argument selects the feed (HDF5 nifs index, or spectrum
+*			within a -t record) to search, 0 for the first
+*	the -j argument specifies the number of worker threads (default 4)
+*	an HDF5 file is recognized as such and described by its fch1, foff
+*			and tsamp attributes; any other input, or - for
+*			stdin, is a stream of -t -b records of feeds spectra
+*			of the -c channels each, and needs -r and -T
+*	the -F argument specifies the frequency of channel nchans/2 of a
+*			binary input, i.e. the band center of the records
+*			(default 0)
+*
+*  output:
+*	the -o option identifies the output file, stdout is default
+*	one line per hit: first spectrum of the group, its time (s),
+*			channel where the line starts, its frequency (Hz),
+*			drift rate (Hz/s), drift in channels over the
+*			group, and SNR
+*
+*  method:
+*	the drift lines through n spectra are summed with the tree of
+*	Taylor (1974, A&AS 15, 367), in log2(n) passes of n sums per
+*	channel instead of n^2.  The band is cut into blocks that, with the
+*	n-1 channels a line can reach beyond them, fit in cache, and the
+*	blocks are shared among the threads.  Each block is searched for
+*	positive drifts, then mirrored in frequency for negative ones.  The
+*	SNR of a line is its sum less the mean over the block at the same
+*	drift, over their rms with outliers clipped.  Of the lines starting
+*	within one maximum drift of each other, only the one with the best
+*	SNR at any drift is reported.
+*
+*******************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <hdf5.h>
+
+/* revision control variable */
+static char const rcsid[] =
+"$Id$";
+
+#define DDCACHE   (1 << 20)	/* bytes of tree per thread, both buffers */
+#define DDSTRIPE  (256 << 20)	/* bytes of spectra read at a time */
+#define DDCLIP    5.0		/* sigmas beyond which lines leave the noise */
+#define DDMINSTAT 16		/* fewest lines for a noise estimate */
+
+struct DDIN {
+  char *name;
+  int hdf5;			/* HDF5 file, else binary records */
+  hid_t file, dset;
+  int fd;
+  long long rows;		/* spectra, -1 if unknown */
+  int nifs;			/* feeds per record */
+  int feed;			/* the one searched */
+  int nchans;
+  double foff;			/* channel spacing, Hz */
+  double f0;			/* frequency of channel 0, Hz */
+  double tsamp;			/* time between spectra, s */
+  float *rec;			/* binary: n records of the group held */
+  long long held;		/* first spectrum in rec, -1 for none */
+};
+
+struct DDIN in;			/* the input */
+int     nrows;			/* spectra per group, n */
+int     maxd;			/* largest drift searched, channels */
+float   snrmin;			/* report threshold */
+int     nthreads;
+int     blockw;			/* channels per block */
+int     stripew;		/* channels per stripe, a multiple of blockw */
+float  *data;			/* n rows of the stripe and n-1 channels each side */
+int     dataw;			/* stripe width + 2(n-1) */
+int     s0, sw;			/* first channel and width of the stripe */
+float  *best;			/* per channel of the stripe, best SNR */
+int    *bestd;			/* and its drift, signed channels */
+
+FILE   *fpoutput;		/* pointer to output file */
+char   *outfile;		/* output file name */
+
+char	command_line[512];	/* command line assembled by processargs */
+
+void processargs();
+void open_file();
+void copy_cmd_line();
+void open_input(struct DDIN *in);
+int  read_stripe(struct DDIN *in, long long t0, int c0, int nc, float *buf, int stride);
+float *taylor(float *a, float *b, int n, int w);
+void *search();
+int  report(long long t0);
+
+int main(int argc, char *argv[])
+{
+  pthread_t *proc;
+  long long t0;		/* first spectrum of the group */
+  long long nhits=0;
+  long long ngroups=0;
+  double maxrate;	/* -D, Hz/s */
+  double drift1;	/* Hz/s of one channel of drift */
+  int lo, hi;		/* channels of the stripe that exist */
+  int t;
+
+  /* get the command line arguments */
+  memset(&in, 0, sizeof(in));
+  processargs(argc,argv,&in.name,&outfile,&nrows,&snrmin,&maxrate,&in.feed,&in.nchans,&in.nifs,&in.foff,&in.tsamp,&in.f0,&nthreads);
+
+  /* save the command line */
+  copy_cmd_line(argc,argv,command_line);
+
+  /* open input, binary records start at frequency f0 of channel nchans/2 */
+  open_input(&in);
+
+  /* drifts searched */
+  drift1 = in.foff / ((nrows - 1) * in.tsamp);
+  maxd = nrows - 1;
+  if (maxrate > 0 && maxrate < maxd * fabs(drift1))
+    maxd = (int) (maxrate / fabs(drift1));
+  if (maxrate > 0 && maxrate > (nrows - 1) * fabs(drift1))
+    fprintf(stderr,"Drift rates limited to one channel per spectrum, %g Hz/s\n",
+	    (nrows - 1) * fabs(drift1));
+
+  /* blocks that fit in cache, stripes that fit in DDSTRIPE; a binary
+     input is read whole records at a time, so it is one stripe */
+  blockw = DDCACHE / (2 * sizeof(float) * nrows) - (nrows - 1);
+  if (blockw < nrows) blockw = nrows;
+  if (blockw > in.nchans) blockw = in.nchans;
+  stripew = DDSTRIPE / (sizeof(float) * nrows) - 2 * (nrows - 1);
+  stripew = stripew / blockw * blockw;
+  if (stripew < blockw) stripew = blockw;
+  if (stripew > in.nchans || !in.hdf5) stripew = in.nchans;
+  dataw = stripew + 2 * (nrows - 1);
+
+  data  = (float *) malloc((size_t) nrows * dataw * sizeof(float));
+  best  = (float *) malloc(stripew * sizeof(float));
+  bestd = (int *) malloc(stripew * sizeof(int));
+  proc  = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+  if (!data || !best || !bestd || !proc)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+
+  /* open output file, stdout default */
+  open_file(outfile,&fpoutput);
+
+  /* describe what we are doing */
+  fprintf(stderr,"\n%s\n\n",command_line);
+  fprintf(stderr,"%-31s: %s\n","Input format",in.hdf5 ? "HDF5" : "binary");
+  fprintf(stderr,"%-31s: %d\n","Channels",in.nchans);
+  fprintf(stderr,"%-31s: %d of %d\n","Feed",in.feed,in.nifs);
+  fprintf(stderr,"%-31s: %e Hz\n","Channel spacing",in.foff);
+  fprintf(stderr,"%-31s: %e s\n","Time between spectra",in.tsamp);
+  if (in.rows >= 0)
+    fprintf(stderr,"%-31s: %lld\n","Spectra",in.rows);
+  fprintf(stderr,"%-31s: %d\n","Spectra per search",nrows);
+  fprintf(stderr,"%-31s: %d channels, %e Hz/s\n","Largest drift",maxd,maxd * fabs(drift1));
+  fprintf(stderr,"%-31s: %d\n","Channels per block",blockw);
+  fprintf(stderr,"%-31s: %d\n","Channels per stripe",stripew);
+  fprintf(stderr,"%-31s: %d\n","Threads",nthreads);
+  fprintf(stderr,"%-31s: %.1f\n\n","SNR threshold",snrmin);
+
+  /* search groups of nrows spectra as they are read */
+  for (t0 = 0; ; t0 += nrows)
+    {
+      for (s0 = 0; s0 < in.nchans; s0 += stripew)
+	{
+	  sw = in.nchans - s0 < stripew ? in.nchans - s0 : stripew;
+	  lo = s0 - (nrows - 1) < 0 ? 0 : s0 - (nrows - 1);
+	  hi = s0 + sw + nrows - 1 > in.nchans ? in.nchans : s0 + sw + nrows - 1;
+
+	  /* channels beyond the band read as zero, the lines through them are not searched */
+	  memset(data, 0, (size_t) nrows * dataw * sizeof(float));
+	  if (read_stripe(&in, t0, lo, hi - lo, &data[lo - (s0 - (nrows - 1))], dataw) < 0)
+	    goto done;
+
+	  for (t = 0; t < sw; t++)
+	    {
+	      best[t] = -HUGE_VAL;
+	      bestd[t] = 0;
+	    }
+	  for (t = 0; t < nthreads; t++)
+	    if (pthread_create(&proc[t], NULL, search, (void *) (long) t))
+	      {
+		perror("pthread_create");
+		exit(1);
+	      }
+	  for (t = 0; t < nthreads; t++)
+	    pthread_join(proc[t], NULL);
+
+	  nhits += report(t0);
+	}
+      fflush(fpoutput);
+      ngroups++;
+    }
+
+ done:
+  fprintf(stderr,"Read error or EOF.\n");
+  fprintf(stderr,"Searched %lld groups of %d spectra, %lld hits\n",ngroups,nrows,nhits);
+  fclose(fpoutput);
+  return 0;
+}
+
+/******************************************************************************/
+/*	taylor								      */
+/******************************************************************************/
+float *taylor(float *a, float *b, int n, int w)
+{
+  /* the tree sum of the n (a power of 2) rows of w channels in a.  After
+     the pass that joins groups of 2h rows, row d of each group holds the
+     sums along the lines that start at each channel of its first row
+     and drift d channels by its last, as the lines of drift d/2 through
+     its first h rows and, from channel (d+1)/2 on, through its last h.
+     The last n-1 channels see zeros past w and are not valid; b is
+     scratch the size of a, and the result is in whichever of the two is
+     returned */
+  float *in = a, *out = b, *tmp, *p, *q, *r;
+  int h, g, d, s, f;
+
+  for (h = 1; h < n; h *= 2)
+    {
+      for (g = 0; g < n; g += 2 * h)
+	for (d = 0; d < 2 * h; d++)
+	  {
+	    p = &in[(size_t) (g + d / 2) * w];
+	    q = &in[(size_t) (g + h + d / 2) * w];
+	    r = &out[(size_t) (g + d) * w];
+	    s = (d + 1) / 2;
+	    for (f = 0; f < w - s; f++)
+	      r[f] = p[f] + q[f + s];
+	    for (; f < w; f++)
+	      r[f] = 0;
+	  }
+      tmp = in;
+      in = out;
+      out = tmp;
+    }
+  return in;
+}
+
+/******************************************************************************/
+/*	search								      */
+/******************************************************************************/
+void *search(arg)
+void *arg;
+{
+  /* searches the blocks (t, t+nthreads, ...) of the stripe for both signs
+     of drift, keeping the best SNR of the lines from each channel */
+  int t = (int) (long) arg;
+  float *a, *b, *r, *row;
+  double sum, sum2, mean, rms, lim, snr;
+  int c0, nb, w, sign, d, f, c, e, j, k, n;
+
+  w = blockw + nrows - 1;
+  a = (float *) malloc((size_t) nrows * w * sizeof(float));
+  b = (float *) malloc((size_t) nrows * w * sizeof(float));
+  if (!a || !b)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+
+  for (c0 = t * blockw; c0 < sw; c0 += nthreads * blockw)
+    {
+      nb = sw - c0 < blockw ? sw - c0 : blockw;
+      w = nb + nrows - 1;
+      for (sign = 1; sign >= -1; sign -= 2)
+	{
+	  /* the block, mirrored for negative drifts; data column j is
+	     channel s0 - (nrows-1) + j */
+	  for (k = 0; k < nrows; k++)
+	    {
+	      row = &data[(size_t) k * dataw + nrows - 1 + c0];
+	      if (sign > 0)
+		memcpy(&a[(size_t) k * w], row, w * sizeof(float));
+	      else
+		for (f = 0; f < w; f++)
+		  a[(size_t) k * w + f] = row[nb - 1 - f];
+	    }
+	  r = taylor(a, b, nrows, w);
+
+	  for (d = sign > 0 ? 0 : 1; d <= maxd; d++)
+	    {
+	      row = &r[(size_t) d * w];
+
+	      /* noise of the lines in the band, twice to clip outliers */
+	      mean = 0;
+	      rms = 0;
+	      lim = HUGE_VAL;
+	      for (j = 0; j < 2; j++)
+		{
+		  sum = sum2 = 0;
+		  n = 0;
+		  for (f = 0; f < nb; f++)
+		    {
+		      c = s0 + (sign > 0 ? c0 + f : c0 + nb - 1 - f);
+		      e = c + sign * d;
+		      if (e < 0 || e >= in.nchans || fabs(row[f] - mean) > lim)
+			continue;
+		      sum += row[f];
+		      sum2 += row[f] * row[f];
+		      n++;
+		    }
+		  if (n < DDMINSTAT)
+		    break;
+		  mean = sum / n;
+		  rms = sqrt(sum2 / n - mean * mean);
+		  lim = DDCLIP * rms;
+		}
+	      if (n < DDMINSTAT || rms <= 0)
+		continue;
+
+	      for (f = 0; f < nb; f++)
+		{
+		  c = sign > 0 ? c0 + f : c0 + nb - 1 - f;
+		  e = s0 + c + sign * d;
+		  if (e < 0 || e >= in.nchans)
+		    continue;
+		  snr = (row[f] - mean) / rms;
+		  if (snr > best[c])
+		    {
+		      best[c] = snr;
+		      bestd[c] = sign * d;
+		    }
+		}
+	    }
+	}
+    }
+
+  free(a);
+  free(b);
+  return NULL;
+}
+
+/******************************************************************************/
+/*	report								      */
+/******************************************************************************/
+int report(long long t0)
+{
+  /* writes the lines of the stripe above threshold that have the best
+     SNR of those starting within maxd channels; returns their number */
+  int win = maxd > 1 ? maxd : 1;
+  int c, k, lo, hi, nhits = 0;
+
+  for (c = 0; c < sw; c++)
+    {
+      if (best[c] < snrmin)
+	continue;
+      lo = c - win < 0 ? 0 : c - win;
+      hi = c + win >= sw ? sw - 1 : c + win;
+      for (k = lo; k <= hi; k++)
+	if (best[k] > best[c] || (best[k] == best[c] && k < c))
+	  break;
+      if (k <= hi)
+	continue;
+      fprintf(fpoutput,"%lld %.6f %d %.3f % .6e %d %.2f\n",
+	      t0, t0 * in.tsamp, s0 + c, in.f0 + (s0 + c) * in.foff,
+	      bestd[c] ? bestd[c] * in.foff / ((nrows - 1) * in.tsamp) : 0.0, bestd[c], best[c]);
+      nhits++;
+    }
+  return nhits;
+}
+
+/******************************************************************************/
+/*	open_input							      */
+/******************************************************************************/
+void open_input(struct DDIN *in)
+{
+  /* opens an HDF5 dynamic spectrum, reading its shape and attributes, or
+     a stream of binary records described on the command line */
+  hid_t space, attr;
+  hsize_t dims[3];
+  double fch1, foff, tsamp;
+
+  in->held = -1;
+  if (strcmp(in->name, "-") != 0 && H5Fis_hdf5(in->name) > 0)
+    {
+      in->hdf5 = 1;
+      if ((in->file = H5Fopen(in->name, H5F_ACC_RDONLY, H5P_DEFAULT)) < 0
+	  || (in->dset = H5Dopen2(in->file, "/data", H5P_DEFAULT)) < 0)
+	{
+	  fprintf(stderr,"Cannot open /data in HDF5 file %s\n",in->name);
+	  exit(1);
+	}
+      space = H5Dget_space(in->dset);
+      if (H5Sget_simple_extent_ndims(space) != 3)
+	{
+	  fprintf(stderr,"/data in %s is not time by feed by channel\n",in->name);
+	  exit(1);
+	}
+      H5Sget_simple_extent_dims(space, dims, NULL);
+      H5Sclose(space);
+      in->rows = dims[0];
+      in->nifs = dims[1];
+      in->nchans = dims[2];
+
+      /* as written by pfs_fft_2, MHz and s */
+      if ((attr = H5Aopen(in->dset, "fch1", H5P_DEFAULT)) < 0
+	  || H5Aread(attr, H5T_NATIVE_DOUBLE, &fch1) < 0 || H5Aclose(attr) < 0
+	  || (attr = H5Aopen(in->dset, "foff", H5P_DEFAULT)) < 0
+	  || H5Aread(attr, H5T_NATIVE_DOUBLE, &foff) < 0 || H5Aclose(attr) < 0
+	  || (attr = H5Aopen(in->dset, "tsamp", H5P_DEFAULT)) < 0
+	  || H5Aread(attr, H5T_NATIVE_DOUBLE, &tsamp) < 0 || H5Aclose(attr) < 0)
+	{
+	  fprintf(stderr,"Cannot read fch1, foff and tsamp of %s\n",in->name);
+	  exit(1);
+	}
+      in->f0 = fch1 * 1e6;
+      in->foff = foff * 1e6;
+      in->tsamp = tsamp;
+    }
+  else
+    {
+      if (in->nchans <= 0 || in->foff <= 0 || in->tsamp <= 0)
+	{
+	  fprintf(stderr,"Binary input needs -c, -r and -T\n");
+	  exit(1);
+	}
+      if (strcmp(in->name, "-") == 0)
+	in->fd = 0;
+      else if ((in->fd = open(in->name, O_RDONLY)) < 0)
+	{
+	  perror("open input file");
+	  exit(1);
+	}
+      in->rows = -1;
+      in->f0 -= in->nchans / 2 * in->foff;
+      in->rec = (float *) malloc((size_t) nrows * in->nifs * in->nchans * sizeof(float));
+      if (!in->rec)
+	{
+	  fprintf(stderr,"Malloc error\n");
+	  exit(1);
+	}
+    }
+
+  if (in->feed < 0 || in->feed >= in->nifs)
+    {
+      fprintf(stderr,"Feed %d not in input, which has %d\n",in->feed,in->nifs);
+      exit(1);
+    }
+  if (in->nchans < nrows)
+    {
+      fprintf(stderr,"Fewer channels than spectra per search\n");
+      exit(1);
+    }
+}
+
+/******************************************************************************/
+/*	read_stripe							      */
+/******************************************************************************/
+int read_stripe(struct DDIN *in, long long t0, int c0, int nc, float *buf, int stride)
+{
+  /* reads channels c0 to c0+nc-1 of the searched feed in spectra t0 to
+     t0+nrows-1 into nrows rows stride floats apart; binary records are
+     read whole, once per group.  Returns -1 at EOF */
+  hid_t space, mem;
+  hsize_t off[3], cnt[3], moff[2], mcnt[2], mdim[2];
+  size_t len;
+  ssize_t got;
+  char *p;
+  int k;
+
+  if (in->hdf5)
+    {
+      if (t0 + nrows > in->rows)
+	return -1;
+      space = H5Dget_space(in->dset);
+      off[0] = t0;    off[1] = in->feed; off[2] = c0;
+      cnt[0] = nrows; cnt[1] = 1;        cnt[2] = nc;
+      H5Sselect_hyperslab(space, H5S_SELECT_SET, off, NULL, cnt, NULL);
+      mdim[0] = nrows; mdim[1] = stride;
+      moff[0] = 0;     moff[1] = 0;
+      mcnt[0] = nrows; mcnt[1] = nc;
+      mem = H5Screate_simple(2, mdim, NULL);
+      H5Sselect_hyperslab(mem, H5S_SELECT_SET, moff, NULL, mcnt, NULL);
+      if (H5Dread(in->dset, H5T_NATIVE_FLOAT, mem, space, H5P_DEFAULT, buf) < 0)
+	{
+	  fprintf(stderr,"HDF5 read failed at spectrum %lld\n",t0);
+	  exit(1);
+	}
+      H5Sclose(mem);
+      H5Sclose(space);
+      return 0;
+    }
+
+  if (in->held != t0)
+    {
+      len = (size_t) nrows * in->nifs * in->nchans * sizeof(float);
+      for (p = (char *) in->rec; len > 0; p += got, len -= got)
+	if ((got = read(in->fd, p, len)) <= 0)
+	  return -1;
+      in->held = t0;
+    }
+  for (k = 0; k < nrows; k++)
+    memcpy(&buf[(size_t) k * stride],
+	   &in->rec[((size_t) k * in->nifs + in->feed) * in->nchans + c0],
+	   nc * sizeof(float));
+  return 0;
+}
+
+/******************************************************************************/
+/*	processargs							      */
+/******************************************************************************/
+void	processargs(argc,argv,infile,outfile,nrows,snrmin,maxrate,feed,nchans,nifs,freqres,tsamp,fcenter,nthreads)
+int	argc;
+char	**argv;			 /* command line arguements */
+char	**infile;		 /* input file name */
+char	**outfile;		 /* output file name */
+int     *nrows;
+float   *snrmin;
+double  *maxrate;
+int     *feed;
+int     *nchans;
+int     *nifs;
+double  *freqres;
+double  *tsamp;
+double  *fcenter;
+int     *nthreads;
+{
+  /* function to process a programs input command line.
+     This is a template which has been customised for the pfs_dedoppler program:
+	- the outfile name is set from the -o option
+	- the infile name is set from the 1st unoptioned argument
+  */
+
+  int getopt();		/* c lib function returns next opt*/
+  extern char *optarg; 	/* if arg with option, this pts to it*/
+  extern int optind;	/* after call, ind into argv for next*/
+  extern int opterr;    /* if 0, getopt won't output err mesg*/
+
+  char *myoptions = "n:s:D:i:c:r:T:F:j:o:"; 	 /* options to search for :=> argument*/
+  char *USAGE="pfs_dedoppler [-n spectra per search] [-s SNR threshold] [-D maximum drift rate (Hz/s)] [-i feed] [-c channels[,feeds] -r frequency resolution (Hz) -T time between spectra (s) [-F center frequency (Hz)]] [-j threads] [-o outfile] infile";
+
+  int  c;			 /* option letter returned by getopt  */
+
+  /* default parameters */
+  opterr = 0;			 /* turn off there message */
+  *infile  = "-";		 /* initialise to stdin, stdout */
+  *outfile = "-";
+  *nrows = 16;
+  *snrmin = 10;
+  *maxrate = 0;
+  *feed = 0;
+  *nchans = 0;
+  *nifs = 1;
+  *freqres = 0;
+  *tsamp = 0;
+  *fcenter = 0;
+  *nthreads = 4;
+
+  /* loop over all the options in list */
+  while ((c = getopt(argc,argv,myoptions)) != -1)
+  {
+    switch (c)
+    {
+      case 'o':
+ 	       *outfile = optarg;	/* output file name */
+	       break;
+
+      case 'n':
+ 	       sscanf(optarg,"%d",nrows);
+	       break;
+
+      case 's':
+ 	       sscanf(optarg,"%f",snrmin);
+	       break;
+
+      case 'D':
+ 	       sscanf(optarg,"%lf",maxrate);
+	       break;
+
+      case 'i':
+ 	       sscanf(optarg,"%d",feed);
+	       break;
+
+      case 'c':
+	       if (sscanf(optarg,"%d,%d",nchans,nifs) < 1)
+		 goto errout;
+	       break;
+
+      case 'r':
+ 	       sscanf(optarg,"%lf",freqres);
+	       break;
+
+      case 'T':
+ 	       sscanf(optarg,"%lf",tsamp);
+	       break;
+
+      case 'F':
+ 	       sscanf(optarg,"%lf",fcenter);
+	       break;
+
+      case 'j':
+ 	       sscanf(optarg,"%d",nthreads);
+	       break;
+
+      case '?':			 /*if not in myoptions, getopt rets ? */
+               goto errout;
+               break;
+    }
+  }
+
+  if (*nrows < 2 || (*nrows & (*nrows - 1)))
+    {
+      fprintf(stderr,"Spectra per search (-n) must be a power of 2\n");
+      goto errout;
+    }
+  if (*nthreads < 1 || *nifs < 1)
+    goto errout;
+
+  if (optind < argc)		 /* 1st non-optioned param is infile */
+    *infile = argv[optind];
+
+  return;
+
+  /* here if illegal option or argument */
+  errout: fprintf(stderr,"%s\n",rcsid);
+          fprintf(stderr,"Usage: %s\n",USAGE);
+	  exit(1);
+}
+
+/******************************************************************************/
+/*	open file    							      */
+/******************************************************************************/
+void	open_file(outfile,fpoutput)
+char	*outfile;		/* output file name */
+FILE    **fpoutput;		/* pointer to output file */
+{
+  /* opens the output file, stdout is default */
+  if (outfile[0] == '-')
+    *fpoutput=stdout;
+  else
+    {
+      *fpoutput=fopen(outfile,"w");
+      if (*fpoutput == NULL)
+	{
+	  perror("open_files: output file open error");
+	  exit(1);
+	}
+    }
+  return;
+}
+
+/******************************************************************************/
+/*	copy_cmd_line    						      */
+/******************************************************************************/
+void	copy_cmd_line(argc,argv,command_line)
+int	argc;
+char	**argv;			/* command line arguements */
+char	command_line[];		/* command line parameters in single string */
+{
+  /* copys the command line parameters in argv to the single string
+     command line
+  */
+  int	i;
+
+  strcpy(command_line,argv[0]);
+  strcat(command_line," ");
+
+  for (i=1; i<argc; i++)
+  {
+    strcat(command_line,argv[i]);
+    strcat(command_line," ");
+  }
+
+  return;
+}
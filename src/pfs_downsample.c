@@ -20,6 +20,9 @@
 *	the -m option specifies the data acquisition mode
 *	the -d argument specifies the downsampling factor
 *       the -c argument specifies which channel (1 or 2) to process
+*	the -a option continues with the files that follow infile.NNN
+*	infile may also be the prefix of a recording set (data*.NNN)
+*			whose files are then read as one stream
 *
 *  output:
 *	the -o option identifies the output file, stdout is default
@@ -136,20 +139,18 @@
 #include <pthread.h>
 
 #include "unpack.h"
+#include "multifile.h"
 
 /* revision control variable */
 static char const rcsid[] = 
 "$Id: pfs_downsample.c,v 3.16 2014/01/07 02:27:21 jlm Exp $";
 
-int	fdinput;		/* file descriptor for input file */ 
+struct MULTIREAD *mfinput;	/* input file or recording set */
 int	fdoutput;		/* file descriptor to output file */
 
 char	command_line[200];	/* command line assembled by processargs */
-char	header[40];		/* data file name header */
-int	ext;			/* data file extension */
-int	open_rflags;	/* flags required for open() call for reading */
 int	open_wflags;	/* flags required for open() call for writing */
-struct  stat filestat;	/* input file status structure */
+long long filesize;	/* size of input file(s) */
 int	verbose = 1;    /* verbosity level */
 int     clipping = 0;	/* flag for detection and reporting of clipping */
 int	floats  = 1;    /* default output format is floating point */
@@ -224,28 +225,27 @@ int main(int argc, char *argv[])
     default: fprintf(stderr,"Invalid mode\n"); exit(1);
     }
 
-  /* open input file */
-  open_rflags = O_RDONLY;
-  if((fdinput = open(infile, open_rflags)) < 0 )
+  /* open input file, with -a the rest of the recording set as well */
+  if((mfinput = multi_ropen(infile, allfiles)) == NULL)
     {
       perror("open input file");
       exit(1);
     }
 
-  /* get file status */
-  if (fstat (fdinput, &filestat) < 0)
+  /* get file size */
+  if ((filesize = multi_size(mfinput)) < 0)
     {
-      perror("input file status");
+      fprintf(stderr,"Cannot determine size of input file\n");
       exit(1);
-      } 
+    } 
   
   /* test size compatibility */
-  if (filestat.st_size % 4 != 0)
+  if (filesize % 4 != 0)
     if (verbose) fprintf(stderr,"Warning: file size %lld is not a multiple of 4\n", 
-			 (long long int) filestat.st_size);
-  if (filestat.st_size % downsample != 0)
+			 (long long int) filesize);
+  if (filesize % downsample != 0)
     if (verbose) fprintf(stderr,"Warning: file size %lld not a multiple of dwnsmplng factor\n",
-			 (long long int) filestat.st_size);
+			 (long long int) filesize);
 
   /* skip samples if needed */
   /* but skip along 4-byte boundaries only */
@@ -258,7 +258,7 @@ int main(int argc, char *argv[])
 			 samplestoskip, wordstoskip, bytestoskip);
     
     /* skip desired amount of bytes */
-    if ((long) bytestoskip != lseek(fdinput, (long) bytestoskip, SEEK_SET))
+    if ((long) bytestoskip != multi_lseek(mfinput, (long) bytestoskip, SEEK_SET))
       {
         perror("lseek");
         fprintf(stderr, "Unable to skip %ld bytes\n", (long) bytestoskip);
@@ -270,12 +270,12 @@ int main(int argc, char *argv[])
     remainingbytestoskip = (int) ((wordstoskip - (int) wordstoskip) * 4);
 
     /* test new size compatibility */
-    if ((filestat.st_size - (int) bytestoskip) % 4 != 0)
+    if ((filesize - (int) bytestoskip) % 4 != 0)
       if (verbose) fprintf(stderr,"Warning: file size %lld with %.1f byte skip not a multiple of 4\n",
-			   (long long int) filestat.st_size, bytestoskip);
-    if ((filestat.st_size - (int) bytestoskip) % downsample != 0)
+			   (long long int) filesize, bytestoskip);
+    if ((filesize - (int) bytestoskip) % downsample != 0)
       if (verbose) fprintf(stderr,"Warning: file size %lld with %.1f byte skip not a multiple of dwnsmplng factor\n", 
-			   (long long int) filestat.st_size, bytestoskip);
+			   (long long int) filesize, bytestoskip);
   }
 
   /* open output file, stdout is default */
@@ -290,7 +290,7 @@ int main(int argc, char *argv[])
 
   /* compute dynamic range parameters */
   if (verbose) fprintf(stderr,"Downsampling file of size %d kB by %d\n", 
-		       (int) (filestat.st_size / 1000), downsample);
+		       (int) (filesize / 1000), downsample);
   maxvalue = maxunpack * sqrt(downsample);
   scale = fudge * 0.25 * 128 / maxvalue;
 
@@ -306,15 +306,15 @@ int main(int argc, char *argv[])
   /* make it 4 MB as we were getting warnings when downsampling by 16 */
   bufsize = (int) rint(1000000.0/downsample) * downsample * 4;
   /* but the buffer size must be smaller than the file size */
-  if (bufsize > (filestat.st_size - (int) bytestoskip)) 
+  if (bufsize > (filesize - (int) bytestoskip)) 
     {
-      bufsize = filestat.st_size - (int) bytestoskip;
+      bufsize = filesize - (int) bytestoskip;
       if (verbose) fprintf(stderr,"Reducing buffer size to file size minus bytes to skip: %d\n",
 			   bufsize);
     }
 
   if (verbose) fprintf(stderr,"Using %d buffers of size %d\n", 
-		       (int) floor((filestat.st_size - bytestoskip) / bufsize), bufsize);
+		       (int) floor((filesize - bytestoskip) / bufsize), bufsize);
   
   /* allocate storage */
   nsamples = bufsize * smpwd / 4;
@@ -433,7 +433,7 @@ int main(int argc, char *argv[])
     free (channel1);
     free (channel2);
 
-    close (fdinput);
+    multi_rclose (mfinput);
     close (fdoutput);
 
   return 0;
@@ -442,38 +442,13 @@ int main(int argc, char *argv[])
 
 void *read_buf (void *rdata) {
     struct jdata *rbuf = (struct jdata *)rdata;
-    int datasz;
-    char infile[80];
 
-    /* read one buffer */
-    if        ((rbuf->bytesread = read (fdinput, rbuf->bfrthr1, bufsize)) == -1) {
+    /* read one buffer, across file boundaries with -a */
+    if ((rbuf->bytesread = multi_read (mfinput, rbuf->bfrthr1, bufsize)) == -1) {
 	perror("read");
-	return NULL;
-    /* 03/05/04 SWJ - need more data from next data file? */
-    } else if (rbuf->bytesread != bufsize && allfiles == 1) {
-	close (fdinput);
-
-	sprintf (infile, "%s.%3.3d", &header[0], ++ext);
-	if (verbose) fprintf(stderr, "downsampling next file in sequence: \"%s\"\n", infile);
-
-	/* the program must stop after reading the file with the highest extension */
-	/* we assume that if the file with the next extension does not exist, 
-	   we have reached the end */
-	if ((fdinput = open(infile, open_rflags)) < 0) {
-	    return NULL;
-	} else if (fstat (fdinput, &filestat) < 0) {
-	    perror("fstat");
-	    return NULL;
-	}
-
-	/* make up the data buffer */
-    	if ((datasz = read (fdinput, rbuf->bfrthr1 + rbuf->bytesread, bufsize - rbuf->bytesread )) == -1) {
-	    perror ("read");
-	    return NULL;
-	} else {
-	    rbuf->bytesread = datasz + rbuf->bytesread;
-	} 
+	rbuf->bytesread = 0;
     }
+    return NULL;
 }
 
 
@@ -682,7 +657,7 @@ long 	*samplestoskip;
   extern int opterr;    /* if 0, getopt won't output err mesg*/
 
   char *myoptions = "m:o:d:c:s:I:Q:b:f:axqi"; 	 /* options to search for :=> argument*/
-  char *USAGE1="pfs_downsample -m mode -d downsampling factor [-s number of complex samples to skip] [-f scale fudge factor] [-b output byte quantities (default floats)] [-a downsample all data files] [-I dcoffi] [-Q dcoffq] [-c channel (1 or 2)] [-x (swap I/Q)] [-q (quiet mode)] [-o outfile] [infile] ";
+  char *USAGE1="pfs_downsample -m mode -d downsampling factor [-s number of complex samples to skip] [-f scale fudge factor] [-b output byte quantities (default floats)] [-a downsample infile.NNN and the numbered files after it] [-I dcoffi] [-Q dcoffq] [-c channel (1 or 2)] [-x (swap I/Q)] [-q (quiet mode)] [-o outfile] [infile (or data*.NNN set prefix)] ";
   char *USAGE2="Valid modes are\n\t 0: 2c1b (N/A)\n\t 1: 2c2b\n\t 2: 2c4b\n\t 3: 2c8b\n\t 4: 4c1b (N/A)\n\t 5: 4c2b\n\t 6: 4c4b\n\t 7: 4c8b (N/A)\n\t 8: signed bytes\n\t32: 32bit floats\n";
   int  c;			 /* option letter returned by getopt  */
   int  arg_count = 1;		 /* optioned argument count */
@@ -777,17 +752,7 @@ long 	*samplestoskip;
       
   if (arg_count < argc)          /* 1st non-optioned param is infile */
     *infile = argv[arg_count];
-    
-  /* SWJ 03/05/04 */
-  if (allfiles == 1) {          
-        /* get data file information */
-        /* get extension part of 'filename.ext' */
-        strcpy (header, strrchr (*infile, '.'));
-        ext = atoi (&header[1]);
-      
-        /* get 'name' part */
-        strncpy (header, *infile, strlen(*infile) - strlen(header));
-  } 
+
 
   /* must specify a valid mode and downsampling factor */
   if (*mode == 0 || *downsample < 1) goto errout;
@@ -21,7 +21,20 @@
 *              [-C file of Chebyshev polynomial coefficients defining window to apply after transform] 
 *              [-S number of seconds to skip before applying first FFT]
 *              [-I dcoffi] [-Q dcoffq] 
-*              [-o outfile] [infile]
+*              [-j threads]
+*              [-P estimate|measure|patient|exhaustive]
+*              [-R real input] [-F frequency offset (Hz)]
+*              [-z zoom to the -x band]
+*              [-B taps[,window] polyphase filterbank]
+*              [-L res|pad fast FFT length]
+*              [-k sum|separate|cross|stokes combine inputs]
+*              [-K sigmas[,zero] spectral kurtosis flagging]
+*              [-M megabytes[,scratch dir] memory budget]
+*              [-w nbits[,bins] SIGPROC filterbank output]
+*              [-Y pyramid cache file]
+*              [-T seconds of data]
+*              [-N no result cache]
+*              [-o outfile] [infile[:mode[:chan[:skip]]] ...]
 *
 *  input:
 *       the input parameters are typed in as command line arguments
@@ -33,12 +46,80 @@
 *			(incoherent sum after fft)
 *       the -l argument specifies logarithmic (dB) output
 *	the -t option indicates that (sums of) transforms ought to be written
-*			one after the other until EOF
+*			one after the other until EOF, as binary rows of
+*			the -x band (all bins if none), in dB with -l
 *       the -x option specifies an optional range of output frequencies
 *       the -c argument specifies which channel (1 or 2) to process
+*	the -j argument specifies the number of worker threads (default 1);
+*			the sum does not depend on the number of threads
+*	the -P argument specifies the FFTW planner effort (default estimate);
+*			plans are remembered in ~/.pfs_wisdom or $PFS_WISDOM
+*	the -R option treats modes 16 and 32 as real samples at -f MHz and
+*			uses a real-to-complex transform, replacing pfs_r2c;
+*			the output covers -f/2 to +f/2 as it did after pfs_r2c
+*	the -F argument moves a real input spectrum up by that many Hz, as
+*			the pfs_r2c -x offset did, rounded to a whole bin
+*	the -z option computes only the -x band: the data are mixed to the
+*			band center, low-pass filtered and decimated, and a
+*			much shorter transform gives the same bins
+*	the -B option replaces the single block FFT by a polyphase
+*			filterbank of taps blocks (default 4) with a prototype
+*			filter windowed by hamming (default), hann, blackman,
+*			nuttall or rect
+*	the -L option moves a transform length with prime factors above 7
+*			to a fast length: res changes the resolution to the
+*			nearest one, pad zero pads each block up to the next
+*			one (finer bin spacing, same resolution)
+*	the -k option says what to do with several inputs, transformed in
+*			step: sum adds their power spectra (as pfs_fft_2),
+*			separate writes one per input, cross adds the real
+*			and imaginary parts of the cross spectrum of each
+*			pair after those; the output has one column (or
+*			one spectrum in a -t record) per spectrum.  stokes
+*			reads one mode 5, 6 or 7 input once, transforms
+*			both channels and writes Stokes I, Q, U and V from
+*			|R|^2, |L|^2 and R L*, with R the rcp channel
+*	the -K option flags interference by the spectral kurtosis of the
+*			-n transforms in each bin (-n 2 or more): bins
+*			further than sigmas from Gaussian noise are
+*			flagged, and zeroed in the output with ,zero; all
+*			bins are flagged if more than half are
+*	the -M option sets the memory budget for one transform, default
+*			half the physical memory; longer transforms (sub-Hz
+*			resolution at MHz rates) are done by a four-step
+*			FFT in place, on scratch files in the given
+*			directory ($TMPDIR or /tmp) if they would take more
+*			than half the budget; -k sum or separate only
+*	the -w option writes a SIGPROC filterbank file: a header (fch1 and
+*			foff of the baseband bins in MHz, tsamp, nchans,
+*			nbits, nifs one per spectrum) and fixed size rows,
+*			so any time or channel range is at a known offset;
+*			the channels are the -x band summed bins at a time
+*			(default 1), as 32 bit floats or 16 or 8 bit
+*			counts scaled by the mean and rms of the first row
+*	the -Y option names an integration pyramid cache.  A -t run that
+*			finds no cache for these inputs and transform
+*			settings writes one: its records, and their sums
+*			over 2, 4, 8, ... records.  Later runs whose -n is a
+*			multiple of that run's and whose -S falls on one of
+*			its records are then answered from the cache
+*			without reading the inputs; -K and -s are not
+*			allowed, as their output is not a sum of records
+*	the -T argument stops a -t run after that many seconds of data
+*	the -N option computes the spectra even if a run with the same
+*			settings on the same, unchanged inputs has been kept
+*			in the result cache ($PFS_CACHE or ~/.pfs_cache, at
+*			most $PFS_CACHE_MB megabytes); runs with -K or -Y,
+*			or reading stdin, are never cached, and only output
+*			to a regular file is kept
+*	infile may also be the prefix of a recording set (data*.NNN)
+*			whose files are then read as one stream; a suffix
+*			:mode:chan:skip overrides -m, -c and -S for that input
 *
 *  output:
 *	the -o option identifies the output file, stdout is default
+*	with -K, outfile.flags holds one bit per bin (bin i in bit i%8 of
+*			byte i/8) for each output spectrum or -t record
 *
 *  Jean-Luc Margot, Aug 2000
 *******************************************************************************/
@@ -140,87 +221,65 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include "unpack.h"
+#include "fftutil.h"
+#include "pfb.h"
+#include "spectral.h"
+#include "filterbank.h"
+#include "pyramid.h"
+#include "rcache.h"
 #include <fftw3.h>
 
 /* revision control variable */
-static char const rcsid[] = 
+static char const rcsid[] =
 "$Id: pfs_fft.c,v 4.2 2020/05/21 17:44:12 jlm Exp $";
 
 FILE   *fpoutput;		/* pointer to output file */
-int	fdinput;		/* file descriptor for input file */
+FILE   *fpflags;		/* pointer to -K flag file */
 
 char   *outfile;		/* output file name */
-char   *infile;		        /* input file name */
-char   *chebfile;	        /* file of Chebyshev coefficients */
+char  **infiles;	        /* input file names */
 
 char	command_line[512];	/* command line assembled by processargs */
 
 void processargs();
 void open_file();
 void copy_cmd_line();
-void vector_power(float *data, int len);
-void vector_window(float *data, int len);
-void chebyshev_window(float *data, int len, double *chebcoeff, int degree);
-void swap_freq(float *data, int len);
-void swap_iandq(float *data, int len);
-void zerofill(float *data, int len);
-int  no_comma_in_string();	
-double chebeval(double x, double c[], int degree);
-int  read_cheb_coeffs(char *chebfile, double *chebcoeff);
-void average(float *inbuf, int nsamples, double *i, double *q);
+int  no_comma_in_string();
 
 int main(int argc, char *argv[])
 {
-  int mode;
-  long bufsize;		/* size of read buffer */
-  char *buffer;		/* buffer for packed data */
-  char *rcp;		/* buffer for unpacked data */
-  float smpwd;		/* # of single pol complex samples in a 4 byte word */
-  int nsamples;		/* # of complex samples in each buffer */
-  int levels;		/* # of levels for given quantization mode */
-  int degree=0;         /* degree of Chebyshev polynomial, default none */
-
-  float *fftinbuf, *fftoutbuf;
+  struct SPEC sp;	/* transform parameters, see spectral.h */
+  struct FBANK fb;	/* -t and -w output, see filterbank.h */
+  struct PYR pyr;	/* -Y cache, see pyramid.h */
+  struct RCACHE rc;	/* result cache, see rcache.c */
+  int nocache;		/* -N: always compute */
+  char key[PYRKEY];	/* what the cache must have been made from */
+  char *pyrfile;	/* -Y cache file, NULL for none */
+  int frompyr=0;	/* outputs are sums of cached records */
+  int building=0;	/* records go into a new cache */
+  long long first=0;	/* cached record of the first output */
+  long long mult=1;	/* cached records per output */
+  float *pyrbuf=NULL;	/* an output added up from the cache */
+  float duration;	/* -T seconds of data, 0 for all */
+  long long maxrec=-1;	/* -t records in that */
   float *total;
-
-  double *chebcoeff;    /* array for polynomial coefficients */
-
+  int ninfiles;		/* number of input streams */
+  int mode;		/* sampling mode of the inputs */
+  int chan;		/* channel to process (1 or 2) for dual pol data */
+  float nskipseconds;   /* optional number of seconds to skip at beginning of file */
   float freq;		/* frequency */
-  float freqmin;	/* min frequency to output */
-  float freqmax;	/* max frequency to output */
   float value;		/* value to output */
-  float rmsmin;		/* min frequency for rms calculation */
-  float rmsmax;		/* max frequency for rms calculation */
-  double fsamp;		/* sampling frequency, MHz */
-  double freqres;	/* frequency resolution, Hz */
-  double mean,mean1;	/* needed for rms computation */
-  double var,var1;	/* needed for rms computation */
-  double sigma,sigma1;	/* needed for rms computation */
-  int downsample;	/* downsampling factor, dimensionless */
-  long long sum;	/* number of transforms to add, dimensionless */
-  int timeseries;	/* process as time series, boolean */
   int dB;		/* write out results in dB */
-  int fftlen;		/* transform length, complex samples */
-  int chan;		/* channel to process (1 or 2) for dual pol data */
-  int counter=0;	/* keeps track of number of transforms written */
-  int open_flags;	/* flags required for open() call */
-  int invert;		/* swap i and q before fft routine */
-  int hanning;		/* apply Hanning window before fft routine */
-  int swap = 1;		/* swap frequencies at output of fft routine */
   int binary;		/* write output as binary floating point quantities */
-  float nskipseconds;   /* optional number of seconds to skip at beginning of file */
-  long nskipbytes;	/* number of bytes to skip at beginning of file */
-  int imin,imax;	/* indices for rms calculation */
-  double dcoffi,dcoffq;	/* user-provided dc offsets */
-  int dcoffset=0;	/* compute and remove DC offset prior to FFT */
-  
-  fftwf_plan p;
-  int i,j,k,l,n,n1;
-  short x;
+  int filterbank;	/* write a SIGPROC filterbank file */
+  int counter=0;	/* keeps track of number of transforms written */
+  long long nflagged=0;	/* bins flagged over a time series */
+  int i,k;
 
   /* get the command line arguments */
-  processargs(argc,argv,&infile,&outfile,&mode,&fsamp,&freqres,&downsample,&sum,&binary,&timeseries,&chan,&freqmin,&freqmax,&rmsmin,&rmsmax,&dB,&invert,&hanning,&chebfile,&nskipseconds,&dcoffi,&dcoffq,&dcoffset);
+  memset(&sp, 0, sizeof(sp));
+  memset(&fb, 0, sizeof(fb));
+  processargs(argc,argv,&ninfiles,&infiles,&outfile,&mode,&sp.fsamp,&sp.freqres,&sp.downsample,&sp.sum,&binary,&sp.timeseries,&chan,&sp.freqmin,&sp.freqmax,&sp.rmsmin,&sp.rmsmax,&dB,&sp.invert,&sp.hanning,&sp.chebfile,&nskipseconds,&sp.dcoffi,&sp.dcoffq,&sp.dcoffset,&sp.nthreads,&sp.effort,&sp.real,&sp.foff,&sp.zoom,&sp.pfbtaps,sp.pfbwindow,&sp.fastlen,&sp.combine,&sp.skthresh,&sp.skzero,&sp.membudget,&sp.scratchdir,&filterbank,&fb.nbits,&fb.bin,&pyrfile,&duration,&nocache);
 
   /* save the command line */
   copy_cmd_line(argc,argv,command_line);
@@ -228,381 +287,223 @@ int main(int argc, char *argv[])
   /* open output file, stdout default */
   open_file(outfile,&fpoutput);
 
-  /* open file input */
-  open_flags = O_RDONLY;
-  if((fdinput = open(infile, open_flags)) < 0 )
+  /* the inputs, with -m, -c and -S unless the name says otherwise */
+  sp.nstreams = ninfiles;
+  sp.stream = (struct SPEC_STREAM *) calloc(ninfiles, sizeof(struct SPEC_STREAM));
+  if (!sp.stream)
     {
-      perror("open input file");
+      fprintf(stderr,"Malloc error\n");
       exit(1);
     }
-
-  /* read Cheb coefficients, if requested */
-  if (chebfile[0] != '-') 
+  for (k = 0; k < ninfiles; k++)
     {
-      chebcoeff = (double *) malloc(64 * sizeof(double));   /* allocate up to 64 coefficients */
-      degree = read_cheb_coeffs(chebfile, chebcoeff);       /* read coeffs and return degree */
+      sp.stream[k].mode = mode;
+      sp.stream[k].chan = chan;
+      sp.stream[k].skip = nskipseconds;
+      if (spec_stream(infiles[k], &sp.stream[k]) < 0)
+	{
+	  fprintf(stderr,"Channel must be 1 or 2 in %s\n",infiles[k]);
+	  exit(1);
+	}
     }
 
-  switch (mode)
+  /* a rerun of the same settings on the same inputs writes the kept output */
+  memset(&rc, 0, sizeof(rc));
+  if (!nocache && !pyrfile && sp.skthresh == 0 && spec_key(&sp,key,sizeof(key)) == 0)
     {
-    case  -1: smpwd = 8; break;  
-    case   1: smpwd = 8; break;
-    case   2: smpwd = 4; break;
-    case   3: smpwd = 2; break; 
-    case   5: smpwd = 4; break;
-    case   6: smpwd = 2; break;
-    case   7: smpwd = 1; break;
-    case   8: smpwd = 2; break; 
-    case  16: smpwd = 1; break; 
-    case  32: smpwd = 0.5; break; 
-    default: fprintf(stderr,"Invalid mode\n"); exit(1);
+      k = strlen(key);
+      snprintf(key + k, sizeof(key) - k, " S=%.9g n=%qd t=%d b=%d l=%d x=%.9g,%.9g w=%d,%d,%d T=%.9g P=%u M=%.9g",
+	       sp.stream[0].skip, sp.sum, sp.timeseries, binary, dB, sp.freqmin, sp.freqmax,
+	       filterbank, fb.nbits, fb.bin, duration, sp.effort, sp.membudget);
+      if (strlen(key) < sizeof(key) - 1 && rc_open(&rc,"pfs_fft",key,fpoutput))
+	{
+	  fprintf(stderr,"\n%s\n\n",command_line);
+	  fprintf(stderr,"%-31s: %s\n","Answered from result cache",rc.name);
+	  exit(sp.timeseries ? 1 : 0);	/* as at the end of the run */
+	}
     }
 
-  /* compute transform parameters */
-  fftlen = (int) rint(fsamp / freqres * 1e6);
-  bufsize = fftlen * 4 / smpwd; 
-  fftlen = fftlen / downsample;
-
-  /* describe what we are doing */
-  fprintf(stderr,"\n%s\n\n",command_line);
-  fprintf(stderr,"FFT length                     : %d\n",fftlen);
-  fprintf(stderr,"Frequency resolution           : %e Hz\n",freqres);
-  fprintf(stderr,"Processed bandwidth            : %e Hz\n",freqres*fftlen);
-  if (rmsmin != 0 || rmsmax != 0)
-    fprintf(stderr,"Scaling to rms power between   : [%e,%e] Hz\n\n",rmsmin,rmsmax);
-
-  fprintf(stderr,"Data required for one transform: %ld bytes\n",bufsize);
-  fprintf(stderr,"Number of transforms to add    : %qd\n",sum);
-  fprintf(stderr,"Data required for one sum      : %qd bytes\n",sum * bufsize);
-  fprintf(stderr,"Integration time for one sum   : %e s\n",sum / freqres);
-  
-  nskipbytes = (long) rint(fsamp * 1e6 * nskipseconds * 4.0 / smpwd);
-  if (nskipseconds != 0)
-    {
-      fprintf(stderr,"Skipping from BOF              : %f seconds\n",nskipseconds);
-      fprintf(stderr,"Skipping from BOF              : %ld bytes\n",nskipbytes);
-    }
-  if (chebfile[0] != '-')
-    fprintf(stderr, "Degree of Chebyshev polynomial : %d\n",degree);    
-  /* for (i = 0; i <= degree; i++) fprintf(stderr, "%d %lf\n", i, chebcoeff[i]); */
-  fprintf(stderr,"\n");
-    
-  /* skip unwanted bytes */
-  /* fsamp samples per second during nskipseconds, and 4/smpwd bytes per complex sample */
-  if (nskipbytes != lseek(fdinput, nskipbytes, SEEK_SET))
+  /* -Y: answer from the cache when it holds these spectra, else make one */
+  if (pyrfile)
     {
-      fprintf(stderr,"Read error while skipping %ld bytes.  Check file size.\n",nskipbytes);
-      exit(1);
+      if (spec_key(&sp,key,sizeof(key)) < 0)
+	{
+	  fprintf(stderr,"Cannot identify the inputs, not using %s\n",pyrfile);
+	  pyrfile = NULL;
+	}
+      else if (pyr_open(&pyr,pyrfile,key))
+	{
+	  first = (long long) rint((sp.stream[0].skip - pyr.h.t0) / pyr.h.tsum);
+	  mult = sp.sum / pyr.h.sum;
+	  if (sp.sum % pyr.h.sum == 0 && first >= 0 && first + mult <= pyr.h.count[0]
+	      && fabs(sp.stream[0].skip - pyr.h.t0 - first * pyr.h.tsum) < 1e-3 * pyr.h.tsum)
+	    frompyr = 1;
+	  else
+	    fprintf(stderr,"%s does not hold -n %qd from %f s, reading the inputs\n",pyrfile,sp.sum,sp.stream[0].skip);
+	}
+      else if (sp.timeseries)
+	building = 1;
+      else
+	fprintf(stderr,"No cache in %s, which only -t makes\n",pyrfile);
     }
 
-  /* verify that scaling request is sensible */
-  if (rmsmin != 0 || rmsmax != 0)
+  /* open the inputs and plan the transforms, or take the spectra's shape from the cache */
+  if (frompyr)
     {
-      if (rmsmin > rmsmax || rmsmin < -freqres*fftlen/2 || rmsmax > freqres*fftlen/2)
+      sp.fftlen = pyr.h.fftlen;
+      sp.nspec = pyr.h.nspec;
+      sp.freqres = pyr.h.df;
+      sp.fcenter = pyr.h.f0 + sp.fftlen/2 * pyr.h.df;
+      sp.resolution = pyr.h.sum / pyr.h.tsum;
+      if ((pyrbuf = (float *) malloc((size_t) sp.nspec * sp.fftlen * sizeof(float))) == NULL)
 	{
-	  fprintf(stderr,"Problem with -s parameters\n");
+	  fprintf(stderr,"Malloc error\n");
 	  exit(1);
 	}
     }
+  else
+    spec_setup(&sp);
+  if (duration > 0)
+    maxrec = (long long) (duration * sp.resolution / sp.sum + 1e-6);
 
-  /* allocate storage */
-  nsamples = bufsize * smpwd / 4;
-  buffer    = (char *)  malloc(bufsize);
-  fftinbuf  = (float *) malloc(2 * fftlen * sizeof(float));
-  fftoutbuf = (float *) malloc(2 * fftlen * sizeof(float));
-  total = (float *) malloc(fftlen * sizeof(float));
-  rcp   = (char *)  malloc(2 * nsamples * sizeof(char));
-  if (!buffer || !fftinbuf || !fftoutbuf || !total || !rcp)
+  /* rows of the -x band, binned and quantized for -w */
+  if (sp.timeseries || filterbank)
     {
-      fprintf(stderr,"Malloc error\n"); 
-      exit(1);
+      if (!filterbank)
+	fb.nbits = 32;
+      fb.dB = dB;
+      fb.header = filterbank;
+      fb_setup(&fb,sp.fftlen,sp.nspec,spec_freq(&sp,0),sp.freqres,sp.freqmin,sp.freqmax,sp.sum / sp.resolution);
     }
 
-  /* compute fft plan */
-  p = fftwf_plan_dft_1d(fftlen, (fftwf_complex *)fftinbuf, (fftwf_complex *)fftoutbuf, FFTW_FORWARD, FFTW_ESTIMATE);
+  fpflags = spec_flagfile(&sp,outfile);
 
-  /* label used if time series is requested */
- loop:
-
-  /* sum transforms */
-  zerofill(total, fftlen);
-  for (i = 0; i < sum; i++)
+  /* describe what we are doing */
+  fprintf(stderr,"\n%s\n\n",command_line);
+  if (frompyr)
     {
-      /* initialize fft array to zero */
-      zerofill(fftinbuf, 2 * fftlen);
-      
-      /* read one data buffer       */
-      if (bufsize != read(fdinput, buffer, bufsize))
-	{
-	  fprintf(stderr,"Read error or EOF.\n");
-	  if (timeseries) fprintf(stderr,"Wrote %d transforms\n",counter);
-	  exit(1);
-	}
-
-      /* unpack */
-      switch (mode)
-	{
-	case 1:
-	  unpack_pfs_2c2b(buffer, rcp, bufsize); 
-	  break;
-	case 2: 
-	  unpack_pfs_2c4b(buffer, rcp, bufsize);
-	  break;
-	case 3: 
-	  unpack_pfs_2c8b(buffer, rcp, bufsize);
-	  break;
-	case 5:
-	  if (chan == 2) unpack_pfs_4c2b_lcp (buffer, rcp, bufsize);
-	  else 		 unpack_pfs_4c2b_rcp (buffer, rcp, bufsize);
-	  break;
-	case 6: 
-	  if (chan == 2) unpack_pfs_4c4b_lcp (buffer, rcp, bufsize);
-	  else 		 unpack_pfs_4c4b_rcp (buffer, rcp, bufsize);
-	  break;
-	case 7:
-	  if (chan == 2) unpack_pfs_4c8b_lcp (buffer, rcp, bufsize);
-	  else 		 unpack_pfs_4c8b_rcp (buffer, rcp, bufsize);
-	  break;
-     	case 8: 
-	  memcpy (rcp, buffer, bufsize);
-	  break;
-	case 16: 
-	  for (i = 0, j = 0; i < bufsize; i+=sizeof(short), j++)
-	    {
-	      memcpy(&x,&buffer[i],sizeof(short));
-	      fftinbuf[j] = (float) x;
-	    }
-	  break;
-     	case 32: 
-	  memcpy(fftinbuf,buffer,bufsize);
-	  break;
-	default: 
-	  fprintf(stderr,"Mode not implemented yet\n"); 
-	  exit(-1);
-	}
+      fprintf(stderr,"%-31s: %s\n","Answered from pyramid cache",pyrfile);
+      fprintf(stderr,"%-31s: %qd, %qd transforms each\n","Cached records",pyr.h.count[0],pyr.h.sum);
+      fprintf(stderr,"%-31s: %qd from record %qd\n","Cached records per output",mult,first);
+      fprintf(stderr,"%-31s: %d\n","FFT length",sp.fftlen);
+      fprintf(stderr,"%-31s: %e Hz\n","Bin spacing",sp.freqres);
+      fprintf(stderr,"%-31s: %e s\n\n","Integration time for one sum",sp.sum / sp.resolution);
+    }
+  else
+    spec_describe(&sp, stderr);
+  if (building)
+    {
+      pyr_create(&pyr,pyrfile,key,sp.nspec,sp.fftlen,sp.sum,sp.sum / sp.resolution,sp.stream[0].skip,spec_freq(&sp,0),sp.freqres);
+      fprintf(stderr,"%-31s: %s\n","Writing pyramid cache",pyrfile);
+    }
+  if (filterbank)
+    {
+      fb_describe(&fb, stderr);
+      fb_header(&fb, fpoutput, infiles[0]);
+    }
 
-      /* downsample */
-      if (mode != 16 && mode != 32)
-	for (k = 0, l = 0; k < 2*fftlen; k += 2, l += 2*downsample)
-	  {
-	    for (j = 0; j < 2*downsample; j+=2)
-	      {
-		fftinbuf[k]   += (float) rcp[l+j];
-		fftinbuf[k+1] += (float) rcp[l+j+1];
-	      }
-	  }
+  /* start the workers */
+  if (!frompyr)
+    spec_start(&sp);
 
-      /* compute DC offset if required */
-      if (dcoffset)
-	{
-	  average(fftinbuf, fftlen, &dcoffi, &dcoffq);
-	  /* fprintf(stderr,"DC offsets found: %e %e\n", dcoffi, dcoffq); */
-	}
+  /* label used if time series is requested */
+ loop:
 
-      
-      /* deal with nonzero DC offsets if provided by user or if option -D was invoked */
-      if (dcoffi != 0 || dcoffq != 0)
-	for (k = 0; k < 2*fftlen; k += 2)
-	  {
-	    fftinbuf[k]   -= dcoffi;
-	    fftinbuf[k+1] -= dcoffq; 
-	  }
-      
-      /* transform, swap, and compute power */
-      if (invert) swap_iandq(fftinbuf,fftlen); 
-      if (hanning) vector_window(fftinbuf,fftlen);
-      fftwf_execute(p); 
-      if (swap) swap_freq(fftoutbuf,fftlen); 
-      vector_power(fftoutbuf,fftlen);
-      
-      /* sum transforms */
-      for (j = 0; j < fftlen; j++)
-	total[j] += fftoutbuf[j];
+  /* wait for the next sum of transforms, or add it up from the cache */
+  if (maxrec >= 0 && counter >= maxrec)
+    total = NULL;
+  else if (frompyr)
+    total = pyr_sum(&pyr,first + counter * mult,mult,pyrbuf) < 0 ? NULL : pyrbuf;
+  else
+    total = spec_next(&sp);
+  if (total == NULL)
+    {
+      if (building)
+	pyr_finish(&pyr);
+      rc_store(&rc);
+      fprintf(stderr,"Read error or EOF.\n");
+      if (sp.timeseries) fprintf(stderr,"Wrote %d transforms\n",counter);
+      if (sp.timeseries && sp.skthresh != 0)
+	fprintf(stderr,"Flagged %lld of %lld bins\n",nflagged,(long long) counter * sp.fftlen);
+      if (fpflags) fclose(fpflags);
+      exit(1);
     }
-  
-  /* set DC to average of neighboring values  */
-  /* total[fftlen/2] = (total[fftlen/2-1]+total[fftlen/2+1]) / 2.0;  */
 
-  /* apply Chebyshev to detected power if needed */
-  if (degree) chebyshev_window(total,fftlen,chebcoeff,degree);
-  
-  /* compute rms if needed */
-  mean = 0;
-  sigma = 1;
-  if (rmsmin != 0 || rmsmax != 0)
+  /* the -K flags of this output */
+  if (sp.skthresh != 0)
     {
-      /* identify relevant indices for rms power computation */
-      imin = fftlen/2 + rmsmin/freqres; 
-      imax = fftlen/2 + rmsmax/freqres; 
-      mean1 = var1 = 0;
-      n1 = 0;
-      for (i = imin; i < imax; i++)
-	{
-	  mean1 += total[i];
-	  var1  += total[i] * total[i];
-	  n1++;
-	}
-      mean1  = mean1 / n1;
-      var1   = var1 / n1;
-      sigma1 = sqrt(var1 - mean1 * mean1);
-
-      /* now redo calculation but exclude 3-sigma outliers */
-      mean = var = 0;
-      n = 0;
-      for (i = imin; i < imax; i++)
-	{
-	  if (fabs((total[i] - mean1)/sigma1) > 3.5)
-	    continue;
-	  mean += total[i];
-	  var  += total[i] * total[i];
-	  n++;
-	}
-      mean  = mean / n;
-      var   = var / n;
-      sigma = sqrt(var - mean * mean);
-      /*
-      fprintf(stderr,"Computed mean,sigma with    %d outliers : %e +/- %e s\n",(n1-n),mean1,sigma1);
-      fprintf(stderr,"Computed mean,sigma without %d outliers : %e +/- %e s\n",(n1-n),mean,sigma);
-      */
+      nflagged += sp.nflagged;
+      if (fpflags && sp.flagbytes != fwrite(sp.flags,1,sp.flagbytes,fpflags))
+	fprintf(stderr,"Write error\n");
+      if (!sp.timeseries)
+	fprintf(stderr,"Flagged %d of %d bins\n",sp.nflagged,sp.fftlen);
     }
-  
+
   /* write output */
-  /* either time series */
-  if (timeseries)
+  /* either time series, the nspec spectra one after the other */
+  if (sp.timeseries)
     {
-      for (i = 0; i < fftlen; i++) total[i] = (total[i]-mean)/sigma;
-      if (fftlen != fwrite(total,sizeof(float),fftlen,fpoutput))
+      if (building)
+	pyr_add(&pyr,total);
+      if (fb_write(&fb,total,fpoutput) < 0)
 	fprintf(stderr,"Write error\n");
       fflush(fpoutput);
+      if (fpflags) fflush(fpflags);
       counter++;
+      if (!frompyr)
+	spec_done(&sp,total);
       goto loop;
     }
-  /* or standard output */
+  /* or a filterbank file of one row */
+  else if (filterbank)
+    {
+      if (fb_write(&fb,total,fpoutput) < 0)
+	fprintf(stderr,"Write error\n");
+    }
+  /* or standard output, one value per spectrum */
   /* or limited frequency range */
   else
-    for (i = 0; i < fftlen; i++)
+    for (i = 0; i < sp.fftlen; i++)
       {
-	  freq = (i-fftlen/2)*freqres;
-    
-	  if ((freqmin == 0.0 && freqmax == 0.0) || (freq >= freqmin && freq <= freqmax)) 
+	  freq = spec_freq(&sp,i);
+
+	  if ((sp.freqmin == 0.0 && sp.freqmax == 0.0) || (freq >= sp.freqmin && freq <= sp.freqmax))
 	  {
-	    value = (total[i]-mean)/sigma;
-	    if (dB) value = 10*log10(value);
+	    if (!binary)
+	      fprintf(fpoutput,"% .3f",freq);
+	    for (k = 0; k < sp.nspec; k++)
+	      {
+		value = total[k * sp.fftlen + i];
+		if (dB) value = 10*log10(value);
 
-	    if (binary)
-	      fwrite(&value,sizeof(float),1,fpoutput);
-	    else
-	      fprintf(fpoutput,"% .3f % .3e\n",freq,value);  
+		if (binary)
+		  fwrite(&value,sizeof(float),1,fpoutput);
+		else
+		  fprintf(fpoutput," % .3e",value);
+	      }
+	    if (!binary)
+	      fprintf(fpoutput,"\n");
 	  }
       }
-  
-  fftwf_destroy_plan(p);
-  free(fftinbuf);
-  free(fftoutbuf);
-  
-  return 0;
-}
-
-/******************************************************************************/
-/*    average         							      */
-/******************************************************************************/
-void average(float *inbuf, int nsamples, double *i, double *q)
-{
-  int k;
-
-  *i = 0;
-  *q = 0;
-  
-  /* sum Is and Qs */
-  for (k = 0; k < 2*nsamples; k += 2)
-    {
-      *i  += inbuf[k];
-      *q  += inbuf[k+1];
-    }
-
-  /* divide by nsamples to get the average value */
-  *i = *i / nsamples;
-  *q = *q / nsamples;
-
-  return;
-}    
-/******************************************************************************/
-/*	vector_window							      */
-/******************************************************************************/
-void vector_window(float *data, int len)
-{
-  /* Hanning windows the data array of length 'len' (complex samples)
-  */
-  float  weight;		/* calculated weight */
-  double n_minus_1;		/* weight calculation scale */
-  int    i,j,k;
 
-  n_minus_1 = 1.0/(double)(len - 1);
-
-  for (i=0, j=0, k=1; i<len; i++, j+=2, k+=2)
-  {
-    weight = (float)(0.5 - 0.5 * cos( 2 * M_PI * (double)i * n_minus_1 ) );
-    data[j] *= weight;
-    data[k] *= weight;
-  }
-  return;
-}
-
-/******************************************************************************/
-/*	chebyshev_window						      */
-/******************************************************************************/
-void chebyshev_window(float *data, int len, double *chebcoeff, int degree)
-{
-  /* Applies Chebyshev window the data array of length 'len' (floating point samples)
-  */
-  double x;
-  double weight;		/* calculated weight */
-  int    i;
-
-  for (i=0; i<len; i++)
-  {
-    x = -0.5 + (double) i / (double) len;
-    weight = chebeval(x, chebcoeff, degree);
-    data[i] /= weight;
-  }
-  return;
-}
+  if (fpflags) fclose(fpflags);
+  rc_store(&rc);
+  if (frompyr)
+    pyr_close(&pyr);
+  else
+    spec_finish(&sp);
 
-/******************************************************************************/
-/*	chebeval							      */
-/******************************************************************************/
-double chebeval(double x, double c[], int degree)
-{
-  /* 
-     Evaluate a Chebyshev series at points x.
-     Expects an array `c` of length at least degree + 1 = n + 1
-     This function returns the value:
-     p(x) = c_0 * T_0(x) + c_1 * T_1(x) + ... + c_n * T_n(x)
-  */
-  double x2;
-  double c0, c1;
-  double tmp;
-  int i;
-  
-  x2 = 2*x;
-  c0 = c[degree-1];
-  c1 = c[degree];
-  for (i = 2; i <= degree; i++)    
-    {
-      tmp = c0;
-      c0 = c[degree-i] - c1;
-      c1 = tmp + c1*x2;
-    }
-  return c0 + c1*x;
+  return 0;
 }
 
 /******************************************************************************/
 /*	processargs							      */
 /******************************************************************************/
-void	processargs(argc,argv,infile,outfile,mode,fsamp,freqres,downsample,sum,binary,timeseries,chan,freqmin,freqmax,rmsmin,rmsmax,dB,invert,hanning,chebfile,nskipseconds,dcoffi,dcoffq,dcoffset)
+void	processargs(argc,argv,ninfiles,infiles,outfile,mode,fsamp,freqres,downsample,sum,binary,timeseries,chan,freqmin,freqmax,rmsmin,rmsmax,dB,invert,hanning,chebfile,nskipseconds,dcoffi,dcoffq,dcoffset,nthreads,effort,real,foff,zoom,pfbtaps,pfbwindow,fastlen,combine,skthresh,skzero,membudget,scratchdir,filterbank,fbbits,fbbin,pyrfile,duration,nocache)
 int	argc;
 char	**argv;			 /* command line arguements */
-char	**infile;		 /* input file name */
+int	*ninfiles;		 /* number of input files */
+char	***infiles;		 /* input file names */
 char	**outfile;		 /* output file name */
 int     *mode;
 double   *fsamp;
@@ -624,11 +525,30 @@ float   *nskipseconds;
 double  *dcoffi;
 double  *dcoffq;
 int     *dcoffset;
+int     *nthreads;
+unsigned int *effort;
+int     *real;
+double  *foff;
+int     *zoom;
+int     *pfbtaps;
+char    *pfbwindow;
+int     *fastlen;
+int     *combine;
+float   *skthresh;
+int     *skzero;
+float   *membudget;
+char   **scratchdir;
+int     *filterbank;
+int     *fbbits;
+int     *fbbin;
+char   **pyrfile;
+float   *duration;
+int     *nocache;
 {
   /* function to process a programs input command line.
      This is a template which has been customised for the pfs_fft program:
 	- the outfile name is set from the -o option
-	- the infile name is set from the 1st unoptioned argument
+	- the infile names are the unoptioned arguments, stdin if none
   */
 
   int getopt();		/* c lib function returns next opt*/ 
@@ -636,15 +556,17 @@ int     *dcoffset;
   extern int optind;	/* after call, ind into argv for next*/
   extern int opterr;    /* if 0, getopt won't output err mesg*/
 
-  char *myoptions = "m:f:d:r:n:tc:o:lbx:s:iHC:S:I:Q:D"; /* options to search for :=> argument*/
-  char *USAGE1="pfs_fft -m mode -f sampling frequency (MHz) [-r desired frequency resolution (Hz)] [-d downsampling factor] [-n sum n transforms] [-l (dB output)] [-b (binary output)] [-t time series] [-x freqmin,freqmax (Hz)] [-s scale to sigmas using smin,smax (Hz)] [-c channel (1 or 2)] [-i swap IQ before transform (invert freq axis)] [-w apply Hanning window before transform] [-C file of Chebyshev polynomial coefficients defining window to apply after transform] [-S number of seconds to skip before applying first FFT] [-I dcoffi] [-Q dcoffq] [-D compute and remove DC offset prior to FFT] [-o outfile] [infile]";
+  char *myoptions = "m:f:d:r:n:tc:o:lbx:s:iHC:S:I:Q:Dj:P:RF:zB:L:k:K:M:w:Y:T:N"; /* options to search for :=> argument*/
+  char *USAGE1="pfs_fft -m mode -f sampling frequency (MHz) [-r desired frequency resolution (Hz)] [-d downsampling factor] [-n sum n transforms] [-l (dB output)] [-b (binary output)] [-t time series] [-x freqmin,freqmax (Hz)] [-s scale to sigmas using smin,smax (Hz)] [-c channel (1 or 2)] [-i swap IQ before transform (invert freq axis)] [-H apply Hanning window before transform] [-C file of Chebyshev polynomial coefficients defining window to apply after transform] [-S number of seconds to skip before applying first FFT] [-I dcoffi] [-Q dcoffq] [-D compute and remove DC offset prior to FFT] [-j threads] [-P estimate|measure|patient|exhaustive] [-R real input (modes 16, 32)] [-F frequency offset for real input (Hz)] [-z zoom to the -x band] [-B taps[,window] polyphase filterbank] [-L res|pad fast FFT length] [-k sum|separate|cross|stokes] [-K sigmas[,zero] spectral kurtosis flagging] [-M megabytes[,scratch dir] memory budget] [-w nbits[,bins] SIGPROC filterbank output] [-Y pyramid cache file] [-T seconds of data] [-N no result cache] [-o outfile] [infile[:mode[:chan[:skip]]] ...]";
   char *USAGE2="Valid modes are\n\t 0: 2c1b (N/A)\n\t 1: 2c2b\n\t 2: 2c4b\n\t 3: 2c8b\n\t 4: 4c1b (N/A)\n\t 5: 4c2b\n\t 6: 4c4b\n\t 7: 4c8b (N/A)\n\t 8: signed bytes\n\t16: signed 16bit\n\t32: 32bit floats\n";
   int  c;			 /* option letter returned by getopt  */
   int  arg_count = 1;		 /* optioned argument count */
+  static char *stdinput[] = { "-" };
 
   /* default parameters */
   opterr = 0;			 /* turn off there message */
-  *infile  = "-";		 /* initialise to stdin, stdout */
+  *ninfiles = 1;		 /* initialise to stdin, stdout */
+  *infiles = stdinput;
   *outfile = "-";
 
   *mode  = 0;                /* default value */
@@ -666,6 +588,24 @@ int     *dcoffset;
   *rmsmax  = 0;		/* not set value */
   *dcoffi = 0;
   *dcoffq = 0;
+  *nthreads = 1;
+  *effort = FFTW_ESTIMATE;
+  *real = 0;
+  *foff = 0;
+  *zoom = 0;
+  *pfbtaps = 0;
+  *fastlen = FFT_EXACT;
+  *combine = SPEC_SUM;
+  *skthresh = 0;		/* no flagging */
+  *skzero = 0;
+  *membudget = 0;	/* half the memory */
+  *scratchdir = NULL;
+  *filterbank = 0;	/* no header */
+  *fbbits = 32;
+  *fbbin = 1;
+  *pyrfile = NULL;
+  *duration = 0;	/* all */
+  *nocache = 0;
 
   /* loop over all the options in list */
   while ((c = getopt(argc,argv,myoptions)) != -1)
@@ -682,6 +622,105 @@ int     *dcoffset;
 	arg_count += 2;           /* two command line arguments */
 	break;
 
+      case 'j':
+	sscanf(optarg,"%d",nthreads);
+	arg_count += 2;
+	break;
+
+      case 'P':
+	if (fft_effort(optarg,effort) < 0)
+	  {
+	    fprintf(stderr,"Unknown planner effort %s\n",optarg);
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'B':
+	if (pfb_parse(optarg,pfbtaps,pfbwindow) < 0)
+	  {
+	    fprintf(stderr,"Bad filterbank taps or window %s\n",optarg);
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'L':
+	if (fft_lenmode(optarg,fastlen) < 0)
+	  {
+	    fprintf(stderr,"-L must be res or pad\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'k':
+	if (spec_combine(optarg,combine) < 0)
+	  {
+	    fprintf(stderr,"-k must be sum, separate, cross or stokes\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'K':
+	if (spec_sk(optarg,skthresh,skzero) < 0)
+	  {
+	    fprintf(stderr,"-K must be sigmas or sigmas,zero\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'M':
+	if (spec_budget(optarg,membudget,scratchdir) < 0)
+	  {
+	    fprintf(stderr,"-M must be megabytes or megabytes,directory\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'w':
+	if (fb_parse(optarg,fbbits,fbbin) < 0)
+	  {
+	    fprintf(stderr,"-w must be 32, 16 or 8 bits, then optionally bins per channel\n");
+	    goto errout;
+	  }
+	*filterbank = 1;
+	arg_count += 2;
+	break;
+
+      case 'Y':
+	*pyrfile = optarg;
+	arg_count += 2;
+	break;
+
+      case 'T':
+	sscanf(optarg,"%f",duration);
+	arg_count += 2;
+	break;
+
+      case 'N':
+	*nocache = 1;
+	arg_count += 1;
+	break;
+
+      case 'z':
+	*zoom = 1;
+	arg_count += 1;
+	break;
+
+      case 'R':
+	*real = 1;
+	arg_count += 1;
+	break;
+
+      case 'F':
+	sscanf(optarg,"%lf",foff);
+	arg_count += 2;
+	break;
+
       case 'o':
 	*outfile = optarg;	/* output file name */
 	arg_count += 2;		/* two command line arguments */
@@ -791,38 +830,66 @@ int     *dcoffset;
       }
   }
   
-  if (arg_count < argc)		 /* 1st non-optioned param is infile */
-    *infile = argv[arg_count];
-
-  /* must specify a valid mode */
-  if (*mode == 0)
+  if (arg_count < argc)		 /* non-optioned params are infiles */
     {
-      fprintf(stderr,"Must specify sampling mode\n");
-      goto errout;
+      *ninfiles = argc - arg_count;
+      *infiles = &argv[arg_count];
     }
+
+  /* the mode, here or after each infile, is checked by spec_setup */
   /* must specify a valid sampling frequency */
   if (*fsamp == 0) 
     {
       fprintf(stderr,"Must specify sampling frequency\n");
       goto errout;
     }
+  if (*nthreads < 1)
+    {
+      fprintf(stderr,"Must have at least one thread\n");
+      goto errout;
+    }
   /* must specify a valid channel */
   if (*chan != 1 && *chan != 2) goto errout;
   /* some combinations not implemented yet */
-  if (*timeseries && *dB) 
+  if (*dB && (*combine == SPEC_CROSS || *combine == SPEC_STOKES))
+    {
+      fprintf(stderr,"Cannot have -l with -k cross or stokes\n");
+      goto errout;
+    }
+  if (*zoom && (*freqmin == 0 && *freqmax == 0))
+    {
+      fprintf(stderr,"Zoom (-z) requires a band (-x)\n");
+      goto errout;
+    }
+  if (*pfbtaps && (*hanning || *zoom))
+    {
+      fprintf(stderr,"Cannot have -B with -H or -z\n");
+      goto errout;
+    }
+  if (*fastlen == FFT_PAD && (*pfbtaps || *zoom))
+    {
+      fprintf(stderr,"Cannot have -L pad with -B or -z\n");
+      goto errout;
+    }
+  if (*zoom && *real)
+    {
+      fprintf(stderr,"Cannot have -z and -R simultaneously yet\n");
+      goto errout;
+    }
+  if (*pyrfile && (*skthresh != 0 || *rmsmin != 0 || *rmsmax != 0))
     {
-      fprintf(stderr,"Cannot have -t and -l simultaneously yet\n");
+      fprintf(stderr,"Cannot have -Y with -K or -s\n");
       goto errout;
     }
-  if (*timeseries && (*freqmin != 0 || *freqmax !=0)) 
+  if (*duration != 0 && !*timeseries)
     {
-      fprintf(stderr,"Cannot have -t and -x simultaneously yet\n");
+      fprintf(stderr,"Duration (-T) requires time series (-t)\n");
       goto errout;
     }
-  if (*downsample > 1 && (*mode == 16 || *mode == 32)) 
+  if (*foff != 0 && !*real)
     {
-      fprintf(stderr,"Cannot have -d with modes 16 or 32 yet\n");
-      exit (1);
+      fprintf(stderr,"Frequency offset (-F) requires real input (-R)\n");
+      goto errout;
     }
 
   return;
@@ -856,31 +923,6 @@ FILE    **fpoutput;		/* pointer to output file */
   return;
 }
 
-/******************************************************************************/
-/*	read cheb coeffs						      */
-/******************************************************************************/
-int     read_cheb_coeffs(char *chebfile, double *chebcoeff)
-{
-  int degree = 0;
-  FILE   *fpcheb;		/* pointer to file of Cheb coefficients */
-
-  /* open the Cheb coeff file */
-  fpcheb=fopen(chebfile,"r");
-  if (fpcheb == NULL)
-    {
-      perror("read_cheb_coeff: cheb coefficients file open error");
-      exit(1);
-    }
-
-  /* read coefficients */
-  while (fscanf(fpcheb, "%lf", &chebcoeff[degree++]) == 1)
-    continue;
-
-  degree = degree - 1; /* EOF does not count */
-  degree = degree - 1; /* number of coeffs = degree + 1 */
-
-  return degree;
-}
 
 /******************************************************************************/
 /*	copy_cmd_line    						      */
@@ -906,80 +948,7 @@ char	command_line[];		/* command line parameters in single string */
   return;
 }	
 
-/******************************************************************************/
-/*	vector_power							      */
-/******************************************************************************/
-void vector_power(float *data, int len)
-{
-  /* detects the complex array data of len complex samples placing the
-     result in the bottom len samples of the input array
-  */
-
-  int i,j,k;
-
-  for (i=0, j=0, k=1; i<len; i++, j+=2, k+=2)
-    data[i] = data[j]*data[j] + data[k]*data[k];
 
-  return;
-}
-
-/******************************************************************************/
-/*	swap_freq							      */
-/******************************************************************************/
-void swap_freq(float *data, int len)
-{
-  /* swaps the location of the + and - frequencies for a continuous
-     spectrum, the data array is 2*len samples long
-  */
-  int i,j;
-  float temp;
-
-  for (i=0, j=len; i<len; i++, j++)
-    {
-      temp    = data[i];
-      data[i] = data[j];
-      data[j] = temp;
-    }
-
-  return;
-}
-
-/******************************************************************************/
-/*	swap_iandq							      */
-/******************************************************************************/
-void swap_iandq(float *data, int len)
-{
-  /* swaps the i and q components of each complex word to reverse the "phase"
-     direction, the data array is len complex samples long or 2*len samples long
-  */
-
-  int i,j;
-  float temp;
-
-  for (i=0, j=1; i < 2*len; i+=2, j+=2)
-    {
-      temp    = data[i];
-      data[i] = data[j];
-      data[j] = temp;
-    }
-
-  return;
-}
-
-/******************************************************************************/
-/*	zerofill							      */
-/******************************************************************************/
-void zerofill(float *data, int len)
-{
-  /* zero fills array of floats of size len */
-
-  int i;
-
-  for (i=0; i<len; i++)
-    data[i] = 0.0;
-
-  return;
-}
 
 /******************************************************************************/
 /*	no_comma_in_string						      */
@@ -1000,3 +969,4 @@ char    params[];               /* parameter string */
 
   return(no_comma);
 }
+
@@ -3,7 +3,7 @@
 *  $Id: pfs_fft_2.c,v 4.2 2020/05/21 17:47:53 jlm Exp $
 *  This programs performs spectral analysis on data acquired with the portable
 *  fast sampler (PFS), JPL clones of the PFS, and other data-taking devices.
-*  It sums the powers obtained in two channels.
+*  It sums the powers obtained in two or more channels.
 *
 *  usage:
 *  	pfs_fft -m mode 
@@ -22,7 +22,15 @@
 *              [-C file of Chebyshev polynomial coefficients defining window to apply after transform] 
 *              [-S number of seconds to skip before applying first FFT]
 *              [-h fch1, write output in HDF5 format with starting frequency fch1 (MHz)]
-*              [-o outfile] [infile]
+*              [-Z level, shuffle and deflate HDF5 output]
+*              [-P estimate|measure|patient|exhaustive]
+*              [-B taps[,window] polyphase filterbank]
+*              [-L res|pad fast FFT length]
+*              [-j threads]
+*              [-k sum|separate|cross combine inputs]
+*              [-K sigmas[,zero] spectral kurtosis flagging]
+*              [-M megabytes[,scratch dir] memory budget]
+*              [-o outfile] infile1[:mode[:chan[:skip]]] infile2... [...]
 *
 *  input:
 *       the input parameters are typed in as command line arguments
@@ -37,9 +45,49 @@
 *			one after the other until EOF
 *       the -x option specifies an optional range of output frequencies
 *       the -c argument specifies which channel (1 or 2) to process
+*	the -h option writes the spectra to the /data dataset of an HDF5
+*			file, one row per -t record (or a single row
+*			without -t), nifs one per output spectrum; rows are
+*			written HDF5ROWS at a time to a chunked dataset
+*			that grows as they come, so the input size need not
+*			be known
+*	the -Z argument compresses the HDF5 output with the shuffle and
+*			deflate filters at that level (1-9)
+*	the -P argument specifies the FFTW planner effort (default estimate);
+*			plans are remembered in ~/.pfs_wisdom or $PFS_WISDOM
+*	the -B option replaces the single block FFT by a polyphase
+*			filterbank of taps blocks (default 4) with a prototype
+*			filter windowed by hamming (default), hann, blackman,
+*			nuttall or rect
+*	the -L option moves a transform length with prime factors above 7
+*			to a fast length: res changes the resolution to the
+*			nearest one, pad zero pads each block up to the next
+*			one (finer bin spacing, same resolution)
+*	the -j argument specifies the number of worker threads, by default
+*			one per input so the disks and transforms overlap;
+*			the output does not depend on the number of threads
+*	the -k option keeps the inputs' spectra apart (separate), or adds
+*			the real and imaginary parts of the cross spectrum
+*			of each pair after them (cross), instead of summing
+*			the powers; the output has one column (or one
+*			spectrum in a -t record, one feed in HDF5) each
+*	the -K option flags interference by the spectral kurtosis of the
+*			-n transforms in each bin of each input (-n 2 or
+*			more), as in pfs_fft; ,zero zeroes flagged bins
+*	the -M option sets the memory budget for one transform, as in
+*			pfs_fft; longer transforms are done four-step,
+*			spilling to scratch files in the given directory
+*	the 4 channel modes take rcp from the first input, lcp from the
+*			second, and so on alternately
+*	any input file may also be the prefix of a recording set 
+*			(data*.NNN) whose files are then read as one stream;
+*			a suffix :mode:chan:skip overrides -m, the channel
+*			and -S for that input
 *
 *  output:
 *	the -o option identifies the output file, stdout is default
+*	with -K, outfile.flags holds one bit per bin (bin i in bit i%8 of
+*			byte i/8) for each output spectrum or -t record
 *
 *  Jean-Luc Margot, Mar 2017, based on pfs_fft 3.13
 *******************************************************************************/
@@ -67,466 +115,254 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include "unpack.h"
+#include "fftutil.h"
+#include "pfb.h"
+#include "spectral.h"
 #include <fftw3.h>
 #include <hdf5.h>
 
 /* revision control variable */
-static char const rcsid[] = 
+static char const rcsid[] =
 "$Id: pfs_fft_2.c,v 4.2 2020/05/21 17:47:53 jlm Exp $";
 
 #define UNDEFINED 0.987654321
 
+/* HDF5 output: rows are buffered and written HDF5ROWS at a time (fewer if
+   that would take more than HDF5BUF bytes), and the dataset is chunked
+   the same number of rows by about HDF5CHUNK bytes of one feed, so each
+   write fills whole chunks and a reader of a frequency range over time
+   touches only the chunks it needs */
+#define HDF5ROWS  16
+#define HDF5BUF   (64 << 20)
+#define HDF5CHUNK (1 << 20)
+
 FILE   *fpoutput;		/* pointer to output file */
-int	fdinput1;		/* file descriptor for input file 1 */
-int	fdinput2;		/* file descriptor for input file 2 */
+FILE   *fpflags;		/* pointer to -K flag file */
 
 char   *outfile;		/* output file name */
-char   *infile1;	        /* input file name 1 */
-char   *infile2;	        /* input file name 2 */
-char   *chebfile;	        /* file of Chebyshev coefficients */
+char  **infiles;	        /* input file names */
 
 char	command_line[512];	/* command line assembled by processargs */
 
 void processargs();
 void open_file();
 void copy_cmd_line();
-void vector_power(float *data, int len);
-void vector_window(float *data, int len);
-void chebyshev_window(float *data, int len, double *chebcoeff, int degree);
-void swap_freq(float *data, int len);
-void swap_iandq(float *data, int len);
-void zerofill(float *data, int len);
-int  no_comma_in_string();	
-double chebeval(double x, double c[], int degree);
-int  read_cheb_coeffs(char *chebfile, double *chebcoeff);
-hid_t createHDF5File(const char* filename, size_t rows, size_t cols, double tsum, double freqres, double fch1);
-void writeFloatLineToHDF5(hid_t dataset_id, const float* line_data, size_t current_row, size_t cols);
+int  no_comma_in_string();
+hid_t createHDF5File(const char* filename, size_t nifs, size_t cols, double tsum, double freqres, double fch1, int deflate, int *batch);
+void writeFloatLinesToHDF5(hid_t dataset_id, const float* data, size_t first_row, size_t nrows, size_t nifs, size_t cols);
 
 int main(int argc, char *argv[])
 {
-  int mode;
-  long bufsize;		/* size of read buffer */
-  char *buffer1;	/* buffer 1 for packed data */
-  char *buffer2;	/* buffer 2 for packed data */
-  char *rcp;		/* buffer for unpacked data */
-  char *lcp;		/* buffer for unpacked data */
-  float smpwd;		/* # of single pol complex samples in a 4 byte word */
-  int nsamples;		/* # of complex samples in each buffer */
-  int levels;		/* # of levels for given quantization mode */
-  int degree=0;         /* degree of Chebyshev polynomial, default none */
-
-  float *fftinbuf1, *fftoutbuf1;
-  float *fftinbuf2, *fftoutbuf2;
-  float *total1,*total2;
+  struct SPEC sp;	/* transform parameters, see spectral.h */
   float *total;
-
-  double *chebcoeff;    /* array for polynomial coefficients */
-
+  int ninfiles;		/* number of input streams */
+  int mode;		/* sampling mode of the inputs */
+  int chan;		/* channel to process (1 or 2) for dual pol data */
+  float nskipseconds;     /* optional number of seconds to skip at beginning of file */
   float freq;		/* frequency */
-  float freqmin;	/* min frequency to output */
-  float freqmax;	/* max frequency to output */
   float value;		/* value to output */
-  float rmsmin;		/* min frequency for rms calculation */
-  float rmsmax;		/* max frequency for rms calculation */
-  double fsamp;		/* sampling frequency, MHz */
-  double freqres;	/* frequency resolution, Hz */
-  double mean,mean1;	/* needed for rms computation */
-  double var,var1;	/* needed for rms computation */
-  double sigma,sigma1;	/* needed for rms computation */
-  int downsample;	/* downsampling factor, dimensionless */
-  long long sum;	/* number of transforms to add, dimensionless */
   double tsum;		/* integration time for one sum */
-  int timeseries;	/* process as time series, boolean */
   int dB;		/* write out results in dB */
-  int fftlen;		/* transform length, complex samples */
-  int fftout;		/* number of output (summed) transforms */
-  int chan;		/* channel to process (1 or 2) for dual pol data */
+  long long fftout;	/* number of output (summed) transforms */
   int counter=0;	/* keeps track of number of transforms written */
-  int open_flags;	/* flags required for open() call */
-  int invert;		/* swap i and q before fft routine */
-  int hanning;		/* apply Hanning window before fft routine */
+  long long nflagged=0;	/* bins flagged over a time series */
   double hdf5;		/* write output file in HDF5 format with starting frequency fch1 (Hz) */
-  int swap = 1;		/* swap frequencies at output of fft routine */
+  int deflate;		/* HDF5 deflate level, 0 for none */
+  float *h5rows = NULL;	/* HDF5 rows not written yet */
+  int h5batch = 0;	/* rows per HDF5 write */
+  int h5n = 0;		/* rows held */
+  size_t rowlen;	/* floats per row */
   int binary;		/* write output as binary floating point quantities */
-  float nskipseconds;     /* optional number of seconds to skip at beginning of file */
-  long nskipbytes;	/* number of bytes to skip at beginning of file */
-  long long inbytes;	/* size of input file in bytes */
-  int imin,imax;	/* indices for rms calculation */
-  
-  fftwf_plan p1;
-  fftwf_plan p2;
-  int i,j,k,l,n,n1;
-  short x;
+  int i,k;
 
-  hid_t dataset_id;
-  struct stat fileStat;
+  hid_t dataset_id = -1;
 
   /* get the command line arguments */
-  processargs(argc,argv,&infile1,&infile2,&outfile,&mode,&fsamp,&freqres,&downsample,&sum,&binary,&timeseries,&chan,&freqmin,&freqmax,&rmsmin,&rmsmax,&dB,&invert,&hanning,&hdf5,&chebfile,&nskipseconds);
+  memset(&sp, 0, sizeof(sp));
+  processargs(argc,argv,&ninfiles,&infiles,&outfile,&mode,&sp.fsamp,&sp.freqres,&sp.downsample,&sp.sum,&binary,&sp.timeseries,&chan,&sp.freqmin,&sp.freqmax,&sp.rmsmin,&sp.rmsmax,&dB,&sp.invert,&sp.hanning,&hdf5,&deflate,&sp.chebfile,&nskipseconds,&sp.effort,&sp.pfbtaps,sp.pfbwindow,&sp.fastlen,&sp.combine,&sp.nthreads,&sp.skthresh,&sp.skzero,&sp.membudget,&sp.scratchdir);
 
   /* save the command line */
   copy_cmd_line(argc,argv,command_line);
 
-  /* open file input */
-  open_flags = O_RDONLY;
-  if((fdinput1 = open(infile1, open_flags)) < 0 )
+  /* the inputs; the 4 channel modes take rcp from the first, lcp from
+     the second and so on, unless the name says otherwise */
+  sp.nstreams = ninfiles;
+  sp.stream = (struct SPEC_STREAM *) calloc(ninfiles, sizeof(struct SPEC_STREAM));
+  if (!sp.stream)
     {
-      perror("open input file");
-      exit(1);
-    }
-  if((fdinput2 = open(infile2, open_flags)) < 0 )
-    {
-      perror("open input file");
-      exit(1);
-    }
-  if (fstat(fdinput1, &fileStat) == -1) {
-      perror("fstat input file");
+      fprintf(stderr,"Malloc error\n");
       exit(1);
     }
-  inbytes = fileStat.st_size;
-
-  /* read Cheb coefficients, if requested */
-  if (chebfile[0] != '-') 
+  for (k = 0; k < ninfiles; k++)
     {
-      chebcoeff = (double *) malloc(64 * sizeof(double));   /* allocate up to 64 coefficients */
-      degree = read_cheb_coeffs(chebfile, chebcoeff);       /* read coeffs and return degree */
-    }
-
-  switch (mode)
-    {
-    case  -1: smpwd = 8; break;
-    case   1: smpwd = 8; break;
-    case   2: smpwd = 4; break;
-    case   3: smpwd = 2; break;
-    case   5: smpwd = 4; break;
-    case   6: smpwd = 2; break;
-    case   8: smpwd = 2; break;
-    case  16: smpwd = 1; break;
-    case  32: smpwd = 0.5; break;
-    default: fprintf(stderr,"Invalid mode\n"); exit(1);
+      sp.stream[k].mode = mode;
+      sp.stream[k].chan = k % 2 + 1;
+      sp.stream[k].skip = nskipseconds;
+      if (spec_stream(infiles[k], &sp.stream[k]) < 0)
+	{
+	  fprintf(stderr,"Channel must be 1 or 2 in %s\n",infiles[k]);
+	  exit(1);
+	}
     }
+  if (sp.nthreads == 0)
+    sp.nthreads = ninfiles;	/* one per input, as the inputs' disks */
+  sp.dcfix = 1;
 
-  /* compute transform parameters */
-  fftlen = (int) rint(fsamp / freqres * 1e6);
-  bufsize = fftlen * 4 / smpwd;
-  fftlen = fftlen / downsample;
-  tsum = sum / freqres;
-
-  /* compute number of output transforms */
-  nskipbytes = (long) rint(fsamp * 1e6 * nskipseconds * 4.0 / smpwd);
-  fftout = (inbytes - nskipbytes) / bufsize / sum;
+  /* open the inputs and plan the transforms */
+  spec_setup(&sp);
+  tsum = sp.sum / sp.resolution;
+  fftout = sp.nsums;
 
   /* open output file, stdout default */
+  rowlen = (size_t) sp.nspec * sp.fftlen;
   if (hdf5 == UNDEFINED)
     open_file(outfile,&fpoutput);
   else
-    dataset_id = createHDF5File(outfile, fftout, fftlen, tsum, freqres, hdf5);
-
-  /* describe what we are doing */
-  fprintf(stderr,"\n%s\n\n",command_line);
-  fprintf(stderr,"FFT length                     : %d\n",fftlen);
-  fprintf(stderr,"Frequency resolution           : %e Hz\n",freqres);
-  fprintf(stderr,"Processed bandwidth            : %e Hz\n",freqres*fftlen);
-  if (rmsmin != 0 || rmsmax != 0)
-    fprintf(stderr,"Scaling to rms power between   : [%e,%e] Hz\n\n",rmsmin,rmsmax);
-
-  fprintf(stderr,"Data required for one transform: %ld bytes\n",bufsize);
-  fprintf(stderr,"Number of transforms to add    : %qd\n",sum);
-  fprintf(stderr,"Data required for one sum      : %qd bytes\n",sum * bufsize);
-  fprintf(stderr,"Integration time for one sum   : %e s\n",tsum);
-
-  if (nskipseconds != 0)
-    {
-      fprintf(stderr,"Skipping from BOF              : %f seconds\n",nskipseconds);
-      fprintf(stderr,"Skipping from BOF              : %ld bytes\n",nskipbytes);
-    }
-  fprintf(stderr,"Number of output (summed) ffts : %qd\n",fftout);
-
-  if (chebfile[0] != '-')
-    fprintf(stderr, "Degree of Chebyshev polynomial : %d\n",degree);
-  /* for (i = 0; i <= degree; i++) fprintf(stderr, "%d %lf\n", i, chebcoeff[i]); */
-  fprintf(stderr,"\n");
-    
-  /* skip unwanted bytes */
-  /* fsamp samples per second during nskipseconds, and 4/smpwd bytes per complex sample */
-  if (nskipbytes != lseek(fdinput1, nskipbytes, SEEK_SET))
-    {
-      fprintf(stderr,"Read error while skipping %ld bytes.  Check file size.\n",nskipbytes);
-      exit(1);
-    }
-  if (nskipbytes != lseek(fdinput2, nskipbytes, SEEK_SET))
-    {
-      fprintf(stderr,"Read error while skipping %ld bytes.  Check file size.\n",nskipbytes);
-      exit(1);
-    }
-
-  /* verify that scaling request is sensible */
-  if (rmsmin != 0 || rmsmax != 0)
     {
-      if (rmsmin > rmsmax || rmsmin < -freqres*fftlen/2 || rmsmax > freqres*fftlen/2)
+      dataset_id = createHDF5File(outfile, sp.nspec, sp.fftlen, tsum, sp.freqres, hdf5, deflate, &h5batch);
+      if ((h5rows = (float *) malloc(h5batch * rowlen * sizeof(float))) == NULL)
 	{
-	  fprintf(stderr,"Problem with -s parameters\n");
+	  fprintf(stderr,"Malloc error\n");
 	  exit(1);
 	}
     }
 
-  /* allocate storage */
-  nsamples = bufsize * smpwd / 4;
-  buffer1    = (char *)  malloc(bufsize);
-  buffer2    = (char *)  malloc(bufsize);
-  fftinbuf1  = (float *) malloc(2 * fftlen * sizeof(float));
-  fftinbuf2  = (float *) malloc(2 * fftlen * sizeof(float));
-  fftoutbuf1 = (float *) malloc(2 * fftlen * sizeof(float));
-  fftoutbuf2 = (float *) malloc(2 * fftlen * sizeof(float));
-  total1 = (float *) malloc(fftlen * sizeof(float));
-  total2 = (float *) malloc(fftlen * sizeof(float));
-  total = (float *) malloc(fftlen * sizeof(float));
-  rcp   = (char *)  malloc(2 * nsamples * sizeof(char));
-  lcp   = (char *)  malloc(2 * nsamples * sizeof(char));
-  if (!buffer2 || !fftinbuf2 || !fftoutbuf2 || !total || !rcp || !lcp)
-    {
-      fprintf(stderr,"Malloc error\n");
-      exit(1);
-    }
+  fpflags = spec_flagfile(&sp,outfile);
+
+  /* describe what we are doing */
+  fprintf(stderr,"\n%s\n\n",command_line);
+  spec_describe(&sp, stderr);
+  if (fftout >= 0)
+    fprintf(stderr,"Number of output (summed) ffts : %qd\n\n",fftout);
 
-  /* compute fft plan */
-  p1 = fftwf_plan_dft_1d(fftlen, (fftwf_complex *)fftinbuf1, (fftwf_complex *)fftoutbuf1, FFTW_FORWARD, FFTW_ESTIMATE);
-  p2 = fftwf_plan_dft_1d(fftlen, (fftwf_complex *)fftinbuf2, (fftwf_complex *)fftoutbuf2, FFTW_FORWARD, FFTW_ESTIMATE);
+  /* start the workers */
+  spec_start(&sp);
 
   /* label used if time series is requested */
  loop:
 
-  /* sum transforms */
-  zerofill(total1, fftlen);
-  zerofill(total2, fftlen);
-  zerofill(total, fftlen);
-  for (i = 0; i < sum; i++)
+  /* wait for the next sum of transforms */
+  if ((total = spec_next(&sp)) == NULL)
     {
-      /* initialize fft array to zero */
-      zerofill(fftinbuf1, 2 * fftlen);
-      zerofill(fftinbuf2, 2 * fftlen);
-      
-      /* read one data buffer       */
-      if (bufsize != read(fdinput1, buffer1, bufsize))
-	{
-	  fprintf(stderr,"Read error or EOF.\n");
-	  if (timeseries) fprintf(stderr,"Wrote %d transforms\n",counter);
-	  exit(1);
-	}
-      if (bufsize != read(fdinput2, buffer2, bufsize))
+      fprintf(stderr,"Read error or EOF.\n");
+      if (sp.timeseries) fprintf(stderr,"Wrote %d transforms\n",counter);
+      if (sp.timeseries && sp.skthresh != 0)
+	fprintf(stderr,"Flagged %lld of %lld bins\n",nflagged,(long long) counter * sp.fftlen);
+      if (fpflags) fclose(fpflags);
+      if (hdf5 != UNDEFINED)
 	{
-	  fprintf(stderr,"Read error or EOF.\n");
-	  if (timeseries) fprintf(stderr,"Wrote %d transforms\n",counter);
-	  exit(1);
-	}
-
-      /* unpack */
-      switch (mode)
-	{
-	case 1:
-	  unpack_pfs_2c2b(buffer1, rcp, bufsize);
-	  unpack_pfs_2c2b(buffer2, lcp, bufsize);
-	  break;
-	case 2: 
-	  unpack_pfs_2c4b(buffer1, rcp, bufsize);
-	  unpack_pfs_2c4b(buffer2, lcp, bufsize);
-	  break;
-	case 3: 
-	  unpack_pfs_2c8b(buffer1, rcp, bufsize);
-	  unpack_pfs_2c8b(buffer2, lcp, bufsize);
-	  break;
-	case 5:
-	  unpack_pfs_4c2b_rcp (buffer1, rcp, bufsize);
-	  unpack_pfs_4c2b_lcp (buffer2, lcp, bufsize);
-	  break;
-	case 6: 
-	  unpack_pfs_4c4b_rcp (buffer1, rcp, bufsize);
-	  unpack_pfs_4c4b_lcp (buffer2, lcp, bufsize);
-	  break;
-     	case 8: 
-	  memcpy (rcp, buffer1, bufsize);
-	  memcpy (lcp, buffer2, bufsize);
-	  break;
-	case 16: 
-	  for (i = 0, j = 0; i < bufsize; i+=sizeof(short), j++)
-	    {
-	      memcpy(&x,&buffer1[i],sizeof(short));
-	      fftinbuf1[j] = (float) x;
-	      memcpy(&x,&buffer2[i],sizeof(short));
-	      fftinbuf2[j] = (float) x;
-	    }
-	  break;
-     	case 32: 
-	  memcpy(fftinbuf1,buffer1,bufsize);
-	  memcpy(fftinbuf2,buffer2,bufsize);
-	  break;
-	default: 
-	  fprintf(stderr,"Mode not implemented yet\n");
-	  exit(-1);
-	}
-
-      /* downsample */
-      if (mode != 16 && mode != 32)
-	for (k = 0, l = 0; k < 2*fftlen; k += 2, l += 2*downsample)
-	  {
-	    for (j = 0; j < 2*downsample; j+=2)
-	      {
-		fftinbuf1[k]   += (float) rcp[l+j];
-		fftinbuf1[k+1] += (float) rcp[l+j+1];
-		fftinbuf2[k]   += (float) lcp[l+j];
-		fftinbuf2[k+1] += (float) lcp[l+j+1];
-	      }
-	  }
-
-      /* transform, swap, and compute power */
-      if (invert) swap_iandq(fftinbuf1,fftlen);
-      if (invert) swap_iandq(fftinbuf2,fftlen);
-      if (hanning) vector_window(fftinbuf1,fftlen);
-      if (hanning) vector_window(fftinbuf2,fftlen);
-      fftwf_execute(p1);
-      fftwf_execute(p2);
-      if (swap) swap_freq(fftoutbuf1,fftlen);
-      if (swap) swap_freq(fftoutbuf2,fftlen);
-      vector_power(fftoutbuf1,fftlen);
-      vector_power(fftoutbuf2,fftlen);
-      
-      /* sum transforms */
-      for (j = 0; j < fftlen; j++)
-	{
-	  total1[j] += fftoutbuf1[j];
-	  total2[j] += fftoutbuf2[j];
+	  if (h5n)
+	    writeFloatLinesToHDF5(dataset_id, h5rows, counter - h5n, h5n, sp.nspec, sp.fftlen);
+	  H5Dclose(dataset_id);
 	}
+      exit(1);
     }
-  
-  /* set DC to average of neighboring values  */
-  total1[fftlen/2] = (total1[fftlen/2-1]+total1[fftlen/2+1]) / 2.0;
-  total2[fftlen/2] = (total2[fftlen/2-1]+total2[fftlen/2+1]) / 2.0;
-
-  /* sum powers */
-  for (j = 0; j < fftlen; j++)
-    total[j] = total1[j] + total2[j];
 
-  /* apply Chebyshev to detected power if needed */
-  if (degree) chebyshev_window(total,fftlen,chebcoeff,degree);
-  
-  /* compute rms if needed */
-  mean = 0;
-  sigma = 1;
-  if (rmsmin != 0 || rmsmax != 0)
+  /* the -K flags of this output */
+  if (sp.skthresh != 0)
     {
-      /* identify relevant indices for rms power computation */
-      imin = fftlen/2 + rmsmin/freqres;
-      imax = fftlen/2 + rmsmax/freqres;
-      mean1 = var1 = 0;
-      n1 = 0;
-      for (i = imin; i < imax; i++)
-	{
-	  mean1 += total[i];
-	  var1  += total[i] * total[i];
-	  n1++;
-	}
-      mean1  = mean1 / n1;
-      var1   = var1 / n1;
-      sigma1 = sqrt(var1 - mean1 * mean1);
-
-      /* now redo calculation but exclude 3-sigma outliers */
-      mean = var = 0;
-      n = 0;
-      for (i = imin; i < imax; i++)
-	{
-	  if (fabs((total[i] - mean1)/sigma1) > 3.5)
-	    continue;
-	  mean += total[i];
-	  var  += total[i] * total[i];
-	  n++;
-	}
-      mean  = mean / n;
-      var   = var / n;
-      sigma = sqrt(var - mean * mean);
-      /*
-      fprintf(stderr,"Computed mean,sigma with    %d outliers : %e +/- %e s\n",(n1-n),mean1,sigma1);
-      fprintf(stderr,"Computed mean,sigma without %d outliers : %e +/- %e s\n",(n1-n),mean,sigma);
-      */
+      nflagged += sp.nflagged;
+      if (fpflags && sp.flagbytes != fwrite(sp.flags,1,sp.flagbytes,fpflags))
+	fprintf(stderr,"Write error\n");
+      if (fpflags) fflush(fpflags);
+      if (!sp.timeseries)
+	fprintf(stderr,"Flagged %d of %d bins\n",sp.nflagged,sp.fftlen);
     }
-  
+
   /* write output */
-  /* either time series */
-  if (timeseries)
+  /* either time series, the nspec spectra one after the other */
+  if (sp.timeseries)
     {
-      for (i = 0; i < fftlen; i++) total[i] = (total[i]-mean)/sigma;
       if (hdf5 == UNDEFINED)
 	{
-	  if (fftlen != fwrite(total,sizeof(float),fftlen,fpoutput))
+	  if (sp.nspec * sp.fftlen != fwrite(total,sizeof(float),sp.nspec * sp.fftlen,fpoutput))
 	    fprintf(stderr,"Write error\n");
 	  fflush(fpoutput);
 	}
       else
 	{
-	  if (counter < fftout)
-	    writeFloatLineToHDF5(dataset_id, total, counter, fftlen);
+	  memcpy(&h5rows[h5n * rowlen], total, rowlen * sizeof(float));
+	  if (++h5n == h5batch)
+	    {
+	      writeFloatLinesToHDF5(dataset_id, h5rows, counter + 1 - h5n, h5n, sp.nspec, sp.fftlen);
+	      h5n = 0;
+	    }
 	}
       counter++;
+      spec_done(&sp,total);
       goto loop;
     }
-  /* or standard output */
+  /* or a single HDF5 row */
+  else if (hdf5 != UNDEFINED)
+    {
+      if (dB)
+	for (i = 0; i < (int) rowlen; i++)
+	  total[i] = 10*log10(total[i]);
+      writeFloatLinesToHDF5(dataset_id, total, 0, 1, sp.nspec, sp.fftlen);
+    }
+  /* or standard output, one value per spectrum */
   /* or limited frequency range */
   else
-    for (i = 0; i < fftlen; i++)
+    for (i = 0; i < sp.fftlen; i++)
       {
-	  freq = (i-fftlen/2)*freqres;
-    
-	  if ((freqmin == 0.0 && freqmax == 0.0) || (freq >= freqmin && freq <= freqmax)) 
+	  freq = spec_freq(&sp,i);
+
+	  if ((sp.freqmin == 0.0 && sp.freqmax == 0.0) || (freq >= sp.freqmin && freq <= sp.freqmax))
 	  {
-	    value = (total[i]-mean)/sigma;
-	    if (dB) value = 10*log10(value);
-
-	    if (binary)
-	      if (hdf5 == UNDEFINED)
-		fwrite(&value,sizeof(float),1,fpoutput);
-	      else
-		/* writeFloatValueToHDF5(dataset_id, &value); */
-		fprintf(stderr, "Writing a single transform to HDF5 is not implemented yet.  Try with -t -n 1.\n");
-	    else
-	      fprintf(fpoutput,"% .3f % .3e\n",freq,value);
+	    if (!binary)
+	      fprintf(fpoutput,"% .3f",freq);
+	    for (k = 0; k < sp.nspec; k++)
+	      {
+		value = total[k * sp.fftlen + i];
+		if (dB) value = 10*log10(value);
+
+		if (binary)
+		  fwrite(&value,sizeof(float),1,fpoutput);
+		else
+		  fprintf(fpoutput," % .3e",value);
+	      }
+	    if (!binary)
+	      fprintf(fpoutput,"\n");
 	  }
       }
 
   /* close files */
+  if (fpflags) fclose(fpflags);
   if (hdf5 == UNDEFINED)
     {
       fclose(fpoutput);
     }
   else
-    {
-      H5Dclose(dataset_id);
-      H5Fclose(H5Iget_file_id(dataset_id));
-    }
-  
-  fftwf_destroy_plan(p1);
-  fftwf_destroy_plan(p2);
-  free(fftinbuf1);
-  free(fftoutbuf1);
-  free(fftinbuf2);
-  free(fftoutbuf2);
-  
+    H5Dclose(dataset_id);	/* and the file, see createHDF5File */
+
+  spec_finish(&sp);
+
   return 0;
 }
 
 /******************************************************************************/
-/*	writeFloatLineToHDF5						      */
+/*	writeFloatLinesToHDF5						      */
 /******************************************************************************/
-void writeFloatLineToHDF5(hid_t dataset_id, const float* line_data, size_t current_row, size_t cols)
+void writeFloatLinesToHDF5(hid_t dataset_id, const float* data, size_t first_row, size_t nrows, size_t nifs, size_t cols)
 {
   hid_t dataspace_id, memspace_id;
   herr_t status;
 
+  // Grow the dataset to hold the new rows
+  hsize_t dims[3] = {first_row + nrows, nifs, cols};
+  status = H5Dset_extent(dataset_id, dims);
+  if (status < 0)
+    {
+      fprintf(stderr,"HDF5 set extent failed with error code %d\n", status);
+      exit(1);
+    }
+
   // Get the dataspace for the dataset
   dataspace_id = H5Dget_space(dataset_id);
 
-  // Select the hyperslab for the new line
-  hsize_t offset[3] = {current_row, 0, 0};
-  hsize_t count[3] = {1, 1, cols};
+  // Select the hyperslab for the new rows
+  hsize_t offset[3] = {first_row, 0, 0};
+  hsize_t count[3] = {nrows, nifs, cols};
   status = H5Sselect_hyperslab(dataspace_id, H5S_SELECT_SET, offset, NULL, count, NULL);
   if (status < 0)
     {
@@ -534,12 +370,11 @@ void writeFloatLineToHDF5(hid_t dataset_id, const float* line_data, size_t curre
       exit(1);
     }
 
-  // Create the memory dataspace for the line of data
-  hsize_t mem_dims[3] = {1, 1, cols};
-  memspace_id = H5Screate_simple(3, mem_dims, NULL);
+  // Create the memory dataspace for the rows
+  memspace_id = H5Screate_simple(3, count, NULL);
 
-  // Write the line data to the dataset
-  status = H5Dwrite(dataset_id, H5T_NATIVE_FLOAT, memspace_id, dataspace_id, H5P_DEFAULT, line_data);
+  // Write the rows to the dataset
+  status = H5Dwrite(dataset_id, H5T_NATIVE_FLOAT, memspace_id, dataspace_id, H5P_DEFAULT, data);
   if (status < 0)
     {
       fprintf(stderr,"HDF5 write failed with error code %d\n", status);
@@ -547,6 +382,7 @@ void writeFloatLineToHDF5(hid_t dataset_id, const float* line_data, size_t curre
     }
 
   // Close resources
+  H5Sclose(memspace_id);
   H5Sclose(dataspace_id);
 }
 
@@ -554,23 +390,57 @@ void writeFloatLineToHDF5(hid_t dataset_id, const float* line_data, size_t curre
 /*	createHDF5File							      */
 /******************************************************************************/
 /* The structure and attributes of this HDF5 file are odd.
-   They are meant to replicate Breakthrough Listen dynamic spectra. */
-hid_t createHDF5File(const char* filename, size_t rows, size_t cols, double tsum, double freqres, double fch1)
+   They are meant to replicate Breakthrough Listen dynamic spectra.
+   The dataset starts with no rows and grows as they are written; batch
+   is set to the rows per chunk, which the caller writes at a time. */
+hid_t createHDF5File(const char* filename, size_t nifs, size_t cols, double tsum, double freqres, double fch1, int deflate, int *batch)
 {
-  hid_t file_id, dataspace_id, dataset_id, attribute_id, attribute_type_id;
-    int status;
+  hid_t file_id, dataspace_id, dataset_id, attribute_id, attribute_type_id, plist_id;
+    size_t rows, chunkcols;
 
     // Create a new HDF5 file
     file_id = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file_id < 0)
+      {
+	fprintf(stderr,"Cannot create HDF5 file %s\n", filename);
+	exit(1);
+      }
 
-    // Create the dataspace for the dataset
+    // Create the dataspace for the dataset, unlimited in time
     int rank = 3;
-    hsize_t dims[3] = {rows, 1, cols};
-    dataspace_id = H5Screate_simple(rank, dims, NULL);
+    hsize_t dims[3] = {0, nifs, cols};
+    hsize_t maxdims[3] = {H5S_UNLIMITED, nifs, cols};
+    dataspace_id = H5Screate_simple(rank, dims, maxdims);
+
+    // Chunks of HDF5ROWS rows or fewer, one feed and about HDF5CHUNK bytes
+    rows = HDF5BUF / (nifs * cols * sizeof(float));
+    if (rows > HDF5ROWS) rows = HDF5ROWS;
+    if (rows < 1) rows = 1;
+    chunkcols = HDF5CHUNK / (rows * sizeof(float));
+    if (chunkcols > cols) chunkcols = cols;
+    if (chunkcols < 1) chunkcols = 1;
+    hsize_t chunk[3] = {rows, 1, chunkcols};
+    plist_id = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(plist_id, rank, chunk);
+    if (deflate > 0 && H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0)
+      {
+	H5Pset_shuffle(plist_id);
+	H5Pset_deflate(plist_id, deflate);
+      }
+    else if (deflate > 0)
+      fprintf(stderr,"HDF5 deflate filter not available, writing uncompressed\n");
+    *batch = rows;
 
     // Create the dataset
     dataset_id = H5Dcreate2(file_id, "/data", H5T_NATIVE_FLOAT, dataspace_id,
-			    H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+			    H5P_DEFAULT, plist_id, H5P_DEFAULT);
+    if (dataset_id < 0)
+      {
+	fprintf(stderr,"Cannot create HDF5 dataset in %s\n", filename);
+	exit(1);
+      }
+    H5Pclose(plist_id);
+    H5Sclose(dataspace_id);
 
     // Create a scalar dataspace for the attributes
     dataspace_id = H5Screate(H5S_SCALAR);
@@ -666,7 +536,7 @@ hid_t createHDF5File(const char* filename, size_t rows, size_t cols, double tsum
                               dataspace_id, H5P_DEFAULT, H5P_DEFAULT);
 
     // Write the "nifs" attribute value
-    int64_t nifs_attribute_value = 1;
+    int64_t nifs_attribute_value = nifs;
     H5Awrite(attribute_id, attribute_type_id, &nifs_attribute_value);
 
     // Close the "nifs" attribute resources
@@ -766,88 +636,20 @@ hid_t createHDF5File(const char* filename, size_t rows, size_t cols, double tsum
     H5Sclose(dataspace_id);
     H5Tclose(attribute_type_id);
 
-    return dataset_id;
-}
-
-/******************************************************************************/
-/*	vector_window							      */
-/******************************************************************************/
-void vector_window(float *data, int len)
-{
-  /* Hanning windows the data array of length 'len' (complex samples)
-  */
-  float  weight;		/* calculated weight */
-  double n_minus_1;		/* weight calculation scale */
-  int    i,j,k;
-
-  n_minus_1 = 1.0/(double)(len - 1);
-
-  for (i=0, j=0, k=1; i<len; i++, j+=2, k+=2)
-  {
-    weight = (float)(0.5 - 0.5 * cos( 2 * M_PI * (double)i * n_minus_1 ) );
-    data[j] *= weight;
-    data[k] *= weight;
-  }
-  return;
-}
-
-/******************************************************************************/
-/*	chebyshev_window						      */
-/******************************************************************************/
-void chebyshev_window(float *data, int len, double *chebcoeff, int degree)
-{
-  /* Applies Chebyshev window the data array of length 'len' (floating point samples)
-  */
-  double x;
-  double weight;		/* calculated weight */
-  int    i;
+    // The file stays open until the dataset is closed
+    H5Fclose(file_id);
 
-  for (i=0; i<len; i++)
-  {
-    x = -0.5 + (double) i / (double) len;
-    weight = chebeval(x, chebcoeff, degree);
-    data[i] /= weight;
-    /* fprintf(stderr,"%lf %lf %lf\n",weight,data[i],data[i]/weight); */
-  }
-  return;
-}
-
-/******************************************************************************/
-/*	chebeval							      */
-/******************************************************************************/
-double chebeval(double x, double c[], int degree)
-{
-  /* 
-     Evaluate a Chebyshev series at points x.
-     Expects an array `c` of length at least degree + 1 = n + 1
-     This function returns the value:
-     p(x) = c_0 * T_0(x) + c_1 * T_1(x) + ... + c_n * T_n(x)
-  */
-  double x2;
-  double c0, c1;
-  double tmp;
-  int i;
-  
-  x2 = 2*x;
-  c0 = c[degree-1];
-  c1 = c[degree];
-  for (i = 2; i <= degree; i++)    
-    {
-      tmp = c0;
-      c0 = c[degree-i] - c1;
-      c1 = tmp + c1*x2;
-    }
-  return c0 + c1*x;
+    return dataset_id;
 }
 
 /******************************************************************************/
 /*	processargs							      */
 /******************************************************************************/
-void	processargs(argc,argv,infile1,infile2,outfile,mode,fsamp,freqres,downsample,sum,binary,timeseries,chan,freqmin,freqmax,rmsmin,rmsmax,dB,invert,hanning,hdf5,chebfile,nskipseconds)
+void	processargs(argc,argv,ninfiles,infiles,outfile,mode,fsamp,freqres,downsample,sum,binary,timeseries,chan,freqmin,freqmax,rmsmin,rmsmax,dB,invert,hanning,hdf5,deflate,chebfile,nskipseconds,effort,pfbtaps,pfbwindow,fastlen,combine,nthreads,skthresh,skzero,membudget,scratchdir)
 int	argc;
 char	**argv;			 /* command line arguements */
-char	**infile1;		 /* input file name 1 */
-char	**infile2;		 /* input file name 2 */
+int	*ninfiles;		 /* number of input files */
+char	***infiles;		 /* input file names */
 char	**outfile;		 /* output file name */
 int     *mode;
 double   *fsamp;
@@ -865,13 +667,24 @@ int     *dB;
 int     *invert;
 int     *hanning;
 double  *hdf5;
+int     *deflate;
 char    **chebfile;
 float     *nskipseconds;
+unsigned int *effort;
+int     *pfbtaps;
+char    *pfbwindow;
+int     *fastlen;
+int     *combine;
+int     *nthreads;
+float   *skthresh;
+int     *skzero;
+float   *membudget;
+char   **scratchdir;
 {
   /* function to process a programs input command line.
      This is a template which has been customised for the pfs_fft program:
 	- the outfile name is set from the -o option
-	- the infile name is set from the 1st unoptioned argument
+	- the infile names are the unoptioned arguments, at least two
   */
 
   int getopt();		/* c lib function returns next opt*/
@@ -879,16 +692,15 @@ float     *nskipseconds;
   extern int optind;	/* after call, ind into argv for next*/
   extern int opterr;    /* if 0, getopt won't output err mesg*/
 
-  char *myoptions = "m:f:d:r:n:tc:h:o:lbx:s:iHC:S:"; /* options to search for :=> argument*/
-  char *USAGE1="pfs_fft_2 -m mode -f sampling frequency (MHz) [-r desired frequency resolution (Hz)] [-d downsampling factor] [-n sum n transforms] [-l (dB output)] [-b (binary output)] [-t time series] [-x freqmin,freqmax (Hz)] [-s scale to sigmas using smin,smax (Hz)] [-c channel (1 or 2)] [-i swap IQ before transform (invert freq axis)] [-H apply Hanning window before transform] [-C file of Chebyshev polynomial coefficients defining window to apply after transform] [-S number of seconds to skip before applying first FFT] [-h fch1, write output in HDF5 format with starting frequency fch1 (MHz)] [-o outfile] infile1 infile2";
+  char *myoptions = "m:f:d:r:n:tc:h:Z:o:lbx:s:iHC:S:P:B:L:j:k:K:M:"; /* options to search for :=> argument*/
+  char *USAGE1="pfs_fft_2 -m mode -f sampling frequency (MHz) [-r desired frequency resolution (Hz)] [-d downsampling factor] [-n sum n transforms] [-l (dB output)] [-b (binary output)] [-t time series] [-x freqmin,freqmax (Hz)] [-s scale to sigmas using smin,smax (Hz)] [-c channel (1 or 2)] [-i swap IQ before transform (invert freq axis)] [-H apply Hanning window before transform] [-C file of Chebyshev polynomial coefficients defining window to apply after transform] [-S number of seconds to skip before applying first FFT] [-h fch1, write output in HDF5 format with starting frequency fch1 (MHz)] [-Z level, shuffle and deflate HDF5 output] [-P estimate|measure|patient|exhaustive] [-B taps[,window] polyphase filterbank] [-L res|pad fast FFT length] [-j threads] [-k sum|separate|cross] [-K sigmas[,zero] spectral kurtosis flagging] [-M megabytes[,scratch dir] memory budget] [-o outfile] infile1[:mode[:chan[:skip]]] infile2 [...]";
   char *USAGE2="Valid modes are\n\t 0: 2c1b (N/A)\n\t 1: 2c2b\n\t 2: 2c4b\n\t 3: 2c8b\n\t 4: 4c1b (N/A)\n\t 5: 4c2b\n\t 6: 4c4b\n\t 7: 4c8b (N/A)\n\t 8: signed bytes\n\t16: signed 16bit\n\t32: 32bit floats\n";
   int  c;			 /* option letter returned by getopt  */
   int  arg_count = 1;		 /* optioned argument count */
 
   /* default parameters */
   opterr = 0;			 /* turn off there message */
-  *infile1  = "-";		 /* initialise to stdin, stdout */
-  *infile2  = "-";		 /* initialise to stdin, stdout */
+  *ninfiles = 0;		 /* initialise to stdout */
   *outfile = "-";
 
   *mode  = 0;                /* default value */
@@ -903,18 +715,87 @@ float     *nskipseconds;
   *invert = 0;
   *hanning = 0;
   *hdf5 = UNDEFINED;
+  *deflate = 0;
   *chebfile = "-";
   *nskipseconds = 0;    /* default is process entire file */
   *freqmin = 0;		/* not set value */
   *freqmax = 0;		/* not set value */
   *rmsmin  = 0;		/* not set value */
   *rmsmax  = 0;		/* not set value */
+  *effort = FFTW_ESTIMATE;
+  *pfbtaps = 0;
+  *fastlen = FFT_EXACT;
+  *combine = SPEC_SUM;
+  *skthresh = 0;		/* no flagging */
+  *skzero = 0;
+  *membudget = 0;	/* half the memory */
+  *scratchdir = NULL;
+  *nthreads = 0;		/* one per input */
 
   /* loop over all the options in list */
   while ((c = getopt(argc,argv,myoptions)) != -1)
   { 
     switch (c) 
       {
+      case 'P':
+	if (fft_effort(optarg,effort) < 0)
+	  {
+	    fprintf(stderr,"Unknown planner effort %s\n",optarg);
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'B':
+	if (pfb_parse(optarg,pfbtaps,pfbwindow) < 0)
+	  {
+	    fprintf(stderr,"Bad filterbank taps or window %s\n",optarg);
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'L':
+	if (fft_lenmode(optarg,fastlen) < 0)
+	  {
+	    fprintf(stderr,"-L must be res or pad\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'j':
+	sscanf(optarg,"%d",nthreads);
+	arg_count += 2;
+	break;
+
+      case 'k':
+	if (spec_combine(optarg,combine) < 0)
+	  {
+	    fprintf(stderr,"-k must be sum, separate or cross\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'K':
+	if (spec_sk(optarg,skthresh,skzero) < 0)
+	  {
+	    fprintf(stderr,"-K must be sigmas or sigmas,zero\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
+      case 'M':
+	if (spec_budget(optarg,membudget,scratchdir) < 0)
+	  {
+	    fprintf(stderr,"-M must be megabytes or megabytes,directory\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
       case 'o':
 	*outfile = optarg;	/* output file name */
 	arg_count += 2;		/* two command line arguments */
@@ -976,6 +857,15 @@ float     *nskipseconds;
 	arg_count += 2;
 	break;
 
+      case 'Z':
+	if (sscanf(optarg,"%d",deflate) != 1 || *deflate < 1 || *deflate > 9)
+	  {
+	    fprintf(stderr,"-Z must be a deflate level from 1 to 9\n");
+	    goto errout;
+	  }
+	arg_count += 2;
+	break;
+
       case 'C':
  	*chebfile = optarg;	/* file name for Cheb coefficients */
  	arg_count += 2;		/* two command line arguments */
@@ -1025,20 +915,18 @@ float     *nskipseconds;
       }
   }
   
-  if (arg_count < argc)		 /* 1st non-optioned param is infile1 */
-    *infile1 = argv[arg_count];
-  arg_count += 1;
-
-  if (arg_count < argc)		 /* 2nd non-optioned param is infile2 */
-    *infile2 = argv[arg_count];
-  arg_count += 1;
-  
-  /* must specify a valid mode */
-  if (*mode == 0)
+  if (arg_count < argc)		 /* non-optioned params are infiles */
+    {
+      *ninfiles = argc - arg_count;
+      *infiles = &argv[arg_count];
+    }
+  if (*ninfiles < 2)
     {
-      fprintf(stderr,"Must specify sampling mode\n");
+      fprintf(stderr,"Must specify at least two input files\n");
       goto errout;
     }
+
+  /* the mode, here or after each infile, is checked by spec_setup */
   /* must specify a valid sampling frequency */
   if (*fsamp == 0) 
     {
@@ -1058,10 +946,35 @@ float     *nskipseconds;
       fprintf(stderr,"Cannot have -t and -x simultaneously yet\n");
       goto errout;
     }
-  if (*downsample > 1 && (*mode == 16 || *mode == 32)) 
+  if (*hdf5 != UNDEFINED && (*freqmin != 0 || *freqmax != 0))
     {
-      fprintf(stderr,"Cannot have -d with modes 16 or 32 yet\n");
-      exit (1);
+      fprintf(stderr,"Cannot have -h and -x simultaneously yet\n");
+      goto errout;
+    }
+  if (*deflate && *hdf5 == UNDEFINED)
+    {
+      fprintf(stderr,"Compression (-Z) requires HDF5 output (-h)\n");
+      goto errout;
+    }
+  if (*nthreads < 0)
+    {
+      fprintf(stderr,"Must have at least one thread\n");
+      goto errout;
+    }
+  if (*dB && *combine == SPEC_CROSS)
+    {
+      fprintf(stderr,"Cannot have -l with -k cross\n");
+      goto errout;
+    }
+  if (*fastlen == FFT_PAD && *pfbtaps)
+    {
+      fprintf(stderr,"Cannot have -L pad with -B\n");
+      goto errout;
+    }
+  if (*pfbtaps && *hanning)
+    {
+      fprintf(stderr,"Cannot have -B with -H\n");
+      goto errout;
     }
 
   return;
@@ -1095,32 +1008,6 @@ FILE    **fpoutput;		/* pointer to output file */
   return;
 }
 
-/******************************************************************************/
-/*	read cheb coeffs						      */
-/******************************************************************************/
-int     read_cheb_coeffs(char *chebfile, double *chebcoeff)
-{
-  int degree = 0;
-  FILE   *fpcheb;		/* pointer to file of Cheb coefficients */
-
-  /* open the Cheb coeff file */
-  fpcheb=fopen(chebfile,"r");
-  if (fpcheb == NULL)
-    {
-      perror("read_cheb_coeff: cheb coefficients file open error");
-      exit(1);
-    }
-
-  /* read coefficients */
-  while (fscanf(fpcheb, "%lf", &chebcoeff[degree++]) == 1)
-    continue;
-
-  degree = degree - 1; /* EOF does not count */
-  degree = degree - 1; /* number of coeffs = degree + 1 */
-
-  return degree;
-}
-
 /******************************************************************************/
 /*	copy_cmd_line    						      */
 /******************************************************************************/
@@ -1145,81 +1032,6 @@ char	command_line[];		/* command line parameters in single string */
   return;
 }	
 
-/******************************************************************************/
-/*	vector_power							      */
-/******************************************************************************/
-void vector_power(float *data, int len)
-{
-  /* detects the complex array data of len complex samples placing the
-     result in the bottom len samples of the input array
-  */
-
-  int i,j,k;
-
-  for (i=0, j=0, k=1; i<len; i++, j+=2, k+=2)
-    data[i] = data[j]*data[j] + data[k]*data[k];
-
-  return;
-}
-
-/******************************************************************************/
-/*	swap_freq							      */
-/******************************************************************************/
-void swap_freq(float *data, int len)
-{
-  /* swaps the location of the + and - frequencies for a continuous
-     spectrum, the data array is 2*len samples long
-  */
-  int i,j;
-  float temp;
-
-  for (i=0, j=len; i<len; i++, j++)
-    {
-      temp    = data[i];
-      data[i] = data[j];
-      data[j] = temp;
-    }
-
-  return;
-}
-
-/******************************************************************************/
-/*	swap_iandq							      */
-/******************************************************************************/
-void swap_iandq(float *data, int len)
-{
-  /* swaps the i and q components of each complex word to reverse the "phase"
-     direction, the data array is len complex samples long or 2*len samples long
-  */
-
-  int i,j;
-  float temp;
-
-  for (i=0, j=1; i < 2*len; i+=2, j+=2)
-    {
-      temp    = data[i];
-      data[i] = data[j];
-      data[j] = temp;
-    }
-
-  return;
-}
-
-/******************************************************************************/
-/*	zerofill							      */
-/******************************************************************************/
-void zerofill(float *data, int len)
-{
-  /* zero fills array of floats of size len */
-
-  int i;
-
-  for (i=0; i<len; i++)
-    data[i] = 0.0;
-
-  return;
-}
-
 /******************************************************************************/
 /*	no_comma_in_string						      */
 /******************************************************************************/
@@ -6,7 +6,7 @@
 *
 *  usage:
 *  	pfs_hist -m mode [-a (parse all data)] [-e (parse data at eof)] 
-*               [-o outfile] [infile]
+*               [-N (no result cache)] [-o outfile] [infile]
 *
 *  input:
 *       the input parameters are typed in as command line arguments
@@ -14,6 +14,12 @@
 *	the -e option specifies to parse data at the end of the file
 *	the -a option specifies to parse all the data recorded
 *                     (default is to parse the first megabyte)
+*	the -N option recomputes the histogram even if a run with the
+*		      same options on the same, unchanged file has been
+*		      kept in the result cache ($PFS_CACHE or ~/.pfs_cache,
+*		      at most $PFS_CACHE_MB megabytes)
+*	infile may also be the prefix of a recording set (data*.NNN)
+*			whose files are then read as one stream
 *
 *  output:
 *	the -o option identifies the output file, stdout is default
@@ -63,13 +69,15 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include "unpack.h"
+#include "multifile.h"
+#include "rcache.h"
 
 /* revision control variable */
 static char const rcsid[] = 
 "$Id: pfs_hist.c,v 3.4 2020/05/21 15:43:09 jlm Exp $";
 
 FILE   *fpoutput;		/* pointer to output file */
-int	fdinput;		/* file descriptor for input file */
+struct MULTIREAD *mfinput;	/* input file or recording set */
 
 char   *outfile;		/* output file name */
 char   *infile;		        /* input file name */
@@ -83,18 +91,20 @@ void copy_cmd_line();
 
 int main(int argc, char *argv[])
 {
-  struct stat filestat;	/* input file status structure */
   int mode;		/* data acquisition mode */
   int twoscmp = 0;	/* 2's complement (0 = FALSE)  */
   int bufsize = 1048576;/* size of read buffer, default 1 MB */
-  char *buffer;		/* buffer for packed data */
+  char *buffer;		/* packed data, mapped from the input */
+  long long offset;	/* stream offset of the next buffer */
   char *rcp,*lcp;	/* buffer for unpacked data */
   int smpwd;		/* # of single pol complex samples in a 4 byte word */
   int nsamples;		/* # of complex samples in each buffer */
   int levels;		/* # of levels for given quantization mode */
-  int open_flags;	/* flags required for open() call */
   int parse_all;
   int parse_end;
+  int nocache;
+  struct RCACHE rc;	/* result cache, see rcache.c */
+  char key[1024];	/* options and input identity */
   long long r_ihist[512], r_qhist[512];
   long long l_ihist[512], l_qhist[512];
   int i;
@@ -105,7 +115,7 @@ int main(int argc, char *argv[])
   }
 
   /* get the command line arguments and open the files */
-  processargs(argc,argv,&infile,&outfile,&mode,&twoscmp,&parse_all,&parse_end);
+  processargs(argc,argv,&infile,&outfile,&mode,&twoscmp,&parse_all,&parse_end,&nocache);
 
   /* save the command line */
   copy_cmd_line(argc,argv,command_line);
@@ -114,23 +124,15 @@ int main(int argc, char *argv[])
   open_file(outfile,&fpoutput);
 
   /* open file input */
-  open_flags = O_RDONLY;
-  if((fdinput = open(infile, open_flags)) < 0 )
+  if((mfinput = multi_ropen(infile, 0)) == NULL)
     {
       perror("open input file");
       exit(1);
     }
 
-  /* get file status */
-  if (fstat (fdinput, &filestat) < 0)
-    {
-      perror("input file status");
-      exit(1);
-    }
-  
   /* adjust buffer size if needed */
-  if (filestat.st_size < bufsize)
-    bufsize = filestat.st_size;
+  if (multi_size(mfinput) >= 0 && multi_size(mfinput) < bufsize)
+    bufsize = multi_size(mfinput);
 
   switch (mode)
     {
@@ -145,9 +147,15 @@ int main(int argc, char *argv[])
     default: fprintf(stderr,"Invalid mode\n"); exit(1);
     }
 
+  /* the same histogram of the same file may have been computed before */
+  memset(&rc, 0, sizeof(rc));
+  snprintf(key,sizeof(key),"m=%d 2=%d a=%d e=%d in=",mode,twoscmp,parse_all,parse_end);
+  if (!nocache && multi_ident(mfinput,key,sizeof(key)) == 0
+      && rc_open(&rc,"pfs_hist",key,fpoutput))
+    return 0;
+
   /* allocate storage */
   nsamples = bufsize * smpwd / 4;
-  buffer = (char *) malloc(bufsize);
   rcp = (char *) malloc(2 * nsamples * sizeof(char));
   lcp = (char *) malloc(2 * nsamples * sizeof(char));
   if (lcp == NULL) 
@@ -157,14 +165,16 @@ int main(int argc, char *argv[])
     }
 
   if (parse_end)
-    lseek(fdinput, -bufsize, SEEK_END);
+    multi_lseek(mfinput, -bufsize, SEEK_END);
+  offset = multi_lseek(mfinput, 0, SEEK_CUR);
 
-  /* read first buffer */
+  /* map first buffer */
   do {
-    if (bufsize != read(fdinput, buffer, bufsize)) {
+    if ((buffer = multi_map(mfinput, offset, bufsize)) == NULL) {
       fprintf(stderr,"Read error\n");
       break;
     }  
+    offset += bufsize;
 
     switch (mode) { 
       case 1:
@@ -296,6 +306,7 @@ int main(int argc, char *argv[])
       }
   }
 
+  rc_store(&rc);
   return 0;
 }
 
@@ -303,7 +314,7 @@ int main(int argc, char *argv[])
 /******************************************************************************/
 /*	processargs							      */
 /******************************************************************************/
-void	processargs(argc,argv,infile,outfile,mode,twoscmp,parse_all,parse_end)
+void	processargs(argc,argv,infile,outfile,mode,twoscmp,parse_all,parse_end,nocache)
 int	argc;
 char	**argv;			 /* command line arguements */
 char	**infile;		 /* input file name */
@@ -312,6 +323,7 @@ int     *mode;
 int     *twoscmp;
 int     *parse_all;
 int     *parse_end;
+int     *nocache;
 {
   /* function to process a programs input command line.
      This is a template which has been customised for the pfs_hist program:
@@ -324,8 +336,8 @@ int     *parse_end;
   extern int optind;	/* after call, ind into argv for next*/
   extern int opterr;    /* if 0, getopt won't output err mesg*/
 
-  char *myoptions = "m:o:ae2"; 	 /* options to search for :=> argument*/
-  char *USAGE1="pfs_hist -m mode [-2 (2's complement)] [-e (parse data at eof)] [-a (parse all data)] [-o outfile] [infile] ";
+  char *myoptions = "m:o:ae2N"; 	 /* options to search for :=> argument*/
+  char *USAGE1="pfs_hist -m mode [-2 (2's complement)] [-e (parse data at eof)] [-a (parse all data)] [-N (no result cache)] [-o outfile] [infile (or data*.NNN set prefix)] ";
   char *USAGE2="Valid modes are\n\t 0: 2c1b (N/A)\n\t 1: 2c2b\n\t 2: 2c4b\n\t 3: 2c8b\n\t 4: 4c1b (N/A)\n\t 5: 4c2b\n\t 6: 4c4b\n\t 7: 4c8b (N/A)\n";
   int  c;			 /* option letter returned by getopt  */
   int  arg_count = 1;		 /* optioned argument count */
@@ -339,6 +351,7 @@ int     *parse_end;
   *twoscmp  = 0;             /* default value */
   *parse_all = 0;
   *parse_end = 0;
+  *nocache = 0;
 
   /* loop over all the options in list */
   while ((c = getopt(argc,argv,myoptions)) != -1)
@@ -370,6 +383,11 @@ int     *parse_end;
                arg_count += 1;
 	       break;
 	    
+      case 'N':
+ 	       *nocache = 1;
+               arg_count += 1;
+	       break;
+	    
       case '?':			 /*if not in myoptions, getopt rets ? */
                goto errout;
                break;
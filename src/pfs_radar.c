@@ -10,6 +10,8 @@
 *       [-secs sec] [-step sec] [-cycles c] 
 *       [-files f] [-rings r] [-bytes b]
 *	[-log l] [-code len] [-comment "<msg>"]
+*       [-fsamp f] [-qlook k] [-qlchan n] [-qlsecs s] [-qlfile q]
+*       [-split] [-requant bits] [-nocrc] [-bench mult]
 *       -dir d [-dir d]... 
 *
 *  input:
@@ -94,27 +96,68 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sched.h>
+#include <errno.h>
 #include "fcntl.h"
 #include "edtinc.h"
 #include "multifile.h"
+#include "unpack.h"
+#include <fftw3.h>
 
 /* revision control variable */
 static char const rcsid[] = 
 "$Id$";
 
 void schedule_rt( int );
+float requant_step();
+void xform_write();
+double mode_rate();
+double wait_till_start();
+int quick_look_samples();
+void start_quick_look();
+void stop_quick_look();
+void quick_look_offer();
+void quick_look_write();
+int bench_disk();
+void remove_files();
 
 struct DISKWRITE { /* one of these for each diskbuffer allocated */
   struct MULTIFILE *fd;
+  struct MULTIFILE *fd2; /* LCP stream when polarizations are split */
   int tape_fd;
   int len;
   char *out;
+  char *xout[2]; /* split or requantized data, written instead of out */
+  int split;     /* write RCP and LCP to separate streams */
+  int requant;   /* bits per sample after requantization, 0 if none */
+  float *qstep;  /* requantization step, 0 until measured in a cycle */
+  double wsecs;  /* time taken by the last write */
+  pthread_t proc;
+};
+
+struct QUICKLOOK { /* low priority spectrometer fed with copies of ring buffers */
+  int every;     /* offer one ring buffer out of every this many */
+  int nchan;     /* transform length, complex samples */
+  int secs;      /* integration time between spectrum updates */
+  int mode;
+  int len;       /* size of buf in bytes */
+  double fsamp;  /* sampling frequency (MHz), used to label channels if known */
+  char file[256];
+  unsigned char *buf;
+  int busy;      /* buf holds data that the thread has not processed yet */
+  int quit;          /* busy, quit, taken and dropped are guarded by lock */
+  long long taken;
+  long long dropped;
+  long long missed;  /* dropped while the lock was held, main loop only */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
   pthread_t proc;
 };
 
 struct RADAR { /* structure that holds the buffers and configuration */
   EdtDev *edt;
   unsigned int mode;
+  double fsamp;  /* sampling frequency (MHz), 0 if not specified */
   int ameg;
   int secs;
   int step;
@@ -138,15 +181,24 @@ struct RADAR { /* structure that holds the buffers and configuration */
   char comment[200];
   FILE *logfd;
   int pack;
+  int split;     /* write RCP and LCP to separate streams */
+  int requant;   /* requantize 8-bit data to this many bits, 0 if none */
+  float qstep;   /* requantization step for the current cycle */
+  int nocrc;     /* don't keep block checksums */
+  long long nbufs; /* stop after this many buffers, 0 to stop on the clock */
+  struct QUICKLOOK *ql;  /* quick-look spectrometer if selected */
 } radar;
 
 #define SECS   9000		/* default number of seconds to take */
-#define NFILES 40		/* default number of files to open */
+#define NFILES 40		/* default limit on the number of files */
 #define LCODE 7812500		/* default code length to determine file size */
 #define LFFT 128		/* default fft length to determine file size */
 #define AMEG (1000*1000)	/* default size of edt ring buffer */
 #define RINGBUFS  64		/* default number of one meg edt ring buffers */
 #define AFEWSECS  3		/* interval bw key pressed and toggle EDT bit */
+#define ARMOFF  0.499		/* arm this far past the second before the start */
+#define QLCHAN 4096		/* default number of quick-look channels */
+#define QLSECS 5		/* default quick-look integration time */
 
 int ctlc_flag = 0;
 
@@ -168,6 +220,13 @@ int main(int argc, char *argv[])
   struct timezone tz;
   long long size;
   int fdlock;
+  int qlevery = 0;
+  int qlchan = QLCHAN;
+  int qlsecs = QLSECS;
+  char *qlfile = NULL;
+  double bench = 0;
+  double armed;
+  struct timespec tarm;
 
 #ifdef TIMER
   struct timeval   now;
@@ -216,7 +275,7 @@ int main(int argc, char *argv[])
       }
     } else if( strncasecmp( p, "-files", strlen(p) ) == 0 ) {
       p = argv[++i];
-      if((r->nfiles = atoi(p))<=0 ) {
+      if((r->nfiles = atoi(p))<0 ) {
         fprintf(stderr, "bad value for -files\n");
         pusage();
       }
@@ -283,6 +342,48 @@ int main(int argc, char *argv[])
     }  else if( strncasecmp( p, "-comment", strlen(p) ) == 0 ) {
       p = argv[++i];
       strcpy( r->comment, p);
+    }  else if( strncasecmp( p, "-fsamp", strlen(p) ) == 0 ) {
+      p = argv[++i];
+      if(( r->fsamp = atof(p))<=0 ) {
+        fprintf(stderr, "bad value for -fsamp\n");
+        pusage();
+      }
+    }  else if( strncasecmp( p, "-qlook", strlen(p) ) == 0 ) {
+      p = argv[++i];
+      if(( qlevery = atoi(p))<=0 ) {
+        fprintf(stderr, "bad value for -qlook\n");
+        pusage();
+      }
+    }  else if( strncasecmp( p, "-qlchan", strlen(p) ) == 0 ) {
+      p = argv[++i];
+      if(( qlchan = atoi(p))<=1 ) {
+        fprintf(stderr, "bad value for -qlchan\n");
+        pusage();
+      }
+    }  else if( strncasecmp( p, "-qlsecs", strlen(p) ) == 0 ) {
+      p = argv[++i];
+      if(( qlsecs = atoi(p))<=0 ) {
+        fprintf(stderr, "bad value for -qlsecs\n");
+        pusage();
+      }
+    }  else if( strncasecmp( p, "-qlfile", strlen(p) ) == 0 ) {
+      qlfile = argv[++i];
+    }  else if( strncasecmp( p, "-bench", strlen(p) ) == 0 ) {
+      p = argv[++i];
+      if(( bench = atof(p))<=0 ) {
+        fprintf(stderr, "bad value for -bench\n");
+        pusage();
+      }
+    }  else if( strncasecmp( p, "-nocrc", strlen(p) ) == 0 ) {
+      r->nocrc = 1;
+    }  else if( strncasecmp( p, "-split", strlen(p) ) == 0 ) {
+      r->split = 1;
+    }  else if( strncasecmp( p, "-requant", strlen(p) ) == 0 ) {
+      p = argv[++i];
+      if(( r->requant = atoi(p)) != 2 && r->requant != 4 ) {
+        fprintf(stderr, "bad value for -requant\n");
+        pusage();
+      }
     }  else {
       fprintf(stderr, "Invalid Option: [%s]\n", p);
       pusage();
@@ -318,6 +419,28 @@ int main(int argc, char *argv[])
       exit(1);
   }
 
+  /* writer-side transforms */
+  if( r->split && r->mode != 5 && r->mode != 6 ) {
+      fprintf(stderr,"-split requires a 4-channel mode (5 or 6)\n");
+      set_kb(0);
+      exit(1);
+  }
+  if( r->requant && r->mode != 3 ) {
+      fprintf(stderr,"-requant requires an 8-bit mode (3)\n");
+      set_kb(0);
+      exit(1);
+  }
+  if( (r->split || r->requant) && r->istape ) {
+      fprintf(stderr,"Can't have -split or -requant with tape\n");
+      set_kb(0);
+      exit(1);
+  }
+  if( (r->split || r->requant) && r->ameg % 16 ) {
+      fprintf(stderr,"-bytes must be a multiple of 16 with -split or -requant\n");
+      set_kb(0);
+      exit(1);
+  }
+
   if( r->ringbufs <=0 )
     r->ringbufs = RINGBUFS;
 
@@ -329,9 +452,32 @@ int main(int argc, char *argv[])
     pusage();
   }
   
+  if( bench > 0 && !(r->dir && r->fsamp > 0) ) {
+    fprintf(stderr, "-bench requires -dir and -fsamp\n");
+    pusage();
+  }
+
+  if( qlevery && quick_look_samples( r->mode, r->ameg, NULL ) == 0 ) {
+    fprintf(stderr, "-qlook supports modes 1, 2, 3, 5 and 6 only\n");
+    pusage();
+  }
+  if( qlevery && qlchan > quick_look_samples( r->mode, r->ameg, NULL )) {
+    fprintf(stderr, "-qlchan %d is more than the %d samples of one ring buffer\n",
+	    qlchan, quick_look_samples( r->mode, r->ameg, NULL ));
+    pusage();
+  }
+
+  /* with a known sampling rate, stop on the buffer count, not the clock */
+  if( r->fsamp > 0 )
+    r->nbufs = (long long) ceil( r->secs * mode_rate(r) / r->ameg );
+
   /* set scheduling priority */
   schedule_rt(2); 
 
+  /* qualify the disks instead of taking data */
+  if( bench > 0 )
+    exit( bench_disk( r, bench ));
+
   printf("Starting the Portable Fast Sampler\n");
 
   /* open edt device */
@@ -364,6 +510,10 @@ int main(int argc, char *argv[])
   /* open log file */
   open_log(r);
 
+  /* start quick-look spectrometer if requested */
+  if( qlevery )
+    start_quick_look( r, qlevery, qlchan, qlsecs, qlfile );
+
   /* compute starting time */
   if (time_set)
     {
@@ -408,13 +558,19 @@ int main(int argc, char *argv[])
       edt_start_buffers( r->edt, 0 );
       
       /* wait till .5 sec before expected pulse */
-      wait_till_start(r->startmone); 
+      armed = wait_till_start(r->startmone); 
       /* arm trigger */
       edt_reg_write( r->edt, PCD_FUNCT, 0x01 | (r->mode << 1));  
+      clock_gettime( CLOCK_REALTIME, &tarm );
 
       gettimeofday(&timenow,&tz);
       fprintf(r->logfd, "cclock after toggle        %ld.%06ld\n", 
 	      timenow.tv_sec, timenow.tv_usec);
+      fprintf(r->logfd, "arming offset %+.1f us (wake-up %+.1f us)\n",
+	      1e6*((tarm.tv_sec - r->startmone) + 1e-9*tarm.tv_nsec - ARMOFF),
+	      1e6*armed );
+      if( r->nbufs )
+        fprintf(r->logfd, "stopping after %lld buffers\n", r->nbufs );
       fflush(r->logfd);
 
 #ifdef TIMER
@@ -437,7 +593,10 @@ int main(int argc, char *argv[])
       for( i=0; ; i++ ) {
 	if( ctlc_flag )
 	  break;
-	if (time(NULL) >= r->stop)
+	if( r->nbufs ) {
+	  if( i >= r->nbufs )
+	    break;
+	} else if (time(NULL) >= r->stop)
 	  break;
  	if(!(data = edt_wait_for_buffers( r->edt, 1)))
 	  printf("error \n");
@@ -468,6 +627,10 @@ int main(int argc, char *argv[])
 #endif
 	    /* copy data from EDT to disk write output buffer */
 	    memcpy(&w->out[r->dw_count*r->ameg], data, r->ameg);
+
+	    /* offer a copy to the quick-look spectrometer, never waiting */
+	    if( r->ql && i % r->ql->every == 0 )
+	      quick_look_offer( r->ql, data, r->ameg );
             if( ++r->dw_count >= r->dw_multi ) {
               r->dw_count = 0;
 
@@ -527,7 +690,11 @@ int main(int argc, char *argv[])
     }
       
 
+  if( r->ql )
+    stop_quick_look(r);
+
   edt_close(r->edt);
+  multi_drain();
   fclose(r->logfd);
   set_kb(0);
   unlink("/tmp/pfs.lock");
@@ -542,17 +709,90 @@ struct DISKWRITE *w;
 {
   int writ;
   int k;
+  struct timeval t0, t1;
   
+  gettimeofday( &t0, NULL );
   if( w->tape_fd >= 0 )
     tape_write( w );
+  else if( w->split || w->requant )
+    xform_write( w );
   else {
     if((writ = multi_write( w->fd, w->out, w->len))!= w->len ) 
       printf(" disk write error: could only write %d bytes\n", writ );
   }
+  gettimeofday( &t1, NULL );
+  w->wsecs = (t1.tv_sec - t0.tv_sec) + 1e-6*(t1.tv_usec - t0.tv_usec);
     
   return(0);
 }
 
+/* 
+  split polarizations or requantize in the writer thread, then write
+  the smaller streams.  split 4c2b and 4c4b data are written in the
+  2c2b (mode 1) and 2c4b (mode 2) formats.
+*/
+
+void xform_write( w )
+struct DISKWRITE *w;
+{
+  unsigned char *out = (unsigned char *)w->out;
+  unsigned char *x0 = (unsigned char *)w->xout[0], *x1 = (unsigned char *)w->xout[1];
+  int writ, len;
+
+  if( w->split ) {
+    len = w->len/2;
+    if( radar.mode == 5 )
+      split_pfs_4c2b( out, x0, x1, w->len );
+    else
+      split_pfs_4c4b( out, x0, x1, w->len );
+    if((writ = multi_write( w->fd, w->xout[0], len))!= len ) 
+      printf(" disk write error: could only write %d RCP bytes\n", writ );
+    if((writ = multi_write( w->fd2, w->xout[1], len))!= len ) 
+      printf(" disk write error: could only write %d LCP bytes\n", writ );
+  } else {
+    if( *w->qstep == 0 )
+      *w->qstep = requant_step( out, w->len, w->requant );
+    len = w->len*w->requant/8;
+    if( w->requant == 4 )
+      requant_pfs_2c8b_2c4b( out, x0, w->len, *w->qstep );
+    else
+      requant_pfs_2c8b_2c2b( out, x0, w->len, *w->qstep );
+    if((writ = multi_write( w->fd, w->xout[0], len))!= len ) 
+      printf(" disk write error: could only write %d bytes\n", writ );
+  }
+}
+
+/*
+  requantization levels for gaussian noise: for 2 bits the optimal 
+  threshold is 0.98 rms, for 4 bits the optimal uniform step is 0.335 rms.
+  the rms is measured on every 64th byte of the first write buffer of a cycle.
+*/
+
+float requant_step( buf, len, bits )
+unsigned char *buf;
+int len;
+int bits;
+{
+  double s, ss, v, rms;
+  long n;
+  int i;
+
+  s = ss = 0;
+  n = 0;
+  for( i=0; i<len; i+=64, n++ ) {
+    v = buf[i] - 128.0;
+    s += v;
+    ss += v*v;
+  }
+  rms = sqrt( ss/n - (s/n)*(s/n) );
+  if( rms < 1 )
+    rms = 1;
+
+  if( bits == 4 )
+    return( 0.335*rms );
+  return( 0.98*rms );
+}
+
 tape_write(w)
 struct DISKWRITE *w;
 {
@@ -562,6 +802,266 @@ struct DISKWRITE *w;
       printf(" tape write error: could only write %d bytes\n", writ );
 }
 
+/*
+   Quick-look spectrometer.
+
+   The main loop offers a copy of one ring buffer out of every ql->every
+   buffers.  If the spectrometer thread is still busy with the previous
+   copy, or if the lock is held, the buffer is dropped: the EDT loop must
+   never wait on the spectrometer.  The thread runs at the lowest
+   scheduling priority, unpacks the buffer, sums the powers of as many
+   ql->nchan point transforms as fit in the buffer, and rewrites the
+   spectrum file every ql->secs seconds.
+*/
+
+/* complex samples per polarization in a buffer of len bytes, 0 for a
+   mode the spectrometer cannot unpack */
+
+int quick_look_samples( mode, len, npol )
+int mode;
+int len;
+int *npol;
+{
+  float smpwd;
+  int n = 1;
+
+  switch( mode ) {
+    case 1: smpwd = 8; break;
+    case 2: smpwd = 4; break;
+    case 3: smpwd = 2; break;
+    case 5: smpwd = 4; n = 2; break;
+    case 6: smpwd = 2; n = 2; break;
+    default: return(0);
+  }
+  if( npol )
+    *npol = n;
+  return( len * smpwd / 4 );
+}
+
+void start_quick_look( r, every, nchan, secs, file )
+struct RADAR *r;
+int every;
+int nchan;
+int secs;
+char *file;
+{
+  struct QUICKLOOK *q;
+  void *quick_look();
+
+  if( !(q = (struct QUICKLOOK *)malloc(sizeof(struct QUICKLOOK)))) {
+    fprintf(stderr, "bad malloc allocating quick-look\n");
+    set_kb(0);
+    exit(1);
+  }
+  bzero( q, sizeof(struct QUICKLOOK));
+  q->every = every;
+  q->nchan = nchan;
+  q->secs = secs;
+  q->mode = r->mode;
+  q->len = r->ameg;
+  q->fsamp = r->fsamp;
+  if( file )
+    strncpy( q->file, file, sizeof(q->file)-1 );
+  else
+    sprintf( q->file, "%s/quicklook.txt", r->dir );
+
+  if( !(q->buf = (unsigned char *)malloc( q->len ))) {
+    fprintf(stderr, "bad malloc allocating quick-look buffer\n");
+    set_kb(0);
+    exit(1);
+  }
+  pthread_mutex_init( &q->lock, NULL );
+  pthread_cond_init( &q->cond, NULL );
+  if( pthread_create( &q->proc, NULL, quick_look, q )) {
+    perror("pthread_create quick-look");
+    free( q->buf );
+    free( q );
+    return;
+  }
+  r->ql = q;
+
+  fprintf(r->logfd, "Quick-look spectrum, 1 of %d buffers, %d channels, every %d s, in %s\n",
+	  q->every, q->nchan, q->secs, q->file );
+  fflush(r->logfd);
+}
+
+void stop_quick_look( r )
+struct RADAR *r;
+{
+  struct QUICKLOOK *q = r->ql;
+
+  pthread_mutex_lock( &q->lock );
+  q->quit = 1;
+  pthread_cond_signal( &q->cond );
+  pthread_mutex_unlock( &q->lock );
+  if( pthread_join( q->proc, NULL ))
+    perror("pthread_join quick-look");
+
+  fprintf(r->logfd, "Quick-look buffers used %lld, dropped %lld\n",
+	  q->taken, q->dropped + q->missed );
+  fflush(r->logfd);
+  free( q->buf );
+  free( q );
+  r->ql = NULL;
+}
+
+/* called from the main loop: copy the buffer only if the thread is idle */
+
+void quick_look_offer( q, data, len )
+struct QUICKLOOK *q;
+unsigned char *data;
+int len;
+{
+  if( pthread_mutex_trylock( &q->lock )) {
+    q->missed++;
+    return;
+  }
+  q->dropped += q->missed;
+  q->missed = 0;
+  if( q->busy ) {
+    q->dropped++;
+    pthread_mutex_unlock( &q->lock );
+    return;
+  }
+  memcpy( q->buf, data, len );
+  q->busy = 1;
+  q->taken++;
+  pthread_cond_signal( &q->cond );
+  pthread_mutex_unlock( &q->lock );
+}
+
+/* quick-look thread */
+
+void *quick_look( q )
+struct QUICKLOOK *q;
+{
+  int nsamples, ntrans, npol, quit, n, k, l, c;
+  long long nsum;
+  char *pol[2];
+  fftwf_complex *in, *out;
+  double *total;
+  fftwf_plan p;
+  time_t last;
+
+#ifdef SCHED_IDLE
+  struct sched_param sp;
+
+  sp.sched_priority = 0;
+  if( pthread_setschedparam( pthread_self(), SCHED_IDLE, &sp ))
+    nice(19);
+#else
+  nice(19);
+#endif
+
+  /* mode and channels were checked with the arguments */
+  npol = 1;
+  nsamples = quick_look_samples( q->mode, q->len, &npol );
+  ntrans = nsamples / q->nchan;
+
+  pol[0] = (char *)malloc( 2*nsamples );
+  pol[1] = (char *)malloc( 2*nsamples );
+  in  = (fftwf_complex *)fftwf_malloc( q->nchan*sizeof(fftwf_complex));
+  out = (fftwf_complex *)fftwf_malloc( q->nchan*sizeof(fftwf_complex));
+  total = (double *)calloc( q->nchan, sizeof(double));
+  if( !pol[0] || !pol[1] || !in || !out || !total ) {
+    fprintf(stderr, "quick-look: bad malloc\n");
+    return(0);
+  }
+  p = fftwf_plan_dft_1d( q->nchan, in, out, FFTW_FORWARD, FFTW_ESTIMATE );
+
+  nsum = 0;
+  last = time(NULL);
+  for(;;) {
+    pthread_mutex_lock( &q->lock );
+    while( !q->busy && !q->quit )
+      pthread_cond_wait( &q->cond, &q->lock );
+    quit = q->quit;
+    pthread_mutex_unlock( &q->lock );
+    if( quit )
+      break;
+
+    switch( q->mode ) {
+      case 1: unpack_pfs_2c2b( q->buf, pol[0], q->len ); break;
+      case 2: unpack_pfs_2c4b( q->buf, pol[0], q->len ); break;
+      case 3: unpack_pfs_2c8b( q->buf, pol[0], q->len ); break;
+      case 5: unpack_pfs_4c2b_rcp( q->buf, pol[0], q->len );
+	      unpack_pfs_4c2b_lcp( q->buf, pol[1], q->len ); break;
+      case 6: unpack_pfs_4c4b_rcp( q->buf, pol[0], q->len );
+	      unpack_pfs_4c4b_lcp( q->buf, pol[1], q->len ); break;
+    }
+
+    /* the copy is unpacked, so the main loop may hand over the next one */
+    pthread_mutex_lock( &q->lock );
+    q->busy = 0;
+    pthread_mutex_unlock( &q->lock );
+
+    /* sum powers of both polarizations for dual pol modes */
+    for( c=0; c<npol; c++ )
+      for( n=0; n<ntrans; n++ ) {
+        for( k=0, l=2*n*q->nchan; k<q->nchan; k++, l+=2 ) {
+          in[k][0] = pol[c][l];
+          in[k][1] = pol[c][l+1];
+        }
+        fftwf_execute( p );
+        for( k=0; k<q->nchan; k++ ) {
+          l = (k + q->nchan - q->nchan/2) % q->nchan;
+          total[k] += out[l][0]*out[l][0] + out[l][1]*out[l][1];
+        }
+        nsum++;
+      }
+
+    if( time(NULL) - last >= q->secs ) {
+      quick_look_write( q, total, nsum );
+      bzero( total, q->nchan*sizeof(double));
+      nsum = 0;
+      last = time(NULL);
+    }
+  }
+  if( nsum )
+    quick_look_write( q, total, nsum );
+
+  fftwf_destroy_plan( p );
+  fftwf_free( in );
+  fftwf_free( out );
+  free( total );
+  free( pol[0] );
+  free( pol[1] );
+  return(0);
+}
+
+/* replace the spectrum file, readers never see a partial spectrum */
+
+void quick_look_write( q, total, nsum )
+struct QUICKLOOK *q;
+double *total;
+long long nsum;
+{
+  FILE *fp;
+  char tmp[264];
+  long long taken, dropped;
+  int k;
+
+  pthread_mutex_lock( &q->lock );
+  taken = q->taken;
+  dropped = q->dropped;
+  pthread_mutex_unlock( &q->lock );
+  sprintf( tmp, "%s.tmp", q->file );
+  if( (fp = fopen( tmp, "w" )) == NULL ) {
+    perror("quick-look file");
+    return;
+  }
+  fprintf( fp, "# pfs_radar quick-look, %d channels, %lld transforms, buffers used %lld dropped %lld\n",
+	   q->nchan, nsum, taken, dropped );
+  for( k=0; k<q->nchan; k++ )
+    if( q->fsamp > 0 )
+      fprintf( fp, "% .3f % .3e\n", (k - q->nchan/2) * q->fsamp * 1e6 / q->nchan, total[k]/nsum );
+    else
+      fprintf( fp, "%6d % .3e\n", k - q->nchan/2, total[k]/nsum );
+  fclose( fp );
+  if( rename( tmp, q->file ))
+    perror("quick-look rename");
+}
+
 #ifdef SOLARIS
 
 /* courtesy of Stuart Anderson, swiped right out of proc_ut.c */
@@ -639,6 +1139,20 @@ struct RADAR *r;
     if( mlock( w->out, aout*r->dw_multi ))
       perror("failed to mlock");
     w->len = r->ameg*r->dw_multi;
+
+    /* room for split or requantized data */
+    w->split = r->split;
+    w->requant = r->requant;
+    w->qstep = &r->qstep;
+    if( r->split || r->requant ) {
+      w->xout[0] = ( char * ) malloc( aout*r->dw_multi/2 );
+      w->xout[1] = ( char * ) malloc( aout*r->dw_multi/2 );
+      if( !w->xout[0] || !w->xout[1] ) {
+        fprintf(stderr, "bad malloc allocating buffer\n");
+        set_kb(0);
+        exit(1);
+      }
+    }
   }
 }
 
@@ -654,11 +1168,13 @@ struct RADAR *r;
   int i, tape_fd;
   struct DISKWRITE *w;
   char *tms;
-  struct MULTIFILE *fd;
+  struct MULTIFILE *fd, *fd2;
   char name[80];
 
   fd = NULL;
+  fd2 = NULL;
   tape_fd = -1;
+  r->qstep = 0;
 
   if( r->istape ) {
     if((tape_fd = open( r->istape, O_WRONLY, 0666 ))<0 ) {
@@ -670,18 +1186,35 @@ struct RADAR *r;
 
   } else {
 
-    sprintf(name, "%s/data%s", r->dir, r->timestr );
+    if( r->split )
+      sprintf(name, "%s/data%s.rcp", r->dir, r->timestr );
+    else
+      sprintf(name, "%s/data%s", r->dir, r->timestr );
 
     // SWJ 11/17/06 added O_EXCL flag to prevent accidently overriding the existing files
     if ((fd = multi_open(name, O_WRONLY|O_CREAT|O_EXCL, 0664, r->nfiles )) == NULL) {
       perror ("pfs_radar() multi_open() error");
       return (-1);
     }
+    if( !r->nocrc )
+      multi_crc(fd);
+
+    if( r->split ) {
+      sprintf(name, "%s/data%s.lcp", r->dir, r->timestr );
+      if ((fd2 = multi_open(name, O_WRONLY|O_CREAT|O_EXCL, 0664, r->nfiles )) == NULL) {
+        perror ("pfs_radar() multi_open() error");
+        multi_close(fd);
+        return (-1);
+      }
+      if( !r->nocrc )
+        multi_crc(fd2);
+    }
   }
 
   for( i=0; i< 2; i++ ) {
     w = &r->dw[i];
     w->fd = fd;
+    w->fd2 = fd2;
     w->tape_fd = tape_fd;
   }
 
@@ -701,8 +1234,214 @@ struct RADAR *r;
 
   w = &r->dw[0];
   multi_close(w->fd);
+  if( w->fd2 )
+    multi_close(w->fd2);
+  if( w->requant ) {
+    fprintf(r->logfd, "Requantized to %d bits with step %.2f counts\n",
+	    w->requant, r->qstep );
+    fflush(r->logfd);
+  }
+}
+
+
+/*
+  disk qualification: run the writer path (writer threads, write buffer
+  sizes, MULTIFILE, -split/-requant, checksums) for -secs seconds with
+  synthetic data delivered at mult times the rate of -m and -fsamp.
+  the main loop is paced like edt_wait_for_buffers, so time it spends
+  waiting for a slow writer shows up as lag.  the EDT ring absorbs lag
+  up to -rings buffers; more than that would have been an overrun.
+  the files are removed when done.
+*/
+
+int bench_disk( r, mult )
+struct RADAR *r;
+double mult;
+{
+  double rate, period, slack, lag, maxlag, elapsed, t, wsum, first;
+  double *lat;
+  long long nbufs, i, nover;
+  int k, nlat, maxlat;
+  unsigned char *syn;
+  unsigned int seed;
+  struct DISKWRITE *w, *wlast;
+  struct timespec t0, now, next;
+  int dblcmp();
+
+  rate = mult * mode_rate(r);               /* bytes per second */
+  period = r->ameg / rate;                  /* seconds per ring buffer */
+  slack = r->ringbufs * period;
+  nbufs = (long long)( r->secs / period );
+
+  /* incompressible synthetic data, one ring's worth */
+  if( !(syn = (unsigned char *)malloc( (size_t)r->ringbufs * r->ameg ))) {
+    fprintf(stderr, "bad malloc allocating synthetic data\n");
+    exit(1);
+  }
+  seed = 1;
+  for( i=0; i<(long long)r->ringbufs * r->ameg; i++ ) {
+    seed = seed * 1103515245 + 12345;
+    syn[i] = seed >> 16;
+  }
+
+  maxlat = nbufs/r->dw_multi + 2;
+  lat = (double *)malloc( maxlat * sizeof(double) );
+  r->logfd = stdout;
+  allocate_writebufs(r);
+  get_tms( time(NULL), r->timestr );
+  if( open_files(r) == -1 )
+    return(1);
+
+  printf("Disk qualification of %s\n", r->dir );
+  printf("%-31s: %.3f MB/s (%.2f x mode %d at %.3f MHz)\n", "Data rate",
+	 rate/1e6, mult, r->mode, r->fsamp );
+  printf("%-31s: %d s, %lld buffers of %d bytes\n", "Duration", r->secs, 
+	 nbufs, r->ameg );
+  printf("%-31s: %d bytes\n", "Write size", r->ameg*r->dw_multi );
+  printf("%-31s: %d buffers, %.3f s\n", "Ring slack", r->ringbufs, slack );
+  fflush(stdout);
+
+  w = &r->dw[0];
+  wlast = NULL;
+  nlat = 0;
+  maxlag = 0;
+  nover = 0;
+  first = 0;
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( i=0; i<nbufs; i++ ) {
+    /* wait for the next buffer to be "filled" */
+    t = (i+1) * period;
+    next.tv_sec = t0.tv_sec + (time_t)t;
+    next.tv_nsec = t0.tv_nsec + (long)((t - (time_t)t) * 1e9);
+    if( next.tv_nsec >= 1000000000 ) {
+      next.tv_sec++;
+      next.tv_nsec -= 1000000000;
+    }
+    clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL );
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    lag = (now.tv_sec - next.tv_sec) + 1e-9*(now.tv_nsec - next.tv_nsec);
+    if( lag > maxlag )
+      maxlag = lag;
+    if( lag > slack && nover++ == 0 )
+      first = t;
+
+    memcpy(&w->out[r->dw_count*r->ameg], &syn[(i % r->ringbufs)*r->ameg], r->ameg);
+    if( ++r->dw_count >= r->dw_multi ) {
+      r->dw_count = 0;
+      if( wlast && wlast->proc ) {
+        if(pthread_join( wlast->proc, NULL ))
+          perror("pthread_join");
+        lat[nlat++] = wlast->wsecs;
+      }
+      if( pthread_create( &w->proc, NULL, disk_write, w ))
+        perror("pthread_create");
+      wlast = w;
+      w = (w == &r->dw[0]) ? &r->dw[1] : &r->dw[0];
+    }
+    if( i % 50 == 0 )
+      fprintf(stderr, ".");
+  }
+  if( wlast && wlast->proc ) {
+    pthread_join( wlast->proc, NULL );
+    lat[nlat++] = wlast->wsecs;
+  }
+  if( r->dw_count > 0 ) {
+    w->len = r->dw_count*r->ameg;
+    disk_write( w );
+    lat[nlat++] = w->wsecs;
+    w->len = r->dw_multi*r->ameg;
+    r->dw_count = 0;
+  }
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  elapsed = (now.tv_sec - t0.tv_sec) + 1e-9*(now.tv_nsec - t0.tv_nsec);
+  close_files(r);
+  remove_files(r);
+
+  /* writer statistics */
+  wsum = 0;
+  for( k=0; k<nlat; k++ )
+    wsum += lat[k];
+  qsort( lat, nlat, sizeof(double), dblcmp );
+  printf("\n%-31s: %.3f MB/s\n", "Sustained throughput", 
+	 nbufs * r->ameg / elapsed / 1e6 );
+  if( nlat > 0 && wsum > 0 ) {
+    printf("%-31s: %.3f MB/s\n", "Writer throughput", 
+	   nbufs * r->ameg / wsum / 1e6 );
+    printf("%-31s: %.1f %.1f %.1f %.1f ms (block period %.1f ms)\n", 
+	   "Write latency 50/99/99.9/max",
+	   1e3*lat[(int)(0.5*(nlat-1))], 1e3*lat[(int)(0.99*(nlat-1))], 
+	   1e3*lat[(int)(0.999*(nlat-1))], 1e3*lat[nlat-1], 
+	   1e3*period*r->dw_multi );
+  }
+  printf("%-31s: %.3f s of %.3f s ring slack\n", "Worst lag", maxlag, slack );
+
+  if( nover > 0 )
+    printf("FAIL: ring would have overrun after %.1f s, %lld buffers late by more than the slack\n", 
+	   first, nover );
+  else if( maxlag > 0.5*slack )
+    printf("MARGINAL: worst lag used %.0f%% of the ring slack\n", 100*maxlag/slack );
+  else
+    printf("PASS: worst lag used %.0f%% of the ring slack\n", 100*maxlag/slack );
+
+  free(lat);
+  free(syn);
+  return( nover > 0 );
 }
 
+/*
+  data rate in bytes per second for the mode and -fsamp
+*/
+
+double mode_rate( r )
+struct RADAR *r;
+{
+  double bps;   /* bytes per complex sample */
+
+  switch( r->mode ) {
+    case 1: bps = 0.5; break;
+    case 2: bps = 1; break;
+    case 3: bps = 2; break;
+    case 5: bps = 1; break;
+    case 6: bps = 2; break;
+    case 7: bps = 4; break;
+    default: bps = 0; break;
+  }
+  return( r->fsamp * 1e6 * bps );
+}
+
+int dblcmp( a, b )
+double *a, *b;
+{
+  return( *a < *b ? -1 : *a > *b );
+}
+
+/*
+  remove the files of the current cycle, used after a disk qualification
+*/
+
+void remove_files(r)
+struct RADAR *r;
+{
+  char base[80], name[100];
+  char *suffix[3];
+  int i, n;
+
+  suffix[0] = "";
+  suffix[1] = ".rcp";
+  suffix[2] = ".lcp";
+  for( i=0; i<3; i++ ) {
+    sprintf( base, "%s/data%s%s", r->dir, r->timestr, suffix[i] );
+    for( n=0; ; n++ ) {
+      sprintf( name, "%s.%03d", base, n );
+      if( access( name, F_OK ) < 0 )
+        break;
+      multi_unlink( name );
+    }
+    sprintf( name, "%s.crc", base );
+    multi_unlink( name );
+  }
+  multi_drain();
+}
 
 /* build time string */
 
@@ -779,6 +1518,14 @@ struct RADAR *r;
   fprintf(r->logfd, "Write buffers, %d\n", r->ringbufs );
   fprintf(r->logfd, "Data taking mode, %d\n", r->mode );
   fprintf(r->logfd, "Operator comment: *** %s ***\n", r->comment );
+  if( r->split )
+    fprintf(r->logfd, "Polarizations written to .rcp and .lcp files, read with -m %d\n",
+	    r->mode == 5 ? 1 : 2 );
+  if( r->requant )
+    fprintf(r->logfd, "Data requantized to %d bits, read with -m %d\n",
+	    r->requant, r->requant == 4 ? 2 : 1 );
+  if( !r->nocrc && !r->istape )
+    fprintf(r->logfd, "CRC32C block checksums in .crc files, check with pfs_verify\n");
   fflush(r->logfd);
 }
 
@@ -844,7 +1591,9 @@ int makeraw;
    - A start time in seconds is computed by adding an offset of AFEWSECS
      to the current one second time from time(NULL); 
    - Then the files are opened, memory is allocated and log file prepared.
-   - wait till 0.5 seconds before the requested time using nanosleep
+   - wait till 0.5 seconds before the requested time using clock_nanosleep
+     on an absolute CLOCK_REALTIME time, then spin for the last part,
+     the spin being calibrated from the measured wake-up latency
    - Then enable data taking.
    - Then arm the trigger.
 
@@ -852,21 +1601,48 @@ int makeraw;
 
 /* wait till 0.501 sec before expected pulse */
 
-wait_till_start( ttt )
+double wait_till_start( ttt )
 time_t ttt;
 {
-  double delay;
-  struct timeval cur;
-  struct timespec nano;
-
-  gettimeofday( &cur, NULL );
-  delay =  (double)ttt - cur.tv_sec  - cur.tv_usec*1.0e-6 + 0.499;
-  nano.tv_sec = (int)delay;
-  nano.tv_nsec = (int)((delay - nano.tv_sec)*1.0e9);
-  
-/*  fprintf(stderr,"nano %d %d\n",nano.tv_sec,nano.tv_nsec); */
-  nanosleep( &nano, NULL ); 
+  static double spin = 0;
+  struct timespec target, wake, now;
+  double t, late;
+  int i;
+
+  /* calibrate once: spin for longer than the worst of a few wake-ups */
+  if( spin == 0 ) {
+    for( i=0; i<20; i++ ) {
+      clock_gettime( CLOCK_REALTIME, &target );
+      target.tv_nsec += 1000000;
+      if( target.tv_nsec >= 1000000000 ) {
+        target.tv_sec++;
+        target.tv_nsec -= 1000000000;
+      }
+      clock_nanosleep( CLOCK_REALTIME, TIMER_ABSTIME, &target, NULL );
+      clock_gettime( CLOCK_REALTIME, &now );
+      late = (now.tv_sec - target.tv_sec) + 1e-9*(now.tv_nsec - target.tv_nsec);
+      if( 3*late > spin )
+        spin = 3*late;
+    }
+    spin += 50e-6;
+    if( spin > 0.01 )
+      spin = 0.01;
+  }
 
+  /* sleep on the absolute time, then spin the rest */
+  t = ARMOFF - spin;
+  wake.tv_sec = ttt;
+  wake.tv_nsec = (long)(t*1e9);
+  target.tv_sec = ttt;
+  target.tv_nsec = (long)(ARMOFF*1e9);
+  while( clock_nanosleep( CLOCK_REALTIME, TIMER_ABSTIME, &wake, NULL ) == EINTR )
+    ;
+  do
+    clock_gettime( CLOCK_REALTIME, &now );
+  while( now.tv_sec < target.tv_sec || 
+	 (now.tv_sec == target.tv_sec && now.tv_nsec < target.tv_nsec) );
+
+  return( (now.tv_sec - target.tv_sec) + 1e-9*(now.tv_nsec - target.tv_nsec) );
 }
 
 pusage()
@@ -881,13 +1657,23 @@ pusage()
   fprintf( stderr, "  -step sec   timestep between A/D cycles (0)\n");
   fprintf( stderr, "  -cycles c   number of repeat cycles (1)\n");
   fprintf( stderr, "  -start yyyy,mm,dd,hh,mm,ss start time\n\n");
-  fprintf( stderr, "  -files f    total number of files to open (40)\n");
+  fprintf( stderr, "  -files f    maximum number of files, 0 for no limit (40)\n");
   fprintf( stderr, "  -rings r    number of input buffers to use (8)\n");
   fprintf( stderr, "  -bytes b    size of input ring buffer (1e6 bytes)\n");
   fprintf( stderr, "  -code len   code length (7812500)\n");
   fprintf( stderr, "  -fft len    fft length (128)\n");
   fprintf( stderr, "  -log l      log file name \n");
   fprintf( stderr, "  -comment \"<msg>\"	operating message in \" \"\n");
+  fprintf( stderr, "  -fsamp f    sampling frequency in MHz; -secs then counts buffers,\n");
+  fprintf( stderr, "              without it the run stops on the system clock\n");
+  fprintf( stderr, "  -qlook k    quick-look spectrum from 1 of every k input buffers (modes 1-3, 5, 6)\n");
+  fprintf( stderr, "  -qlchan n   number of quick-look channels (%d)\n", QLCHAN);
+  fprintf( stderr, "  -qlsecs s   quick-look update interval in seconds (%d)\n", QLSECS);
+  fprintf( stderr, "  -qlfile q   quick-look spectrum file (dir/quicklook.txt)\n");
+  fprintf( stderr, "  -split      write RCP and LCP to separate files (modes 5, 6)\n");
+  fprintf( stderr, "  -requant b  requantize 8-bit data to 4 or 2 bits (mode 3)\n");
+  fprintf( stderr, "  -nocrc      don't write CRC32C block checksums\n");
+  fprintf( stderr, "  -bench mult qualify -dir at mult times the -m/-fsamp data rate, no EDT\n");
   set_kb(0);
   exit(1);
 }
@@ -17,6 +17,8 @@
 *       -n number of reads to perform      (default 10)
 *       -s number of buffers and bytes to skip (default 0)
 *       -r desired start and stop bytes within a record.
+*	infile may also be the prefix of a recording set (data*.NNN)
+*			whose files are then read as one stream
 *
 *  output:
 *	-o option identifies the output file (default is stdout)
@@ -58,12 +60,13 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include "multifile.h"
 
 /* revision control variable */
 static char const rcsid[] = 
 "$Id: pfs_skipbytes.c,v 1.7 2009/11/16 19:08:50 jlm Exp $";
 
-int	fdinput;		/* file descriptor for input file */
+struct MULTIREAD *mfinput;	/* input file or recording set */
 FILE   *fpinput;		/* pointer to input file */
 FILE   *fpoutput;		/* pointer to output file */
 
@@ -86,13 +89,12 @@ int main(int argc, char *argv[])
   int nskipbytes;
   int startbyte;
   int stopbyte;
-  int offset;
+  long long offset;
   char *buffer;			/* buffer space */
 
   int i;
   int done;
   int buffcount;		/* buffer count */ 
-  int open_flags;	/* flags required for open() call */
 
   /* get the command line arguments */
   processargs(argc,argv,&infile,&outfile,&nbytes,&nreads,&nskipbuffs,&nskipbytes,&startbyte,&stopbyte);
@@ -140,9 +142,11 @@ int main(int argc, char *argv[])
   open_file(outfile,&fpoutput);
 
   /* open file input */
-  open_flags = O_RDONLY;
-  if((fdinput = open(infile, open_flags)) < 0 )
-    perror("open input file");
+  if((mfinput = multi_ropen(infile, 0)) == NULL)
+    {
+      perror("open input file");
+      exit(1);
+    }
 
   /* Describe what we are doing to the user */
   fprintf(stderr,"Reading %d byte buffers\n",nbytes);
@@ -152,8 +156,8 @@ int main(int argc, char *argv[])
 
   /* skip unwanted bytes */
   /* nskipbuffs at nbytes each plus nskipbytes */
-  offset = nskipbuffs * nbytes + nskipbytes;
-  if (offset != lseek(fdinput, offset, SEEK_SET))
+  offset = (long long) nskipbuffs * nbytes + nskipbytes;
+  if (offset != multi_lseek(mfinput, offset, SEEK_SET))
     {
       fprintf(stderr,"Read error while skipping buffers.  Check file size.\n");
       exit(1);
@@ -163,7 +167,7 @@ int main(int argc, char *argv[])
   buffcount = 0;
   while(buffcount < nreads)
     {
-      if (read(fdinput, buffer, nbytes) < stopbyte)
+      if (multi_read(mfinput, buffer, nbytes) < stopbyte)
 	{
 	  fprintf(stderr,"Short read or EOF\n");
 	  exit(1);
@@ -203,7 +207,7 @@ int     *stopbyte;
   extern int opterr;    /* if 0, getopt won't output err mesg*/
 
   char *myoptions = "b:n:s:r:o:"; 	 /* options to search for :=> argument*/
-  char *USAGE="pfs_skipbytes -b nbytes [-n nreads] [-s nskipbuffs,nskipbytes] [-r startbyte,stopbyte (one-based)] [-o outfile] infile";
+  char *USAGE="pfs_skipbytes -b nbytes [-n nreads] [-s nskipbuffs,nskipbytes] [-r startbyte,stopbyte (one-based)] [-o outfile] infile (or data*.NNN set prefix)";
 
   int  i;
   int  c;			 /* option letter returned by getopt  */
@@ -212,6 +216,7 @@ int     *stopbyte;
   /* default parameters */
   opterr = 0;			 /* turn off there message */
   *outfile = "-";		 /* initialise to stdout */
+  *infile = "-";		 /* and stdin */
 
   *nbytes  = -1;		 /* no default value */
   *nreads  = INT_MAX;
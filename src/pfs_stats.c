@@ -7,7 +7,7 @@
 *
 *  usage:
 *  	pfs_stats -m mode [-a (parse all data)] [-e (parse data at eof)]
-*                [-o outfile] [infile]
+*                [-N (no result cache)] [-o outfile] [infile]
 *
 *  input:
 *       the input parameters are typed in as command line arguments
@@ -15,6 +15,12 @@
 *       the -e option specifies to parse data at the end of the file
 *	the -a option specifies to parse all the data recorded
 *                     (default is to parse the first megabyte)
+*	the -N option recomputes the statistics even if a run with the
+*		      same options on the same, unchanged file has been
+*		      kept in the result cache ($PFS_CACHE or ~/.pfs_cache,
+*		      at most $PFS_CACHE_MB megabytes)
+*	infile may also be the prefix of a recording set (data*.NNN)
+*			whose files are then read as one stream
 *
 *  output:
 *	the -o option identifies the output file, stdout is default
@@ -77,13 +83,15 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include "unpack.h"
+#include "multifile.h"
+#include "rcache.h"
 
 /* revision control variable */
 static char const rcsid[] = 
 "$Id: pfs_stats.c,v 3.2 2009/11/16 19:08:21 jlm Exp $";
 
 FILE   *fpoutput;		/* pointer to output file */
-int	fdinput;		/* file descriptor for input file */
+struct MULTIREAD *mfinput;	/* input file or recording set */
 
 char   *outfile;		/* output file name */
 char   *infile;		        /* input file name */
@@ -99,9 +107,12 @@ void floatsum(float *inbuf, long nsamples, double *i, double *q, double *ii, dou
 
 int main(int argc, char *argv[])
 {
-  struct stat filestat;	/* input file status structure */
+  struct RCACHE rc;	/* result cache, see rcache.c */
+  char key[1024];	/* options and input identity */
   int bufsize = 1000000;/* size of read buffer, default 1 MB */
-  char *buffer;		/* buffer for packed data */
+  char *buffer;		/* packed data, mapped from the input */
+  char *readbuf;	/* buffer for packed data read from a pipe */
+  long long offset;	/* stream offset of the next buffer */
   char *rcp,*lcp;	/* buffer for unpacked data */
   float *fbuffer;	/* buffer for unpacked data */
   float smpwd;		/* # of single pol complex samples in a 4 byte word */
@@ -111,14 +122,14 @@ int main(int argc, char *argv[])
   long ntotal;		/* total number of samples used in computing statistics */
   int bytesread;	/* number of bytes read from input file */
   int levels;		/* # of levels for given quantization mode */
-  int open_flags;	/* flags required for open() call */
   int parse_all;
   int parse_end;
+  int nocache;
   int mode;
   int k;
 
   /* get the command line arguments and open the files */
-  processargs(argc,argv,&infile,&outfile,&mode,&parse_all,&parse_end);
+  processargs(argc,argv,&infile,&outfile,&mode,&parse_all,&parse_end,&nocache);
 
   /* save the command line */
   copy_cmd_line(argc,argv,command_line);
@@ -127,22 +138,16 @@ int main(int argc, char *argv[])
   open_file(outfile,&fpoutput);
 
   /* open file input */
-  open_flags = O_RDONLY;
-  if((fdinput = open(infile, open_flags)) < 0 )
+  if((mfinput = multi_ropen(infile, 0)) == NULL)
     {
       perror("open input file");
       exit(1);
     }
 
   /* check file size */
-  if (fstat (fdinput, &filestat) < 0)
-    {
-      perror("input file status");
-      exit(1);
-    }
-  if (filestat.st_size % 4 != 0)
-    fprintf(stderr,"Warning: file size %d is not a multiple of 4\n",
-	    (int) filestat.st_size);
+  if (multi_size(mfinput) > 0 && multi_size(mfinput) % 4 != 0)
+    fprintf(stderr,"Warning: file size %lld is not a multiple of 4\n",
+	    multi_size(mfinput));
 
   switch (mode)
     {
@@ -159,13 +164,20 @@ int main(int argc, char *argv[])
     default: fprintf(stderr,"Invalid mode\n"); exit(1);
     }
 
+  /* the same statistics of the same file may have been computed before */
+  memset(&rc, 0, sizeof(rc));
+  snprintf(key,sizeof(key),"m=%d a=%d e=%d in=",mode,parse_all,parse_end);
+  if (!nocache && multi_ident(mfinput,key,sizeof(key)) == 0
+      && rc_open(&rc,"pfs_stats",key,fpoutput))
+    return 0;
+
   /* allocate storage */
   nsamples = (long) rint(bufsize * smpwd / 4.0);
-  buffer = (char *) malloc(bufsize);
+  readbuf = (char *) malloc(bufsize);
   rcp = (char *) malloc(2 * nsamples * sizeof(char));
   lcp = (char *) malloc(2 * nsamples * sizeof(char));
   fbuffer = (float *) malloc(2 * nsamples * sizeof(float));
-  if (!lcp || !rcp || !fbuffer)
+  if (!readbuf || !lcp || !rcp || !fbuffer)
     {
       fprintf(stderr,"Malloc error\n"); 
       exit(1);
@@ -181,13 +193,25 @@ int main(int argc, char *argv[])
 
   /* go to end of file if requested */
   if (parse_end)
-    lseek(fdinput, -bufsize, SEEK_END);
+    multi_lseek(mfinput, -bufsize, SEEK_END);
+  offset = multi_lseek(mfinput, 0, SEEK_CUR);
 
   /* infinite loop */
   while (1)
     {
-      /* read one buffer */
-      bytesread = read(fdinput, buffer, bufsize);
+      /* map one buffer from a file, read it from a pipe */
+      if (mfinput->seekable)
+	{
+	  bytesread = bufsize;
+	  if (multi_size(mfinput) - offset < bufsize)
+	    bytesread = multi_size(mfinput) - offset;
+	  if (bytesread <= 0
+	      || (buffer = multi_map(mfinput, offset, bytesread)) == NULL)
+	    bytesread = 0;
+	  offset += bytesread;
+	}
+      else
+	bytesread = multi_read(mfinput, buffer = readbuf, bufsize);
       /* check for end of file */
       if (bytesread == 0) break;
       /* handle small buffers */
@@ -293,7 +317,11 @@ int main(int argc, char *argv[])
     }
 
   /* exit here for bytes and floats */
-  if (mode >= 8) return 0;
+  if (mode >= 8)
+    {
+      rc_store(&rc);
+      return 0;
+    }
 
   /* convert to volts */
   /* AD range is 1 Vpp */
@@ -343,6 +371,7 @@ int main(int argc, char *argv[])
       fprintf(fpoutput,"\n"); 
     }
  
+  rc_store(&rc);
   return 0;
 }
 
@@ -389,7 +418,7 @@ void floatsum(float *inbuf, long nsamples, double *i, double *q, double *ii, dou
 /******************************************************************************/
 /*	processargs							      */
 /******************************************************************************/
-void	processargs(argc,argv,infile,outfile,mode,parse_all,parse_end)
+void	processargs(argc,argv,infile,outfile,mode,parse_all,parse_end,nocache)
 int	argc;
 char	**argv;			 /* command line arguements */
 char	**infile;		 /* input file name */
@@ -397,6 +426,7 @@ char	**outfile;		 /* output file name */
 int     *mode;
 int     *parse_all;
 int     *parse_end;
+int     *nocache;
 {
   /* function to process a programs input command line.
      This is a template which has been customised for the pfs_stats program:
@@ -409,8 +439,8 @@ int     *parse_end;
   extern int optind;	/* after call, ind into argv for next*/
   extern int opterr;    /* if 0, getopt won't output err mesg*/
 
-  char *myoptions = "m:o:ae"; 	 /* options to search for :=> argument*/
-  char *USAGE1="pfs_stats -m mode [-e (parse data at eof)] [-a (parse all data)] [-o outfile] [infile] ";
+  char *myoptions = "m:o:aeN"; 	 /* options to search for :=> argument*/
+  char *USAGE1="pfs_stats -m mode [-e (parse data at eof)] [-a (parse all data)] [-N (no result cache)] [-o outfile] [infile (or data*.NNN set prefix)] ";
   char *USAGE2="Valid modes are\n\t 0: 2c1b (N/A)\n\t 1: 2c2b\n\t 2: 2c4b\n\t 3: 2c8b\n\t 4: 4c1b (N/A)\n\t 5: 4c2b\n\t 6: 4c4b\n\t 7: 4c8b (N/A)\n\t 8: signed bytes\n\t32: 32bit floats\n";
   int  c;			 /* option letter returned by getopt  */
   int  arg_count = 1;		 /* optioned argument count */
@@ -423,6 +453,7 @@ int     *parse_end;
   *mode  = 0;                /* default value */
   *parse_all = 0;
   *parse_end = 0;
+  *nocache = 0;
 
   /* loop over all the options in list */
   while ((c = getopt(argc,argv,myoptions)) != -1)
@@ -449,6 +480,11 @@ int     *parse_end;
                arg_count += 1;
 	       break;
 	    
+      case 'N':
+ 	       *nocache = 1;
+               arg_count += 1;
+	       break;
+	    
       case '?':			 /*if not in myoptions, getopt rets ? */
                goto errout;
                break;
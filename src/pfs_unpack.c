@@ -21,6 +21,8 @@
 *	the -m argument specifies the data acquisition mode
 *       the -c argument specifies which channel (1 or 2) to process
 *       the -a option allows text output instead of binary output
+*	infile may also be the prefix of a recording set (data*.NNN)
+*			whose files are then read as one stream
 *
 *  output:
 *	the -o option identifies the output file, stdout is default
@@ -101,13 +103,14 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include "unpack.h"
+#include "multifile.h"
 
 /* revision control variable */
 static char const rcsid[] = 
 "$Id: pfs_unpack.c,v 3.4 2009/11/16 19:07:49 jlm Exp $";
 
 int     fdoutput;		/* file descriptor for output file */
-int	fdinput;		/* file descriptor for input file */
+struct MULTIREAD *mfinput;	/* input file or recording set */
 
 char   *outfile;		/* output file name */
 char   *infile;		        /* input file name */
@@ -121,7 +124,6 @@ void apply_linear_phase(float *data, double freq, double time, double timeint, i
 
 int main(int argc, char *argv[])
 {
-  struct stat filestat;	/* input file status structure */
   int bufsize = 1000000;/* size of read buffer, default 1 MB, unless input file is smaller */
   int outbufsize;	/* output buffer size */
   int bytesread;	/* number of bytes read from input file */
@@ -150,11 +152,12 @@ int main(int argc, char *argv[])
   /* save the command line */
   copy_cmd_line(argc,argv,command_line);
 
-  /* open file input */
-  if (infile[0] == '-')
-    fdinput=STDIN_FILENO;
-  else if((fdinput = open(infile, O_RDONLY)) < 0 )
-    perror("open input file");
+  /* open file input, "-" is stdin */
+  if((mfinput = multi_ropen(infile, 0)) == NULL)
+    {
+      perror("open input file");
+      exit(1);
+    }
 
   if (outfile[0] == '-')
     fdoutput=STDOUT_FILENO;
@@ -162,14 +165,9 @@ int main(int argc, char *argv[])
     perror("open output file");
 
   /* check file size */
-  if (fstat (fdinput, &filestat) < 0)
-    {
-      perror("input file status");
-      exit(1);
-    }
-  if (filestat.st_size % 4 != 0)
-    fprintf(stderr,"Warning: file size %d is not a multiple of 4\n",
-	    (int) filestat.st_size);
+  if (multi_size(mfinput) > 0 && multi_size(mfinput) % 4 != 0)
+    fprintf(stderr,"Warning: file size %lld is not a multiple of 4\n",
+	    multi_size(mfinput));
 
   switch (mode)
     {
@@ -207,7 +205,7 @@ int main(int argc, char *argv[])
   while (1)
     {
       /* read one buffer */
-      bytesread = read(fdinput, buffer, bufsize);
+      bytesread = multi_read(mfinput, buffer, bufsize);
       /* check for end of file */
       if (bytesread == 0) break;
       /* handle small buffers */
@@ -383,7 +381,7 @@ double   *foff;
   extern int opterr;    /* if 0, getopt won't output err mesg*/
 
   char *myoptions = "m:c:o:adpf:x:"; 	 /* options to search for :=> argument*/
-  char *USAGE1="pfs_unpack -m mode [-c channel (1 or 2)] [-d (detect and output magnitude)] [-p (detect and output power)] [-o outfile (- for stdout)] [infile (- for stdin)] ";
+  char *USAGE1="pfs_unpack -m mode [-c channel (1 or 2)] [-d (detect and output magnitude)] [-p (detect and output power)] [-o outfile (- for stdout)] [infile (- for stdin, or data*.NNN set prefix)] ";
   char *USAGE2="For phase rotation, also specify [-f sampling frequency (MHz)] [-x desired frequency offset (Hz)] ";
   char *USAGE3="Valid modes are\n\t 0: 2c1b (N/A)\n\t 1: 2c2b\n\t 2: 2c4b\n\t 3: 2c8b\n\t 4: 4c1b (N/A)\n\t 5: 4c2b\n\t 6: 4c4b\n\t 7: 4c8b (N/A)\n\t 8: signed bytes\n\t16: signed 16bit\n\t32: 32bit floats\n";
 
@@ -0,0 +1,432 @@
+/*******************************************************************************
+*  program pfs_verify
+*  $Id$
+*  This program checks a recording against the CRC32C block checksums
+*  that pfs_radar keeps in the .crc sidecar of each recording set,
+*  e.g. data20091116190850.crc for data20091116190850.000, .001, ...
+*
+*  usage:
+*  	pfs_verify [-j threads] [-v] [-o outfile] prefix [prefix]...
+*
+*  input:
+*       the input parameters are typed in as command line arguments
+*	the -j option specifies the number of reader threads (default 4)
+*	the -v option lists every block checked, not just the bad ones
+*	each prefix names a recording set, with or without the .crc suffix
+*
+*  output:
+*	the -o option identifies the output file, stdout is default
+*	one line per bad block: file, offset, length, expected and
+*	computed crc.  exit status is 1 if any block is bad or missing.
+*
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include "crc32c.h"
+
+/* revision control variable */
+static char const rcsid[] =
+"$Id$";
+
+struct BLOCK {
+  int set;			/* index of recording set */
+  int file;			/* file number within set */
+  long long off;		/* offset within file */
+  long long len;		/* bytes */
+  int rank;			/* position within its file */
+  unsigned int crc;		/* expected crc */
+  unsigned int got;		/* computed crc */
+  int status;			/* 0 ok, 1 bad crc, 2 short read */
+};
+
+struct SET {
+  char prefix[256];
+  int nfiles;			/* files named in the sidecar */
+  int *fd;
+  long long *end;		/* bytes covered by checksums */
+  int *nblk;			/* blocks in each file */
+};
+
+struct BLOCK *blocks;		/* all blocks from all sets */
+int nblocks;
+struct SET *sets;
+int nsets;
+int next;			/* next block to check */
+long long maxlen;		/* largest block */
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+FILE   *fpoutput;		/* pointer to output file */
+char   *outfile;		/* output file name */
+
+void processargs();
+void open_file();
+void read_sidecar();
+void *verify();
+int rankcmp();
+int filecmp();
+
+int main(int argc, char *argv[])
+{
+  pthread_t *proc;
+  struct timeval t0, t1;
+  struct stat filestat;
+  struct BLOCK *b;
+  struct SET *s;
+  double secs, bytes;
+  char name[300];
+  int nthreads;
+  int verbose;
+  int first;
+  int nbad, nmissing;
+  int i, k;
+
+  /* get the command line arguments */
+  processargs(argc,argv,&outfile,&nthreads,&verbose,&first);
+
+  /* open output file, stdout default */
+  open_file(outfile,&fpoutput);
+
+  /* read checksums for all the sets */
+  nsets = argc - first;
+  sets = (struct SET *) calloc(nsets, sizeof(struct SET));
+  if (!sets)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  for (i = 0; i < nsets; i++)
+    read_sidecar(argv[first+i], i);
+
+  /* open the data files, a missing file fails its blocks */
+  nmissing = 0;
+  for (i = 0; i < nsets; i++)
+    {
+      s = &sets[i];
+      for (k = 0; k < s->nfiles; k++)
+	{
+	  s->fd[k] = -1;
+	  if (s->end[k] == 0) continue;
+	  sprintf(name, "%s.%03d", s->prefix, k);
+	  if ((s->fd[k] = open(name, O_RDONLY)) < 0)
+	    {
+	      perror(name);
+	      nmissing++;
+	      continue;
+	    }
+	  fstat(s->fd[k], &filestat);
+	  if (filestat.st_size > s->end[k])
+	    fprintf(stderr,"Warning: %s has %lld bytes past the last checksum\n",
+		    name, (long long) filestat.st_size - s->end[k]);
+	}
+    }
+
+  /*
+     interleave the blocks of different files so the threads spread
+     over all files (and disks) while each file is still read in order
+  */
+  qsort(blocks, nblocks, sizeof(struct BLOCK), rankcmp);
+
+  /* describe what we are doing */
+  bytes = 0;
+  for (i = 0; i < nblocks; i++)
+    bytes += blocks[i].len;
+  fprintf(stderr,"%-31s: %d\n","Recording sets",nsets);
+  fprintf(stderr,"%-31s: %d\n","Blocks",nblocks);
+  fprintf(stderr,"%-31s: %.3f GB\n","Data",bytes / 1e9);
+  fprintf(stderr,"%-31s: %d\n","Threads",nthreads);
+
+  /* check the blocks */
+  gettimeofday(&t0, NULL);
+  proc = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+  for (i = 0; i < nthreads; i++)
+    if (pthread_create(&proc[i], NULL, verify, NULL))
+      {
+	perror("pthread_create");
+	exit(1);
+      }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(proc[i], NULL);
+  gettimeofday(&t1, NULL);
+  secs = (t1.tv_sec - t0.tv_sec) + 1e-6 * (t1.tv_usec - t0.tv_usec);
+
+  /* report in file order */
+  qsort(blocks, nblocks, sizeof(struct BLOCK), filecmp);
+  nbad = 0;
+  for (i = 0; i < nblocks; i++)
+    {
+      b = &blocks[i];
+      if (b->status) nbad++;
+      if (b->status == 0 && !verbose) continue;
+      fprintf(fpoutput,"%s %s.%03d %lld %lld %08x %08x\n",
+	      b->status == 0 ? "ok " : b->status == 1 ? "BAD" : "SHORT",
+	      sets[b->set].prefix, b->file, b->off, b->len, b->crc, b->got);
+    }
+
+  fprintf(stderr,"%-31s: %d\n","Bad blocks",nbad);
+  if (nmissing)
+    fprintf(stderr,"%-31s: %d\n","Missing files",nmissing);
+  fprintf(stderr,"%-31s: %.1f s, %.1f MB/s\n","Elapsed",secs,
+	  secs > 0 ? bytes / secs / 1e6 : 0);
+
+  return (nbad || nmissing) ? 1 : 0;
+}
+
+/******************************************************************************/
+/*	verify								      */
+/******************************************************************************/
+void *verify(arg)
+void *arg;
+{
+  /* reader thread: take the next block, read it with pread, check its crc */
+  struct BLOCK *b;
+  unsigned char *buf;
+  long long got;
+  ssize_t n;
+  int fd;
+
+  buf = (unsigned char *) malloc(maxlen);
+  if (!buf)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+
+  while (1)
+    {
+      pthread_mutex_lock(&lock);
+      if (next >= nblocks)
+	{
+	  pthread_mutex_unlock(&lock);
+	  break;
+	}
+      b = &blocks[next++];
+      pthread_mutex_unlock(&lock);
+
+      fd = sets[b->set].fd[b->file];
+      if (fd < 0)
+	{
+	  b->status = 2;
+	  continue;
+	}
+      for (got = 0; got < b->len; got += n)
+	if ((n = pread(fd, &buf[got], b->len - got, b->off + got)) <= 0)
+	  break;
+      if (got != b->len)
+	{
+	  b->status = 2;
+	  continue;
+	}
+#ifdef POSIX_FADV_DONTNEED
+      /* don't let a multi-terabyte check evict everything else */
+      posix_fadvise(fd, b->off, b->len, POSIX_FADV_DONTNEED);
+#endif
+      b->got = crc32c(0, buf, b->len);
+      b->status = (b->got != b->crc);
+    }
+
+  free(buf);
+  return NULL;
+}
+
+/******************************************************************************/
+/*	read_sidecar							      */
+/******************************************************************************/
+void read_sidecar(arg, set)
+char *arg;			/* prefix or prefix.crc */
+int set;
+{
+  /* append the blocks listed in prefix.crc to the block list */
+  static int nalloc = 0;
+  struct SET *s;
+  struct BLOCK *b;
+  FILE *fp;
+  char line[256];
+  char name[300];
+  int len, k;
+
+  s = &sets[set];
+  strncpy(s->prefix, arg, sizeof(s->prefix) - 1);
+  len = strlen(s->prefix);
+  if (len > 4 && strcmp(&s->prefix[len-4], ".crc") == 0)
+    s->prefix[len-4] = 0;
+
+  sprintf(name, "%s.crc", s->prefix);
+  if ((fp = fopen(name, "r")) == NULL)
+    {
+      perror(name);
+      exit(1);
+    }
+
+  while (fgets(line, sizeof(line), fp))
+    {
+      if (line[0] == '#') continue;
+      if (nblocks >= nalloc)
+	{
+	  nalloc = nalloc ? 2 * nalloc : 4096;
+	  blocks = (struct BLOCK *) realloc(blocks, nalloc * sizeof(struct BLOCK));
+	  if (!blocks)
+	    {
+	      fprintf(stderr,"Malloc error\n");
+	      exit(1);
+	    }
+	}
+      b = &blocks[nblocks];
+      bzero(b, sizeof(struct BLOCK));
+      if (sscanf(line, "%d %lld %lld %x", &b->file, &b->off, &b->len, &b->crc) != 4
+	  || b->file < 0 || b->len <= 0)
+	{
+	  fprintf(stderr,"%s: bad line: %s", name, line);
+	  exit(1);
+	}
+      if (b->file >= s->nfiles)
+	{
+	  /* no limit on the number of files, grow the per file arrays */
+	  k = s->nfiles;
+	  s->nfiles = b->file + 64;
+	  s->fd = (int *) realloc(s->fd, s->nfiles * sizeof(int));
+	  s->end = (long long *) realloc(s->end, s->nfiles * sizeof(long long));
+	  s->nblk = (int *) realloc(s->nblk, s->nfiles * sizeof(int));
+	  if (!s->fd || !s->end || !s->nblk)
+	    {
+	      fprintf(stderr,"Malloc error\n");
+	      exit(1);
+	    }
+	  for (; k < s->nfiles; k++)
+	    {
+	      s->end[k] = 0;
+	      s->nblk[k] = 0;
+	    }
+	}
+      b->set = set;
+      b->rank = s->nblk[b->file]++;
+      if (b->off + b->len > s->end[b->file])
+	s->end[b->file] = b->off + b->len;
+      if (b->len > maxlen)
+	maxlen = b->len;
+      nblocks++;
+    }
+  fclose(fp);
+}
+
+/******************************************************************************/
+/*	rankcmp, filecmp						      */
+/******************************************************************************/
+int rankcmp(a, b)
+struct BLOCK *a, *b;
+{
+  /* order for checking: k-th block of every file, then the k+1-th ... */
+  if (a->rank != b->rank)
+    return a->rank < b->rank ? -1 : 1;
+  return filecmp(a, b);
+}
+
+int filecmp(a, b)
+struct BLOCK *a, *b;
+{
+  /* order for reporting: set, file, offset */
+  if (a->set != b->set)
+    return a->set < b->set ? -1 : 1;
+  if (a->file != b->file)
+    return a->file < b->file ? -1 : 1;
+  if (a->off != b->off)
+    return a->off < b->off ? -1 : 1;
+  return 0;
+}
+
+/******************************************************************************/
+/*	processargs							      */
+/******************************************************************************/
+void	processargs(argc,argv,outfile,nthreads,verbose,first)
+int	argc;
+char	**argv;			 /* command line arguements */
+char	**outfile;		 /* output file name */
+int     *nthreads;
+int     *verbose;
+int     *first;			 /* index of first prefix in argv */
+{
+  /* function to process a programs input command line.
+     This is a template which has been customised for the pfs_verify program:
+	- the outfile name is set from the -o option
+	- the recording set prefixes are the unoptioned arguments
+  */
+
+  int getopt();		/* c lib function returns next opt*/
+  extern char *optarg; 	/* if arg with option, this pts to it*/
+  extern int optind;	/* after call, ind into argv for next*/
+  extern int opterr;    /* if 0, getopt won't output err mesg*/
+
+  char *myoptions = "j:vo:"; 	 /* options to search for :=> argument*/
+  char *USAGE="pfs_verify [-j threads] [-v (list all blocks)] [-o outfile] prefix [prefix]...";
+
+  int  c;			 /* option letter returned by getopt  */
+
+  /* default parameters */
+  opterr = 0;			 /* turn off there message */
+  *outfile = "-";		 /* initialise to stdout */
+  *nthreads = 4;
+  *verbose = 0;
+
+  /* loop over all the options in list */
+  while ((c = getopt(argc,argv,myoptions)) != -1)
+  {
+    switch (c)
+    {
+      case 'o':
+ 	       *outfile = optarg;	/* output file name */
+	       break;
+
+      case 'j':
+ 	       sscanf(optarg,"%d",nthreads);
+	       break;
+
+      case 'v':
+ 	       *verbose = 1;
+	       break;
+
+      case '?':			 /*if not in myoptions, getopt rets ? */
+               goto errout;
+               break;
+    }
+  }
+
+  if (*nthreads < 1 || optind >= argc)
+    goto errout;
+
+  *first = optind;
+  return;
+
+  /* here if illegal option or argument */
+  errout: fprintf(stderr,"%s\n",rcsid);
+          fprintf(stderr,"Usage: %s\n",USAGE);
+	  exit(1);
+}
+
+/******************************************************************************/
+/*	open file    							      */
+/******************************************************************************/
+void	open_file(outfile,fpoutput)
+char	*outfile;		/* output file name */
+FILE    **fpoutput;		/* pointer to output file */
+{
+  /* opens the output file, stdout is default */
+  if (outfile[0] == '-')
+    *fpoutput=stdout;
+  else
+    {
+      *fpoutput=fopen(outfile,"w");
+      if (*fpoutput == NULL)
+	{
+	  perror("open_files: output file open error");
+	  exit(1);
+	}
+    }
+  return;
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "pyramid.h"
+
+/*
+  Sidecar cache of the -t records of one pfs_fft run, summed over 1, 2,
+  4, 8, ... records.  Level 0 holds the records as computed, -n
+  transforms each; record i of level k is the sum of level 0 records
+  i*2^k to i*2^k+2^k-1.  The file is the header (struct PYRHDR, with the
+  byte offset and count of every level) padded to PYRALIGN, then the
+  levels one after the other, records of nspec*fftlen floats.
+
+  The sum of any n level 0 records starting at any record is then made
+  of at most 2 log2(n) aligned records of the levels, read in place
+  from the mapped file: a later run at -n a multiple of the cached one,
+  over any part of the data, needs no input and no transform.
+
+  The header carries the spec_key of the run, inputs included, and
+  records are added before any output scaling, so a cache is used only
+  by runs whose spectra it holds.  It is written to a temporary name
+  and renamed when complete, so an interrupted run leaves no cache.
+
+  usage:  if( !pyr_open( &p, file, key )) {
+            pyr_create( &p, file, key, nspec, fftlen, sum, tsum, t0, f0, df );
+            pyr_add( &p, record ) for each record;  pyr_finish( &p );
+          } else
+            pyr_sum( &p, first, n, out ) for each output;
+          pyr_close( &p );
+*/
+
+#define PYRMAGIC "PFSPYR1"
+#define PYRALIGN 4096
+
+/* 1 if file is a complete cache made with key, mapped; 0 if not */
+
+int pyr_open( p, file, key )
+struct PYR *p;
+char *file, *key;
+{
+  struct stat st;
+  int fd;
+
+  memset( p, 0, sizeof(struct PYR) );
+  strncpy( p->name, file, sizeof(p->name)-1 );
+  if( (fd = open( file, O_RDONLY )) < 0 )
+    return(0);
+  if( fstat( fd, &st ) < 0 || read( fd, &p->h, sizeof(p->h) ) != sizeof(p->h) ) {
+    close( fd );
+    return(0);
+  }
+  p->h.magic[sizeof(p->h.magic)-1] = 0;
+  p->h.key[PYRKEY-1] = 0;
+  if( strcmp( p->h.magic, PYRMAGIC ) || !p->h.complete || strcmp( p->h.key, key )
+      || p->h.nlevels < 1 || p->h.nlevels > PYRLEVELS
+      || st.st_size < p->h.offset[p->h.nlevels-1]
+         + p->h.count[p->h.nlevels-1] * p->h.nspec * p->h.fftlen * sizeof(float) ) {
+    close( fd );
+    return(0);
+  }
+  p->maplen = st.st_size;
+  p->map = mmap( NULL, p->maplen, PROT_READ, MAP_SHARED, fd, 0 );
+  close( fd );
+  if( p->map == MAP_FAILED ) {
+    p->map = NULL;
+    return(0);
+  }
+  return(1);
+}
+
+/* starts a cache of records of nspec spectra of fftlen bins, each the
+   sum of sum transforms over tsum s, the first at t0 s into the input */
+
+void pyr_create( p, file, key, nspec, fftlen, sum, tsum, t0, f0, df )
+struct PYR *p;
+char *file, *key;
+int nspec, fftlen;
+long long sum;
+double tsum, t0, f0, df;
+{
+  memset( p, 0, sizeof(struct PYR) );
+  strncpy( p->name, file, sizeof(p->name)-1 );
+  snprintf( p->tmp, sizeof(p->tmp), "%s.%d", p->name, (int)getpid() );
+  strcpy( p->h.magic, PYRMAGIC );
+  strncpy( p->h.key, key, PYRKEY-1 );
+  p->h.nspec = nspec;
+  p->h.fftlen = fftlen;
+  p->h.sum = sum;
+  p->h.tsum = tsum;
+  p->h.t0 = t0;
+  p->h.f0 = f0;
+  p->h.df = df;
+  p->h.offset[0] = (sizeof(struct PYRHDR) + PYRALIGN-1) / PYRALIGN * PYRALIGN;
+  if( (p->fp = fopen( p->tmp, "w+" )) == NULL
+      || fseeko( p->fp, p->h.offset[0], SEEK_SET ) < 0 ) {
+    perror( p->tmp );
+    if( p->fp ) fclose( p->fp );
+    p->fp = NULL;
+  }
+}
+
+/* appends a level 0 record; -1, and the cache abandoned, on error */
+
+int pyr_add( p, record )
+struct PYR *p;
+float *record;
+{
+  size_t len = (size_t)p->h.nspec * p->h.fftlen;
+
+  if( !p->fp )
+    return(-1);
+  if( fwrite( record, sizeof(float), len, p->fp ) != len ) {
+    perror( p->tmp );
+    fclose( p->fp );
+    unlink( p->tmp );
+    p->fp = NULL;
+    return(-1);
+  }
+  p->h.count[0]++;
+  return(0);
+}
+
+/* adds the levels above 0, pairwise from the one below, writes the
+   header and puts the cache in place */
+
+void pyr_finish( p )
+struct PYR *p;
+{
+  size_t len = (size_t)p->h.nspec * p->h.fftlen;
+  float *a, *b, *c;
+  long long i, size;
+  size_t j;
+  int k, fd;
+
+  if( !p->fp )
+    return;
+  if( fflush( p->fp ) || p->h.count[0] == 0 ) {
+    fclose( p->fp );
+    unlink( p->tmp );
+    p->fp = NULL;
+    return;
+  }
+  for( k = 1; k < PYRLEVELS && p->h.count[k-1] >= 2; k++ ) {
+    p->h.count[k] = p->h.count[k-1] / 2;
+    p->h.offset[k] = p->h.offset[k-1] + p->h.count[k-1] * len * sizeof(float);
+  }
+  p->h.nlevels = k;
+  size = p->h.offset[k-1] + p->h.count[k-1] * len * sizeof(float);
+
+  fd = fileno( p->fp );
+  if( ftruncate( fd, size ) < 0
+      || (p->map = mmap( NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED ) {
+    perror( p->tmp );
+    fclose( p->fp );
+    unlink( p->tmp );
+    p->fp = NULL;
+    p->map = NULL;
+    return;
+  }
+  p->maplen = size;
+  for( k = 1; k < p->h.nlevels; k++ )
+    for( i = 0; i < p->h.count[k]; i++ ) {
+      a = (float *)(p->map + p->h.offset[k-1]) + 2*i*len;
+      b = a + len;
+      c = (float *)(p->map + p->h.offset[k]) + i*len;
+      for( j = 0; j < len; j++ )
+	c[j] = a[j] + b[j];
+    }
+  p->h.complete = 1;
+  memcpy( p->map, &p->h, sizeof(p->h) );
+  msync( p->map, size, MS_SYNC );
+  fclose( p->fp );
+  p->fp = NULL;
+  if( rename( p->tmp, p->name ) < 0 ) {
+    perror( p->name );
+    unlink( p->tmp );
+  }
+}
+
+/* out = the sum of level 0 records first to first+n-1; -1 if the cache
+   does not hold them all */
+
+int pyr_sum( p, first, n, out )
+struct PYR *p;
+long long first, n;
+float *out;
+{
+  size_t len = (size_t)p->h.nspec * p->h.fftlen;
+  long long i, end = first + n;
+  float *r;
+  size_t j;
+  int k;
+
+  if( !p->map || first < 0 || n < 1 || end > p->h.count[0] )
+    return(-1);
+  memset( out, 0, len * sizeof(float) );
+  for( i = first; i < end; i += 1LL << k ) {
+    /* the largest aligned record that starts at i and ends by end */
+    for( k = 0; k+1 < p->h.nlevels && i % (2LL << k) == 0 && i + (2LL << k) <= end; k++ )
+      ;
+    r = (float *)(p->map + p->h.offset[k]) + (i >> k) * len;
+    for( j = 0; j < len; j++ )
+      out[j] += r[j];
+  }
+  return(0);
+}
+
+void pyr_close( p )
+struct PYR *p;
+{
+  if( p->fp ) {
+    fclose( p->fp );
+    unlink( p->tmp );
+    p->fp = NULL;
+  }
+  if( p->map )
+    munmap( p->map, p->maplen );
+  p->map = NULL;
+}
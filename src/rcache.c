@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "rcache.h"
+
+/*
+  Result cache of pfs_fft, pfs_stats and pfs_hist.  Scripts looping over
+  scans often rerun a program with the same parameters on the same
+  files; the bytes it wrote the first time are kept and written again
+  instead of recomputing them.
+
+  An entry is named by a 64 bit FNV-1a hash of the program name and the
+  key, the caller's normalized parameters and the identity of its inputs
+  (multi_ident: device, inode, size and mtime of every file).  It holds
+  the key itself, checked on every lookup, then the output.  Rewriting
+  an input changes its mtime, so stale results are never used.
+
+  Entries live in $PFS_CACHE, or ~/.pfs_cache.  A hit touches its entry;
+  after a store the least recently used entries are removed until the
+  entries are within $PFS_CACHE_MB megabytes (default RCMB); other
+  files in the directory, and entries still being written, are left
+  alone.  Only
+  output going to a regular file (-o, or stdout redirected to one) can
+  be recorded: it is read back from there, through /dev/fd as it is
+  usually open write only, when the run completes.
+
+  usage:  if( rc_open( &rc, "pfs_stats", key, fpoutput ))
+            exit(0);                    the output has been written
+          ... the run ...
+          rc_store( &rc );
+*/
+
+#define RCMAGIC "PFSRC1"
+#define RCMB    1024		/* default size limit, MB */
+#define RCBUF   65536
+
+struct RCENTRY {
+  double used;		/* mtime, set on every hit */
+  long long size;
+  char name[256];
+};
+
+static char *rc_dir()
+{
+  static char name[512];
+  char *p;
+
+  if( (p = getenv( "PFS_CACHE" )) && *p )
+    return( p );
+  if( !(p = getenv( "HOME" )) )
+    return( NULL );
+  snprintf( name, sizeof(name), "%s/.pfs_cache", p );
+  return( name );
+}
+
+static long long rc_limit()
+{
+  char *p;
+
+  if( (p = getenv( "PFS_CACHE_MB" )) && *p )
+    return( (long long)(atof( p ) * 1048576) );
+  return( RCMB * 1048576LL );
+}
+
+static int rc_used( a, b )
+const void *a, *b;
+{
+  double ta = ((struct RCENTRY *)a)->used, tb = ((struct RCENTRY *)b)->used;
+
+  return( ta < tb ? -1 : ta > tb );
+}
+
+/* 1 if name is <prog>.<16 hex digits> and path starts with RCMAGIC */
+
+static int rc_entry( name, path )
+char *name, *path;
+{
+  char magic[8], *p;
+  int i;
+  FILE *fp;
+
+  if( (p = strrchr( name, '.' )) == NULL || p == name || strlen( p+1 ) != 16 )
+    return(0);
+  for( i = 1; i <= 16; i++ )
+    if( !strchr( "0123456789abcdef", p[i] ) )
+      return(0);
+  if( (fp = fopen( path, "r" )) == NULL )
+    return(0);
+  i = fread( magic, 1, sizeof(magic), fp ) == sizeof(magic) && strcmp( magic, RCMAGIC ) == 0;
+  fclose( fp );
+  return(i);
+}
+
+/* removes the least recently used entries of dir until they hold limit bytes */
+
+static void rc_trim( dir, limit )
+char *dir;
+long long limit;
+{
+  struct RCENTRY *e = NULL, *ne;
+  struct dirent *d;
+  struct stat st;
+  char path[1400];
+  long long total = 0;
+  int n = 0, max = 0, i;
+  DIR *dp;
+
+  if( (dp = opendir( dir )) == NULL )
+    return;
+  while( (d = readdir( dp )) != NULL ) {
+    snprintf( path, sizeof(path), "%s/%s", dir, d->d_name );
+    if( stat( path, &st ) < 0 || !S_ISREG( st.st_mode ) || !rc_entry( d->d_name, path ) )
+      continue;
+    if( n == max ) {
+      max = max ? 2*max : 64;
+      if( (ne = (struct RCENTRY *)realloc( e, max * sizeof(struct RCENTRY) )) == NULL )
+	break;
+      e = ne;
+    }
+    e[n].used = st.st_mtim.tv_sec + 1e-9 * st.st_mtim.tv_nsec;
+    e[n].size = st.st_size;
+    strncpy( e[n].name, d->d_name, sizeof(e[n].name)-1 );
+    e[n].name[sizeof(e[n].name)-1] = 0;
+    total += st.st_size;
+    n++;
+  }
+  closedir( dp );
+  qsort( e, n, sizeof(struct RCENTRY), rc_used );
+  for( i = 0; i < n && total > limit; i++ ) {
+    snprintf( path, sizeof(path), "%s/%s", dir, e[i].name );
+    if( unlink( path ) == 0 )
+      total -= e[i].size;
+  }
+  free( e );
+}
+
+/* 1 if the output of prog with key was cached and has been written to
+   out; 0 if the run has to be done, and is recorded if out allows it */
+
+int rc_open( rc, prog, key, out )
+struct RCACHE *rc;
+char *prog, *key;
+FILE *out;
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  char magic[8], buf[RCBUF], *dir, *p;
+  struct stat st;
+  size_t n;
+  int len, fd;
+  FILE *fp;
+
+  memset( rc, 0, sizeof(struct RCACHE) );
+  if( !(dir = rc_dir()) )
+    return(0);
+  len = strlen( prog ) + strlen( key ) + 1;
+  if( (rc->key = (char *)malloc( len + 1 )) == NULL )
+    return(0);
+  sprintf( rc->key, "%s %s", prog, key );
+  for( p = rc->key; *p; p++ )
+    hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+  snprintf( rc->name, sizeof(rc->name), "%s/%s.%016llx", dir, prog, hash );
+
+  if( (fp = fopen( rc->name, "r" )) != NULL ) {
+    if( fread( magic, 1, sizeof(magic), fp ) == sizeof(magic) && strcmp( magic, RCMAGIC ) == 0
+	&& fread( &n, sizeof(n), 1, fp ) == 1 && n == len
+	&& fread( buf, 1, len, fp ) == len && memcmp( buf, rc->key, len ) == 0 ) {
+      while( (n = fread( buf, 1, sizeof(buf), fp )) > 0 )
+	if( fwrite( buf, 1, n, out ) != n ) {
+	  fprintf( stderr, "Write error\n" );
+	  break;
+	}
+      fclose( fp );
+      fflush( out );
+      utimes( rc->name, NULL );
+      return(1);
+    }
+    fclose( fp );
+  }
+
+  /* a miss: record the output if it can be read back.  appended
+     output (>>) starts at the end of the file, whatever ftello says */
+  mkdir( dir, 0755 );
+  fd = fileno( out );
+  if( fstat( fd, &st ) < 0 || !S_ISREG( st.st_mode ) || (rc->start = ftello( out )) < 0 )
+    return(0);
+  if( fcntl( fd, F_GETFL ) & O_APPEND )
+    rc->start = st.st_size;
+  if( (fcntl( fd, F_GETFL ) & O_ACCMODE) == O_RDWR )
+    rc->fd = dup( fd );
+  else {
+    snprintf( buf, sizeof(buf), "/dev/fd/%d", fd );
+    rc->fd = open( buf, O_RDONLY );
+  }
+  if( rc->fd >= 0 )
+    rc->out = out;
+  return(0);
+}
+
+/* keeps what the run wrote to out since rc_open */
+
+void rc_store( rc )
+struct RCACHE *rc;
+{
+  char magic[8], buf[RCBUF];
+  long long limit, off, end;
+  struct stat st;
+  size_t len;
+  ssize_t n;
+  int fd, ok;
+  FILE *fp;
+
+  if( !rc->out )
+    return;
+  fd = rc->fd;
+  limit = rc_limit();
+  len = strlen( rc->key );
+  snprintf( rc->tmp, sizeof(rc->tmp), "%s.%d", rc->name, (int)getpid() );
+  ok = fflush( rc->out ) == 0 && fstat( fd, &st ) == 0;
+  rc->out = NULL;
+  end = st.st_size;
+  /* nothing written, or more than the whole cache may hold */
+  if( !ok || end <= rc->start
+      || (long long)(end - rc->start + sizeof(magic) + sizeof(len) + len) > limit
+      || (fp = fopen( rc->tmp, "w" )) == NULL ) {
+    close( fd );
+    return;
+  }
+  memset( magic, 0, sizeof(magic) );
+  strcpy( magic, RCMAGIC );
+  ok = fwrite( magic, 1, sizeof(magic), fp ) == sizeof(magic)
+    && fwrite( &len, sizeof(len), 1, fp ) == 1
+    && fwrite( rc->key, 1, len, fp ) == len;
+  for( off = rc->start; ok && off < end; off += n )
+    ok = (n = pread( fd, buf, end - off < RCBUF ? end - off : RCBUF, off )) > 0
+      && fwrite( buf, 1, n, fp ) == n;
+  close( fd );
+  if( fclose( fp ) || !ok || rename( rc->tmp, rc->name ) < 0 ) {
+    fprintf( stderr, "Could not save the result to %s\n", rc->name );
+    unlink( rc->tmp );
+    return;
+  }
+  rc_trim( rc_dir(), limit );
+}
@@ -0,0 +1,1905 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "unpack.h"
+#include "multifile.h"
+#include "fftutil.h"
+#include "pfb.h"
+#include "bigfft.h"
+#include "spectral.h"
+#include <fftw3.h>
+
+/*
+  Spectral engine of pfs_fft and pfs_fft_2.  Any number of input streams,
+  each with its own sampling mode, channel and skip, are transformed in
+  step with the same resolution, downsampling, window, zoom, filterbank
+  and -L settings.  Their power spectra are added into one (-k sum, what
+  pfs_fft_2 always did), kept apart (-k separate), or kept along with the
+  cross spectrum of every pair (-k cross).  The front ends parse their
+  command lines into a struct SPEC and write what spec_next() returns.
+
+  usage:  spec_stream( "file:mode:chan:skip", &sp.stream[k] );  each input
+          spec_setup( &sp );  spec_describe( &sp, stderr );  spec_start( &sp );
+          while( (total = spec_next( &sp )) ) {
+            write sp.nspec spectra of sp.fftlen bins, one after the other
+            spec_done( &sp, total );
+          }
+          spec_finish( &sp );
+
+  With -k cross the spectra are the nstreams power spectra, then for each
+  pair a<b the real and the imaginary part of X_a conj(X_b).
+
+  -k stokes takes one input of a 4 channel mode and makes it two streams,
+  rcp and lcp, unpacked from the same read.  They are accumulated as for
+  -k cross and turned into I = RR + LL, Q = 2 Re(R L*), U = 2 Im(R L*)
+  and V = RR - LL, in that order.
+
+  -K flags radio frequency interference with the generalized spectral
+  kurtosis (Nita & Gary 2010) of each -n sum.  The squares of the power
+  of each stream are accumulated with the power, in the same pass; for
+  M transforms SK = (M+1)/(M-1) (M S2/S1^2 - 1) is 1 for Gaussian noise,
+  with variance 4M^2/((M-1)(M+2)(M+3)).  A bin is flagged when any
+  stream's SK is further than -K sigmas from 1, and the whole spectrum
+  when more than SKWHOLE of its bins are.  Flagged bins can be zeroed.
+
+  Transforms whose worker buffers would not fit the -M memory budget
+  (half the physical memory by default), 10^8 points and up for sub-Hz
+  resolution, are done by the four-step FFT of bigfft.c instead, one at
+  a time in place in a single mapped array.  The data are read into it
+  LONGPIECE samples at a time, so no buffer holds a whole packed block,
+  and the power goes straight from the transposed transform into the
+  output spectrum in bin order.  When the array and the spectra would
+  take more than half the budget they are backed by scratch files in the
+  -M directory ($TMPDIR or /tmp) and the passes gather blocks of half
+  the budget; otherwise blocks are sized to stay in cache (LONGCACHE).
+*/
+
+/*
+  The -n sum is cut into chunks of at least CHUNK transforms.  Workers
+  take chunks in order, read them with pread and sum each one into its
+  own accumulator; the chunk sums are then added pairwise in a tree whose
+  shape depends only on -n and the transform length.  The result is
+  therefore the same whatever the number of threads, and the same as the
+  serial sum when -n <= CHUNK.
+
+  Within a chunk, transforms are done in batches: one read, one unpack
+  and one fftwf_plan_many_dft execution per stream for up to BATCHSAMP
+  input samples, so short transforms don't pay per call overheads.  All
+  streams of a batch are transformed before any is detected, so the
+  cross spectra see matching transforms.
+*/
+#define CHUNK 16
+#define BATCHSAMP 262144
+
+/*
+  Zoom (-z): the band of nb bins is mixed to zero frequency, filtered
+  with a Blackman windowed sinc of ZOOMTAPS*D+1 taps and decimated by D,
+  and transformed with zlen = fftlen/D points at the same resolution.
+  Output rate is at least ZOOMOVER times the band, so aliases fall
+  beyond the filter transition and the band stays in the flat part of
+  the passband; the remaining filter response is divided out.  The
+  filter is applied circularly over each transform, which makes the
+  zoomed bins equal to the full transform's, up to stopband leakage.
+*/
+#define ZOOMTAPS 10
+#define ZOOMOVER 2.5
+#define ZOOMMIN 4		/* smallest decimation worth doing */
+
+#define SKWHOLE 0.5		/* fraction of flagged bins that flags a spectrum */
+
+#define LONGPIECE 1048576	/* samples per read of a four-step transform */
+#define LONGCACHE 1048576	/* bytes per gather block when in memory */
+
+struct WSTREAM {
+  char *buffer;		/* packed data */
+  char *rcp;		/* unpacked data */
+  float *fftinbuf, *fftoutbuf;
+  float *zoombuf;	/* decimated input for the zoom transform */
+  float *pfbbuf;	/* input blocks for the filterbank */
+  float **blk;		/* the blocks folded into one transform */
+  int kept;		/* filterbank blocks carried over, unseekable input */
+  int nb;		/* blocks in buffer */
+};
+
+struct WORKER {
+  pthread_t proc;
+  fftwf_plan p;		/* planned on the first stream's buffers */
+  struct WSTREAM *s;	/* one per input stream */
+};
+
+static struct JOB {
+  int nstreams;
+  struct SPEC_STREAM *stream;
+  int combine;
+  int nacc;		/* spectra in an accumulator */
+  int nsq;		/* and squared power spectra after them, with -K */
+  int downsample, fftlen;
+  int datalen;		/* samples per block, fftlen unless zero padded */
+  int invert, hanning, swap, dcoffset;
+  int real;		/* real input, r2c transforms */
+  int shift;		/* bins to move a real spectrum up */
+  int outlen;		/* bins per transform at the output */
+  int zoom;		/* decimation factor D, 0 without -z */
+  int nozoom;		/* -z was asked for but would not help */
+  int k0;		/* zoom band center, bins from zero frequency */
+  int ntaps;
+  float *taps;		/* complex taps, filter and mixing combined */
+  float *corr;		/* power correction for each zoomed bin */
+  struct PFB *pfb;	/* polyphase filterbank, NULL for a plain FFT */
+  float *hann;		/* Hanning weights, with -H */
+  double *chebweight;	/* Chebyshev window, with -C */
+  int extra;		/* blocks read beyond each batch, ntaps-1 */
+  long long sum;
+  int batch;		/* transforms per fftw execution */
+  long long chunk;	/* transforms per chunk, a multiple of batch */
+  long long nchunks;	/* chunks in one sum */
+  double dcoffi, dcoffq;
+  int timeseries;
+  struct BIGFFT *big;	/* four-step transform, with sp->longfft */
+  char *scratch;	/* where its arrays are, NULL for memory */
+  float *bigdata;	/* the transform, in place */
+  float *bigtotal;	/* nacc spectra */
+  char *bigbuf, *bigrcp;	/* one piece of packed and unpacked data */
+} job;
+
+static struct WORKER *workers;
+static int nworkers;
+
+/* reduction state, all guarded by lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static long long nextchunk;	/* next chunk to hand out */
+static long long merged;	/* chunks added to the tree so far */
+static long long stopchunk = -1; /* first chunk that hit EOF */
+static int window;		/* chunks in flight plus sums not yet written */
+static float **pend;		/* finished chunks waiting their turn, by chunk % window */
+static float *stk[64];		/* pairwise tree of the sum in progress */
+static int lvl[64];
+static int nstk;
+static float **ready;		/* finished sums, by sum % window */
+static long long nready, nwritten;
+static float **freebuf;		/* spare accumulators */
+static int nfree;
+
+static void *worker(void *arg);
+static int  read_batch(struct WORKER *w, int s, long long first, int n);
+static void long_setup(struct SPEC *sp, double budget);
+static int  long_read(int s);
+static float *long_sum(struct SPEC *sp);
+static void unpack_data(struct SPEC_STREAM *st, char *buffer, char *rcp, float *in, long bufsize, long nout);
+static void detect_batch(struct WORKER *w, int n, float *acc);
+static void merge_chunk(float *acc);
+static float *getbuf(void);
+static void putbuf(float *buf);
+static void rms_scale(struct SPEC *sp, float *total);
+static void sk_flag(struct SPEC *sp, float *total);
+static void real_power(float *data, int len, int shift, float *sum, float *sum2);
+static void zoom_power(float *data, int len, int k0, float *corr, float *sum, float *sum2);
+static void zoom_decimate(float *in, float *out);
+static int  zoom_setup(float binmin, float binmax);
+static void vector_window(float *data, int len, float *weight);
+static double *chebyshev_table(int len, int first, int fulllen, double *chebcoeff, int degree);
+static void chebyshev_window(float *data, int len, double *weight);
+static void swap_iandq(float *data, int len);
+static void zerofill(float *data, int len);
+static double chebeval(double x, double c[], int degree);
+static int  read_cheb_coeffs(char *chebfile, double *chebcoeff);
+static void average(float *inbuf, int nsamples, double *i, double *q);
+
+/******************************************************************************/
+/*	spec_combine							      */
+/******************************************************************************/
+int spec_combine(char *name, int *combine)
+{
+  /* -k sum|separate|cross|stokes, returns -1 for anything else */
+  if (strcmp(name, "sum") == 0)
+    *combine = SPEC_SUM;
+  else if (strcmp(name, "separate") == 0)
+    *combine = SPEC_SEPARATE;
+  else if (strcmp(name, "cross") == 0)
+    *combine = SPEC_CROSS;
+  else if (strcmp(name, "stokes") == 0)
+    *combine = SPEC_STOKES;
+  else
+    return -1;
+  return 0;
+}
+
+/******************************************************************************/
+/*	spec_stream							      */
+/******************************************************************************/
+static int numeric_fields(char *s)
+{
+  /* number of ':' separated fields in s, 0 unless all are numbers or empty */
+  char *end;
+  int n;
+
+  for (n = 1; ; n++, s = end + 1)
+    {
+      strtod(s, &end);
+      if (*end == '\0')
+	return n;
+      if (*end != ':')
+	return 0;
+    }
+}
+
+int spec_stream(char *arg, struct SPEC_STREAM *st)
+{
+  /* fills in st from "file[:mode[:chan[:skip]]]"; fields left out or
+     empty keep what st already holds, the -m, -c and -S values.  the
+     suffix is only taken if it is all numbers, so a file name with a
+     colon still works.  returns -1 for a channel other than 1 or 2
+  */
+  char *p, *q;
+  int field;
+
+  for (p = strchr(arg, ':'); p; p = strchr(p + 1, ':'))
+    if (numeric_fields(p + 1) <= 3 && numeric_fields(p + 1) > 0)
+      break;
+
+  if ((st->name = strdup(arg)) == NULL)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  if (p)
+    st->name[p - arg] = '\0';
+
+  for (field = 0, q = p ? p + 1 : NULL; q; field++)
+    {
+      if (*q && *q != ':')
+	switch (field)
+	  {
+	  case 0: st->mode = atoi(q); break;
+	  case 1: st->chan = atoi(q); break;
+	  case 2: st->skip = atof(q); break;
+	  }
+      if ((q = strchr(q, ':')) != NULL)
+	q++;
+    }
+
+  return (st->chan == 1 || st->chan == 2) ? 0 : -1;
+}
+
+/******************************************************************************/
+/*	spec_sk								      */
+/******************************************************************************/
+int spec_sk(char *arg, float *thresh, int *zero)
+{
+  /* -K sigmas[,zero], returns -1 for anything else */
+  char *p;
+
+  *zero = 0;
+  if (sscanf(arg, "%f", thresh) != 1 || *thresh <= 0)
+    return -1;
+  if ((p = strchr(arg, ',')) != NULL)
+    {
+      if (strcmp(p + 1, "zero") != 0)
+	return -1;
+      *zero = 1;
+    }
+  return 0;
+}
+
+/******************************************************************************/
+/*	spec_flagfile							      */
+/******************************************************************************/
+FILE *spec_flagfile(struct SPEC *sp, char *outfile)
+{
+  /* opens outfile.flags for the -K flags, one record of flagbytes per
+     output, NULL without -K or when the output is stdout */
+  FILE *fp;
+  char *name;
+
+  if (sp->skthresh == 0 || strcmp(outfile,"-") == 0)
+    return NULL;
+  if ((name = (char *) malloc(strlen(outfile) + 7)) == NULL)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  sprintf(name,"%s.flags",outfile);
+  if ((fp = fopen(name,"w")) == NULL)
+    {
+      perror(name);
+      exit(1);
+    }
+  free(name);
+  return fp;
+}
+
+/******************************************************************************/
+/*	spec_budget							      */
+/******************************************************************************/
+int spec_budget(char *arg, float *mb, char **dir)
+{
+  /* -M megabytes[,scratch directory], returns -1 for anything else */
+  char *p;
+
+  if (sscanf(arg, "%f", mb) != 1 || *mb <= 0)
+    return -1;
+  if ((p = strchr(arg, ',')) != NULL)
+    {
+      if (p[1] == '\0')
+	return -1;
+      *dir = p + 1;
+    }
+  return 0;
+}
+
+/******************************************************************************/
+/*	spec_key							      */
+/******************************************************************************/
+int spec_key(struct SPEC *sp, char *key, int len)
+{
+  /* writes into key the front end settings that shape the spectra and
+     the identity of the input files, so that equal keys mean equal
+     spectra; -n, the skip of the first input and the output options are
+     left to the caller.  The -C file counts by its identity as well as
+     its name.  Call before spec_setup.  Returns -1 if an input is stdin
+     or a pipe, the -C file cannot be read, or key is too short */
+  struct SPEC_STREAM *st;
+  struct MULTIREAD *mf;
+  struct stat cst;
+  char *cheb;		/* -C file, "" for none */
+  int n, s;
+
+  memset(&cst, 0, sizeof(cst));
+  cheb = sp->chebfile && sp->chebfile[0] != '-' ? sp->chebfile : "";
+  if (cheb[0] && stat(cheb, &cst) < 0)
+    return -1;
+  n = snprintf(key, len, "f=%.12g r=%.12g d=%d k=%d i=%d H=%d D=%d,%.9g,%.9g dc=%d R=%d,%.9g "
+	       "z=%d,%.9g,%.9g B=%d,%s L=%d C=%s,%llx:%llx:%lld:%ld.%09ld s=%.9g,%.9g K=%.9g,%d in=",
+	       sp->fsamp, sp->freqres, sp->downsample, sp->combine, sp->invert, sp->hanning,
+	       sp->dcoffset, sp->dcoffi, sp->dcoffq, sp->dcfix, sp->real, sp->foff,
+	       sp->zoom, sp->zoom ? sp->freqmin : 0, sp->zoom ? sp->freqmax : 0,
+	       sp->pfbtaps, sp->pfbtaps ? sp->pfbwindow : "", sp->fastlen,
+	       cheb, (long long) cst.st_dev, (long long) cst.st_ino,
+	       (long long) cst.st_size, (long) cst.st_mtim.tv_sec, (long) cst.st_mtim.tv_nsec,
+	       sp->rmsmin, sp->rmsmax, sp->skzero ? sp->skthresh : 0, sp->skzero);
+  for (s = 0; s < sp->nstreams && n < len; s++)
+    {
+      st = &sp->stream[s];
+      n += snprintf(key + n, len - n, "%s:%d:%d:%.9g:", st->name, st->mode, st->chan,
+		    st->skip - sp->stream[0].skip);
+      if (n >= len || strcmp(st->name, "-") == 0 || (mf = multi_ropen(st->name, 0)) == NULL)
+	return -1;
+      if (multi_ident(mf, key, len) < 0)
+	{
+	  multi_rclose(mf);
+	  return -1;
+	}
+      multi_rclose(mf);
+      n = strlen(key);
+    }
+  return n < len - 1 ? 0 : -1;
+}
+
+/******************************************************************************/
+/*	spec_setup							      */
+/******************************************************************************/
+void spec_setup(struct SPEC *sp)
+{
+  /*
+     opens and checks the inputs, computes the transform parameters,
+     allocates the workers and plans their transforms.  exits with a
+     message on any error.
+  */
+  struct SPEC_STREAM *st;
+  struct WSTREAM *ws;
+  double *chebcoeff;
+  long long size, nsums;
+  double budget, need;	/* bytes */
+  int fftlen;		/* transform length, complex samples */
+  int nsamples;		/* # of complex samples in each buffer */
+  int seekable = 1;
+  int i, s;
+
+  /* stokes: both channels of one input, the second unpacked from the first's reads */
+  if (sp->combine == SPEC_STOKES)
+    {
+      st = &sp->stream[0];
+      if (sp->nstreams != 1 || (st->mode != 5 && st->mode != 6 && st->mode != 7))
+	{
+	  fprintf(stderr,"-k stokes takes one input of mode 5, 6 or 7\n");
+	  exit(1);
+	}
+      if ((sp->stream = (struct SPEC_STREAM *) realloc(sp->stream, 2 * sizeof(struct SPEC_STREAM))) == NULL)
+	{
+	  fprintf(stderr,"Malloc error\n");
+	  exit(1);
+	}
+      sp->stream[0].chan = 1;
+      sp->stream[1] = sp->stream[0];
+      sp->stream[1].chan = 2;
+      sp->stream[1].shared = 1;
+      sp->nstreams = 2;
+    }
+
+  /* the inputs */
+  for (s = 0; s < sp->nstreams; s++)
+    {
+      st = &sp->stream[s];
+      if (st->mode == 0)
+	{
+	  fprintf(stderr,"Must specify sampling mode for %s\n",st->name);
+	  exit(1);
+	}
+      switch (st->mode)
+	{
+	case  -1: st->smpwd = 8; break;
+	case   1: st->smpwd = 8; break;
+	case   2: st->smpwd = 4; break;
+	case   3: st->smpwd = 2; break;
+	case   5: st->smpwd = 4; break;
+	case   6: st->smpwd = 2; break;
+	case   7: st->smpwd = 1; break;
+	case   8: st->smpwd = 2; break;
+	case  16: st->smpwd = 1; break;
+	case  32: st->smpwd = 0.5; break;
+	default: fprintf(stderr,"Invalid mode %d for %s\n",st->mode,st->name); exit(1);
+	}
+      if (sp->real && st->mode != 16 && st->mode != 32)
+	{
+	  fprintf(stderr,"Real input (-R) requires mode 16 or 32\n");
+	  exit(1);
+	}
+      if (sp->downsample > 1 && (st->mode == 16 || st->mode == 32))
+	{
+	  fprintf(stderr,"Cannot have -d with modes 16 or 32 yet\n");
+	  exit(1);
+	}
+      if (st->shared)
+	st->mf = sp->stream[s-1].mf;
+      else if((st->mf = multi_ropen(st->name, 0)) == NULL)
+	{
+	  perror("open input file");
+	  exit(1);
+	}
+      if (!st->mf->seekable)
+	seekable = 0;
+    }
+  if (!seekable && sp->nthreads > 1)
+    {
+      fprintf(stderr,"Input is not seekable, using one thread\n");
+      sp->nthreads = 1;
+    }
+  if (sp->skthresh != 0 && sp->sum < 2)
+    {
+      fprintf(stderr,"Spectral kurtosis (-K) needs -n of at least 2\n");
+      exit(1);
+    }
+  if ((sp->combine == SPEC_CROSS || sp->combine == SPEC_STOKES) && (sp->real || sp->zoom))
+    {
+      fprintf(stderr,"Cannot have -k cross or stokes with -R or -z\n");
+      exit(1);
+    }
+
+  /* read Cheb coefficients, if requested */
+  sp->degree = 0;
+  if (sp->chebfile[0] != '-')
+    {
+      chebcoeff = (double *) malloc(64 * sizeof(double));   /* allocate up to 64 coefficients */
+      sp->degree = read_cheb_coeffs(sp->chebfile, chebcoeff); /* read coeffs and return degree */
+    }
+
+  /* compute transform parameters */
+  fftlen = (int) rint(sp->fsamp / sp->freqres * 1e6);
+  sp->freqwas = sp->freqres;
+  if (sp->fastlen == FFT_RES)
+    {
+      fftlen = fft_fastlen(fftlen / sp->downsample, 0) * sp->downsample;
+      sp->freqres = sp->fsamp * 1e6 / fftlen;
+    }
+  for (s = 0; s < sp->nstreams; s++)
+    {
+      st = &sp->stream[s];
+      st->bufsize = fftlen * 4 / st->smpwd;
+      if (sp->real) st->bufsize = fftlen * 2 / st->smpwd;	/* one number per sample */
+      /* fsamp samples per second during skip, and 4/smpwd bytes per complex sample */
+      st->nskipbytes = (long) rint(sp->fsamp * 1e6 * st->skip * 4.0 / st->smpwd);
+    }
+  fftlen = fftlen / sp->downsample;
+
+  /* zero padding keeps the resolution, freqres is the bin spacing */
+  sp->datalen = fftlen;
+  sp->resolution = sp->freqres;
+  if (sp->fastlen == FFT_PAD)
+    {
+      fftlen = fft_fastlen(sp->datalen, 1);
+      sp->freqres = sp->resolution * sp->datalen / fftlen;
+    }
+
+  /* batch and chunk sizes, these must not depend on the number of threads */
+  nsamples = sp->stream[0].bufsize * sp->stream[0].smpwd / 4;
+  job.batch = BATCHSAMP / nsamples;
+  if (job.batch < 1) job.batch = 1;
+  if (job.batch > sp->sum) job.batch = sp->sum;
+  job.chunk = job.batch * ((CHUNK + job.batch - 1) / job.batch);
+  job.nchunks = (sp->sum + job.chunk - 1) / job.chunk;
+
+  if (sp->real)
+    job.shift = (int) rint(sp->foff / sp->freqres);
+
+  /* verify that scaling request is sensible */
+  if (sp->rmsmin != 0 || sp->rmsmax != 0)
+    {
+      if (sp->rmsmin > sp->rmsmax || sp->rmsmin < -sp->freqres*fftlen/2 || sp->rmsmax > sp->freqres*fftlen/2)
+	{
+	  fprintf(stderr,"Problem with -s parameters\n");
+	  exit(1);
+	}
+    }
+
+  /* parameters shared by the workers */
+  job.nstreams = sp->nstreams;
+  job.stream = sp->stream;
+  job.combine = sp->nstreams > 1 ? sp->combine : SPEC_SUM;
+  job.downsample = sp->downsample;
+  job.fftlen = fftlen;
+  job.datalen = sp->datalen;
+  job.invert = sp->invert;
+  job.hanning = sp->hanning;
+  job.swap = 1;
+  job.real = sp->real;
+  job.dcoffset = sp->dcoffset;
+  job.sum = sp->sum;
+  job.dcoffi = sp->dcoffi;
+  job.dcoffq = sp->dcoffq;
+  job.timeseries = sp->timeseries;
+  job.outlen = fftlen;
+  window = 2 * sp->nthreads + 2;
+
+  /* accumulated and output spectra */
+  switch (job.combine)
+    {
+    case SPEC_SUM:
+      job.nacc = sp->nstreams;	/* added after the zero frequency fix */
+      sp->nspec = 1;
+      break;
+    case SPEC_SEPARATE:
+      job.nacc = sp->nspec = sp->nstreams;
+      break;
+    case SPEC_CROSS:
+      job.nacc = sp->nspec = sp->nstreams * sp->nstreams;
+      break;
+    case SPEC_STOKES:
+      job.nacc = sp->nspec = 4;	/* RR, LL, Re and Im of RL* */
+      break;
+    }
+  if (sp->skthresh != 0)
+    job.nsq = sp->nstreams;
+
+  /* transforms too long for the memory budget go four-step */
+  if (sp->membudget == 0)
+    budget = (double) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+  else
+    budget = sp->membudget * 1048576.0;
+  need = (double) sp->nthreads * sp->nstreams * job.batch * (sp->stream[0].bufsize + 2.0 * nsamples + 16.0 * fftlen)
+    + (double) window * (job.nacc + job.nsq) * 4.0 * fftlen;
+  if (need > budget)
+    long_setup(sp, budget);
+
+  /* zoom to the -x band, from here on fftlen is the output length */
+  sp->fcenter = 0;
+  if (sp->zoom && zoom_setup(sp->freqmin / sp->freqres, sp->freqmax / sp->freqres))
+    {
+      fftlen = job.outlen;
+      sp->fcenter = job.k0 * sp->freqres;
+      if ((sp->rmsmin != 0 || sp->rmsmax != 0) &&
+	  (sp->rmsmin < sp->fcenter - sp->freqres*fftlen/2 || sp->rmsmax > sp->fcenter + sp->freqres*fftlen/2))
+	{
+	  fprintf(stderr,"Problem with -s parameters, outside the zoomed band\n");
+	  exit(1);
+	}
+    }
+  else if (sp->zoom)
+    job.nozoom = 1;
+  sp->fftlen = fftlen;
+  if (sp->skthresh != 0)
+    {
+      sp->flagbytes = (fftlen + 7) / 8;
+      if ((sp->flags = (unsigned char *) malloc(sp->flagbytes)) == NULL)
+	{
+	  fprintf(stderr,"Malloc error\n");
+	  exit(1);
+	}
+    }
+
+  /* polyphase filterbank, each transform reads ntaps-1 blocks further */
+  if (sp->pfbtaps)
+    {
+      if ((job.pfb = pfb_create(fftlen, sp->pfbtaps, sp->pfbwindow)) == NULL)
+	{
+	  fprintf(stderr,"Malloc error\n");
+	  exit(1);
+	}
+      job.extra = sp->pfbtaps - 1;
+    }
+
+  /* window weights, computed once */
+  if (sp->hanning && !sp->longfft && (job.hann = fft_hann(job.datalen)) == NULL)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  if (sp->degree)
+    job.chebweight = chebyshev_table(fftlen,job.k0+job.fftlen/2-fftlen/2,job.fftlen,chebcoeff,sp->degree);
+
+  /* whole sums held by the shortest input */
+  sp->nsums = -1;
+  for (s = 0; s < sp->nstreams; s++)
+    {
+      st = &sp->stream[s];
+      if ((size = multi_size(st->mf)) < 0)
+	{
+	  sp->nsums = -1;
+	  break;
+	}
+      nsums = ((size - st->nskipbytes) / st->bufsize - job.extra) / sp->sum;
+      if (nsums < 0) nsums = 0;
+      if (s == 0 || nsums < sp->nsums)
+	sp->nsums = nsums;
+    }
+
+  /* skip unwanted bytes */
+  for (s = 0; s < sp->nstreams; s++)
+    {
+      st = &sp->stream[s];
+      if (!st->shared && st->nskipbytes != multi_lseek(st->mf, st->nskipbytes, SEEK_SET))
+	{
+	  fprintf(stderr,"Read error while skipping %ld bytes.  Check file size.\n",st->nskipbytes);
+	  exit(1);
+	}
+    }
+
+  /* four-step: one transform at a time, no workers */
+  if (sp->longfft)
+    {
+      fft_wisdom_load();
+      if ((job.big = bigfft_create(fftlen, job.scratch ? budget / (2 * sp->nthreads) : LONGCACHE,
+				   sp->nthreads, sp->effort)) == NULL)
+	{
+	  fprintf(stderr,"FFT length %d has no factor near its square root, try -L res\n",fftlen);
+	  exit(1);
+	}
+      if (sp->effort != FFTW_ESTIMATE)
+	fft_wisdom_save();
+      return;
+    }
+
+  /* allocate storage */
+  nworkers = sp->nthreads;
+  workers = (struct WORKER *) calloc(nworkers, sizeof(struct WORKER));
+  pend  = (float **) calloc(window, sizeof(float *));
+  ready = (float **) calloc(window, sizeof(float *));
+  freebuf = (float **) calloc(3 * window + 64, sizeof(float *));
+  if (!workers || !pend || !ready || !freebuf)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  fft_wisdom_load();
+  for (i = 0; i < nworkers; i++)
+    {
+      if ((workers[i].s = (struct WSTREAM *) calloc(sp->nstreams, sizeof(struct WSTREAM))) == NULL)
+	{
+	  fprintf(stderr,"Malloc error\n");
+	  exit(1);
+	}
+      for (s = 0; s < sp->nstreams; s++)
+	{
+	  st = &sp->stream[s];
+	  ws = &workers[i].s[s];
+	  nsamples = st->bufsize * st->smpwd / 4;
+	  if (!st->shared)
+	    ws->buffer  = (char *)  malloc((job.batch + job.extra) * st->bufsize);
+	  else
+	    ws->buffer  = workers[i].s[s-1].buffer;
+	  ws->fftinbuf  = (float *) fftwf_malloc(job.batch * 2 * job.fftlen * sizeof(float));
+	  ws->fftoutbuf = (float *) fftwf_malloc(job.batch * 2 * job.fftlen * sizeof(float));
+	  ws->rcp       = (char *)  malloc((job.batch + job.extra) * 2 * nsamples * sizeof(char));
+	  if (job.zoom)
+	    ws->zoombuf = (float *) fftwf_malloc(job.batch * 2 * job.outlen * sizeof(float));
+	  if (job.pfb)
+	    {
+	      ws->pfbbuf = (float *) malloc((job.batch + job.extra) * 2 * job.fftlen * sizeof(float));
+	      ws->blk    = (float **) malloc(sp->pfbtaps * sizeof(float *));
+	    }
+	  if (!ws->buffer || !ws->fftinbuf || !ws->fftoutbuf || !ws->rcp ||
+	      (job.zoom && !ws->zoombuf) || (job.pfb && (!ws->pfbbuf || !ws->blk)))
+	    {
+	      fprintf(stderr,"Malloc error\n");
+	      exit(1);
+	    }
+	}
+
+      /* compute fft plan, the planner is not thread safe so do it here;
+	 the other streams' buffers are aligned alike and reuse it */
+      ws = &workers[i].s[0];
+      if (job.zoom)
+	workers[i].p = fftwf_plan_many_dft(1, &job.outlen, job.batch,
+					   (fftwf_complex *)ws->zoombuf, NULL, 1, job.outlen,
+					   (fftwf_complex *)ws->fftoutbuf, NULL, 1, job.outlen,
+					   FFTW_FORWARD, sp->effort);
+      else if (sp->real)
+	workers[i].p = fftwf_plan_many_dft_r2c(1, &fftlen, job.batch,
+					       ws->fftinbuf, NULL, 1, fftlen,
+					       (fftwf_complex *)ws->fftoutbuf, NULL, 1, fftlen,
+					       sp->effort);
+      else
+	workers[i].p = fftwf_plan_many_dft(1, &fftlen, job.batch,
+					   (fftwf_complex *)ws->fftinbuf, NULL, 1, fftlen,
+					   (fftwf_complex *)ws->fftoutbuf, NULL, 1, fftlen,
+					   FFTW_FORWARD, sp->effort);
+    }
+  if (sp->effort != FFTW_ESTIMATE)
+    fft_wisdom_save();
+  ws = &workers[0].s[0];
+  sp->tplan = fft_time(workers[0].p, job.zoom ? ws->zoombuf : ws->fftinbuf,
+		       2 * job.batch * (job.zoom ? job.outlen : job.fftlen), job.batch);
+  return;
+}
+
+/******************************************************************************/
+/*	spec_describe							      */
+/******************************************************************************/
+void spec_describe(struct SPEC *sp, FILE *fp)
+{
+  /* describes what we are doing, one "name : value" line each */
+  static char *combine[] = { "sum", "separate", "cross", "stokes" };
+  struct SPEC_STREAM *st;
+  char label[32];
+  int fftlen = job.fftlen;	/* before zooming */
+  int s;
+
+  fprintf(fp,"FFT length                     : %d\n",fftlen);
+  fprintf(fp,"FFT length factors             : %s\n",fft_factors(fftlen));
+  if (fftlen != sp->datalen)
+    fprintf(fp,"Zero padded from               : %d samples\n",sp->datalen);
+  fprintf(fp,"Frequency resolution           : %e Hz\n",sp->resolution);
+  if (sp->resolution != sp->freqwas)
+    fprintf(fp,"Resolution moved from          : %e Hz\n",sp->freqwas);
+  if (fftlen != sp->datalen)
+    fprintf(fp,"Bin spacing                    : %e Hz\n",sp->freqres);
+  fprintf(fp,"Processed bandwidth            : %e Hz\n",sp->freqres*fftlen);
+  if (fft_maxfactor(fftlen) > 7)
+    fprintf(fp,"Slow FFT length, prime factor %d; -L res would use %d, -L pad %d\n",
+	    fft_maxfactor(fftlen),fft_fastlen(fftlen,0),fft_fastlen(fftlen,1));
+  if (sp->rmsmin != 0 || sp->rmsmax != 0)
+    fprintf(fp,"Scaling to rms power between   : [%e,%e] Hz\n\n",sp->rmsmin,sp->rmsmax);
+
+  if (sp->real)
+    {
+      fprintf(fp,"Real input, frequency offset   : %e Hz (%d bins)\n",job.shift * sp->freqres,job.shift);
+      if (fabs(job.shift * sp->freqres - sp->foff) > 1e-6 * sp->freqres)
+	fprintf(fp,"Frequency offset rounded from  : %e Hz\n",sp->foff);
+    }
+  if (sp->nstreams > 1)
+    {
+      fprintf(fp,"Inputs, combined as            : %d, %s\n",sp->nstreams,combine[job.combine]);
+      for (s = 0; s < sp->nstreams; s++)
+	{
+	  st = &sp->stream[s];
+	  sprintf(label,"Input %d",s + 1);
+	  fprintf(fp,"%-31s: %s, mode %d, channel %d, skip %ld bytes\n",label,st->name,st->mode,st->chan,st->nskipbytes);
+	}
+    }
+  fprintf(fp,"Data required for one transform: %ld bytes\n",sp->stream[0].bufsize);
+  fprintf(fp,"Number of transforms to add    : %qd\n",sp->sum);
+  fprintf(fp,"Data required for one sum      : %qd bytes\n",sp->sum * sp->stream[0].bufsize);
+  fprintf(fp,"Integration time for one sum   : %e s\n",sp->sum / sp->resolution);
+  fprintf(fp,"Threads                        : %d\n",sp->nthreads);
+  fprintf(fp,"Transforms per batch           : %d\n",job.batch);
+  fprintf(fp,"Planner effort                 : %s\n",fft_effort_name(sp->effort));
+
+  st = &sp->stream[0];
+  if (sp->nstreams == 1 && st->skip != 0)
+    {
+      fprintf(fp,"Skipping from BOF              : %f seconds\n",st->skip);
+      fprintf(fp,"Skipping from BOF              : %ld bytes\n",st->nskipbytes);
+    }
+  if (sp->degree)
+    fprintf(fp, "Degree of Chebyshev polynomial : %d\n",sp->degree);
+  if (sp->skthresh != 0)
+    fprintf(fp,"Spectral kurtosis flagging     : %.1f sigma%s\n",sp->skthresh,sp->skzero ? ", zeroed" : "");
+  fprintf(fp,"\n");
+
+  if (job.zoom)
+    {
+      fprintf(fp,"Zoom decimation                : %d\n",job.zoom);
+      fprintf(fp,"Zoom FFT length                : %d\n",sp->fftlen);
+      fprintf(fp,"Zoom band center               : %e Hz\n\n",sp->fcenter);
+    }
+  else if (job.nozoom)
+    fprintf(fp,"Zoom not possible for this band and FFT length, computing the full FFT\n\n");
+  if (job.pfb)
+    fprintf(fp,"Polyphase filterbank           : %d taps, %s window\n\n",sp->pfbtaps,sp->pfbwindow);
+  if (sp->longfft)
+    {
+      fprintf(fp,"Four-step FFT                  : %d x %d, %d columns per pass\n",job.big->n1,job.big->n2,job.big->block);
+      fprintf(fp,"Four-step arrays               : %e bytes in %s\n\n",(2.0 + job.nacc) * sizeof(float) * job.fftlen,
+	      job.scratch ? job.scratch : "memory");
+    }
+  else
+    fprintf(fp,"Measured time per transform    : %e s\n\n",sp->tplan);
+  return;
+}
+
+/******************************************************************************/
+/*	spec_start, spec_finish						      */
+/******************************************************************************/
+void spec_start(struct SPEC *sp)
+{
+  int i;
+
+  for (i = 0; i < nworkers; i++)
+    if (pthread_create(&workers[i].proc, NULL, worker, &workers[i]))
+      {
+	perror("pthread_create");
+	exit(1);
+      }
+  return;
+}
+
+void spec_finish(struct SPEC *sp)
+{
+  int i, s;
+
+  for (i = 0; i < nworkers; i++)
+    {
+      pthread_join(workers[i].proc, NULL);
+      fftwf_destroy_plan(workers[i].p);
+      for (s = 0; s < sp->nstreams; s++)
+	{
+	  fftwf_free(workers[i].s[s].fftinbuf);
+	  fftwf_free(workers[i].s[s].fftoutbuf);
+	}
+    }
+  if (sp->longfft)
+    {
+      bigfft_unmap(job.bigdata, 2LL * job.fftlen);
+      bigfft_unmap(job.bigtotal, (long long) job.nacc * job.fftlen);
+      bigfft_free(job.big);
+    }
+  return;
+}
+
+/******************************************************************************/
+/*	spec_next, spec_done						      */
+/******************************************************************************/
+float *spec_next(struct SPEC *sp)
+{
+  /*
+     waits for the next finished sum, NULL if the data ran out first, and
+     finishes it: zero frequency bins replaced by their neighbours with
+     dcfix, streams added with -k sum, Chebyshev window and rms scaling
+     applied to each of the nspec spectra.  with -K the bins are flagged
+     first, from the raw sums, and zeroed last if asked.
+  */
+  int len = sp->fftlen;
+  float *total, *t;
+  float rr, ll;
+  int s, j;
+
+  if (sp->longfft)
+    total = long_sum(sp);
+  else
+    {
+      pthread_mutex_lock(&lock);
+      while (nwritten == nready && (stopchunk < 0 || nwritten < stopchunk / job.nchunks))
+	pthread_cond_wait(&cond, &lock);
+      total = nwritten < nready ? ready[nwritten % window] : NULL;
+      pthread_mutex_unlock(&lock);
+    }
+  if (total == NULL)
+    return NULL;
+
+  /* flag interference before anything changes the sums */
+  if (job.nsq)
+    sk_flag(sp,total);
+
+  /* set DC to average of neighboring values */
+  if (sp->dcfix && !job.zoom)
+    for (s = 0; s < job.nacc; s++)
+      {
+	t = &total[s * len];
+	t[len/2] = (t[len/2-1]+t[len/2+1]) / 2.0;
+      }
+
+  /* sum powers */
+  if (job.combine == SPEC_SUM)
+    for (s = 1; s < job.nstreams; s++)
+      for (j = 0; j < len; j++)
+	total[j] += total[(long long) s * len + j];
+
+  /* or make Stokes parameters of RR, LL and RL* */
+  if (job.combine == SPEC_STOKES)
+    for (j = 0; j < len; j++)
+      {
+	rr = total[j];
+	ll = total[len + j];
+	total[j]           = rr + ll;
+	total[len + j]     = 2 * total[2 * len + j];
+	total[2 * len + j] = 2 * total[3 * len + j];
+	total[3 * len + j] = rr - ll;
+      }
+
+  for (s = 0; s < sp->nspec; s++)
+    {
+      /* apply Chebyshev to detected power if needed */
+      if (sp->degree) chebyshev_window(&total[s * len],len,job.chebweight);
+      if (sp->rmsmin != 0 || sp->rmsmax != 0) rms_scale(sp,&total[s * len]);
+    }
+
+  /* blank flagged bins */
+  if (sp->skzero && sp->nflagged)
+    for (j = 0; j < len; j++)
+      if (sp->flags[j/8] & (1 << (j%8)))
+	for (s = 0; s < sp->nspec; s++)
+	  total[s * len + j] = 0;
+  return total;
+}
+
+void spec_done(struct SPEC *sp, float *total)
+{
+  /* gives the accumulator back once the sum is written */
+  if (sp->longfft)
+    return;
+  pthread_mutex_lock(&lock);
+  putbuf(total);
+  nwritten++;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+  return;
+}
+
+/******************************************************************************/
+/*	spec_freq							      */
+/******************************************************************************/
+double spec_freq(struct SPEC *sp, int i)
+{
+  /* frequency of output bin i, Hz */
+  return (i-sp->fftlen/2)*sp->freqres + sp->fcenter;
+}
+
+/******************************************************************************/
+/*	sk_flag								      */
+/******************************************************************************/
+static void sk_flag(struct SPEC *sp, float *total)
+{
+  /* sets sp->flags and sp->nflagged from the spectral kurtosis of each
+     stream's power sum and sum of squares, see the top of this file */
+  int len = sp->fftlen;
+  double M = sp->sum;
+  double lim, s1, s2, sk;
+  float *p1, *p2;
+  int i, s;
+
+  lim = sp->skthresh * sqrt(4 * M * M / ((M - 1) * (M + 2) * (M + 3)));
+  memset(sp->flags, 0, sp->flagbytes);
+  sp->nflagged = 0;
+  for (i = 0; i < len; i++)
+    for (s = 0; s < job.nstreams; s++)
+      {
+	p1 = &total[s * len];
+	p2 = &total[(job.nacc + s) * len];
+	s1 = p1[i];
+	s2 = p2[i];
+	if (s1 <= 0)
+	  continue;
+	sk = (M + 1) / (M - 1) * (M * s2 / (s1 * s1) - 1);
+	if (fabs(sk - 1) > lim)
+	  {
+	    sp->flags[i/8] |= 1 << (i%8);
+	    sp->nflagged++;
+	    break;
+	  }
+      }
+
+  /* too much of it to trust the rest of the spectrum */
+  if (sp->nflagged > SKWHOLE * len)
+    {
+      memset(sp->flags, 0xff, sp->flagbytes);
+      sp->nflagged = len;
+    }
+  return;
+}
+
+/******************************************************************************/
+/*	rms_scale							      */
+/******************************************************************************/
+static void rms_scale(struct SPEC *sp, float *total)
+{
+  /* scales one spectrum to sigmas of the -s band, 3.5 sigma outliers excluded */
+  double mean,mean1;	/* needed for rms computation */
+  double var,var1;	/* needed for rms computation */
+  double sigma,sigma1;	/* needed for rms computation */
+  int imin,imax;	/* indices for rms calculation */
+  int i,n,n1;
+
+  /* identify relevant indices for rms power computation */
+  imin = sp->fftlen/2 + (sp->rmsmin-sp->fcenter)/sp->freqres;
+  imax = sp->fftlen/2 + (sp->rmsmax-sp->fcenter)/sp->freqres;
+  mean1 = var1 = 0;
+  n1 = 0;
+  for (i = imin; i < imax; i++)
+    {
+      mean1 += total[i];
+      var1  += total[i] * total[i];
+      n1++;
+    }
+  mean1  = mean1 / n1;
+  var1   = var1 / n1;
+  sigma1 = sqrt(var1 - mean1 * mean1);
+
+  /* now redo calculation but exclude 3-sigma outliers */
+  mean = var = 0;
+  n = 0;
+  for (i = imin; i < imax; i++)
+    {
+      if (fabs((total[i] - mean1)/sigma1) > 3.5)
+	continue;
+      mean += total[i];
+      var  += total[i] * total[i];
+      n++;
+    }
+  mean  = mean / n;
+  var   = var / n;
+  sigma = sqrt(var - mean * mean);
+
+  for (i = 0; i < sp->fftlen; i++)
+    total[i] = (total[i]-mean)/sigma;
+  return;
+}
+
+/******************************************************************************/
+/*	worker								      */
+/******************************************************************************/
+static void *worker(void *arg)
+{
+  /* takes chunks in order, sums their transforms and merges the chunk sum */
+  struct WORKER *w = (struct WORKER *) arg;
+  long long g, limit, first;
+  float *acc;
+  int fail;
+  int i, m, n, s;
+
+  pthread_mutex_lock(&lock);
+  while (1)
+    {
+      /* one sum only, unless a time series */
+      limit = job.timeseries ? -1 : job.nchunks;
+      if (stopchunk >= 0 && (limit < 0 || stopchunk < limit))
+	limit = stopchunk;
+      if (limit >= 0 && nextchunk >= limit)
+	break;
+
+      /* don't run too far ahead of the tree or of the output */
+      if (nextchunk - merged + nready - nwritten >= window)
+	{
+	  pthread_cond_wait(&cond, &lock);
+	  continue;
+	}
+      g = nextchunk++;
+      acc = getbuf();
+      pthread_mutex_unlock(&lock);
+
+      /* sum the transforms of this chunk, in order, a batch at a time */
+      first = (g / job.nchunks) * job.sum + (g % job.nchunks) * job.chunk;
+      n = job.sum - (g % job.nchunks) * job.chunk;
+      if (n > job.chunk) n = job.chunk;
+      zerofill(acc, (job.nacc + job.nsq) * job.outlen);
+      fail = 0;
+      for (i = 0; i < n && !fail; i += m)
+	{
+	  m = n - i < job.batch ? n - i : job.batch;
+	  for (s = 0; s < job.nstreams && !fail; s++)
+	    fail = read_batch(w, s, first + i, m);
+	  if (!fail)
+	    detect_batch(w, m, acc);
+	}
+
+      pthread_mutex_lock(&lock);
+      if (fail)
+	{
+	  if (stopchunk < 0 || g < stopchunk)
+	    stopchunk = g;
+	  putbuf(acc);
+	}
+      else
+	{
+	  /* merge every chunk that is now next in line */
+	  pend[g % window] = acc;
+	  while (pend[merged % window] && (stopchunk < 0 || merged < stopchunk))
+	    {
+	      acc = pend[merged % window];
+	      pend[merged % window] = NULL;
+	      merge_chunk(acc);
+	    }
+	}
+      pthread_cond_broadcast(&cond);
+    }
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+/******************************************************************************/
+/*	merge_chunk							      */
+/******************************************************************************/
+static void merge_chunk(float *acc)
+{
+  /*
+     adds chunk sum number 'merged' to the pairwise tree, called with
+     lock held.  two partial sums of the same level are added as soon as
+     both exist, earlier + later, so the order of additions is fixed.
+  */
+  int len = (job.nacc + job.nsq) * job.outlen;
+  float *a, *b;
+  int j;
+
+  stk[nstk] = acc;
+  lvl[nstk++] = 0;
+  while (nstk >= 2 && lvl[nstk-1] == lvl[nstk-2])
+    {
+      a = stk[nstk-2];
+      b = stk[nstk-1];
+      for (j = 0; j < len; j++)
+	a[j] += b[j];
+      putbuf(b);
+      lvl[nstk-2]++;
+      nstk--;
+    }
+  merged++;
+
+  /* end of a sum: fold what is left, top down */
+  if (merged % job.nchunks == 0)
+    {
+      while (nstk >= 2)
+	{
+	  a = stk[nstk-2];
+	  b = stk[nstk-1];
+	  for (j = 0; j < len; j++)
+	    a[j] += b[j];
+	  putbuf(b);
+	  nstk--;
+	}
+      nstk = 0;
+      ready[nready % window] = stk[0];
+      nready++;
+    }
+  return;
+}
+
+/******************************************************************************/
+/*	getbuf, putbuf							      */
+/******************************************************************************/
+static float *getbuf(void)
+{
+  /* an accumulator of nacc spectra and nsq squares, called with lock held */
+  float *buf;
+
+  if (nfree > 0)
+    return freebuf[--nfree];
+  buf = (float *) malloc((job.nacc + job.nsq) * job.outlen * sizeof(float));
+  if (!buf)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  return buf;
+}
+
+static void putbuf(float *buf)
+{
+  freebuf[nfree++] = buf;
+  return;
+}
+
+/******************************************************************************/
+/*	read_batch							      */
+/******************************************************************************/
+static int read_batch(struct WORKER *w, int s, long long first, int n)
+{
+  /*
+     reads transforms first to first+n-1 of stream s, unpacks and
+     transforms them into the stream's fftoutbuf.  returns -1 at EOF.
+     with a filterbank, the ntaps-1 blocks after the batch are read too
+     and the blocks are folded into the transforms.
+  */
+  struct SPEC_STREAM *st = &job.stream[s];
+  struct WSTREAM *ws = &w->s[s];
+  int fftlen = job.fftlen;
+  int len = job.datalen;		/* samples per block before padding */
+  int nb = n + job.extra;		/* blocks to read */
+  long bufsize = nb * st->bufsize;	/* bytes for the whole batch */
+  long keep = ws->kept * st->bufsize;	/* of these, already in buffer */
+  float *in = job.pfb ? ws->pfbbuf : ws->fftinbuf;
+  int ncomp = job.real ? 1 : 2;
+  double dcoffi, dcoffq;
+  long long got;
+  float *data;
+  int k,p,t;
+
+  /* initialize input to zero, the whole batch is always transformed */
+  zerofill(in, 2 * fftlen * (job.batch + job.extra));
+
+  /* read the data for the batch; a pipe can't be read twice, so the
+     filterbank blocks after the last batch are the first of this one.
+     a shared stream unpacks what the previous one just read */
+  if (st->shared)
+    got = bufsize;
+  else if (st->mf->seekable)
+    got = multi_pread(st->mf, ws->buffer, bufsize, st->nskipbytes + first * st->bufsize);
+  else
+    {
+      if (keep)
+	memmove(ws->buffer, ws->buffer + (ws->nb - ws->kept) * st->bufsize, keep);
+      got = keep + multi_read(st->mf, ws->buffer + keep, bufsize - keep);
+      ws->kept = job.extra;
+      ws->nb = nb;
+    }
+  if (got != bufsize)
+    return -1;
+
+  /* unpack and downsample */
+  unpack_data(st, ws->buffer, ws->rcp, in, bufsize, len*nb);
+
+  /* real input: len numbers per block, DC offset and window only */
+  for (t = 0; t < nb && job.real; t++)
+    {
+      data = &in[t * len];
+      dcoffi = job.dcoffi;
+      if (job.dcoffset)
+	{
+	  for (k = 0, dcoffi = 0; k < len; k++)
+	    dcoffi += data[k];
+	  dcoffi = dcoffi / len;
+	}
+      if (dcoffi != 0)
+	for (k = 0; k < len; k++)
+	  data[k] -= dcoffi;
+      if (job.hanning)
+	for (k = 0; k < len; k++)
+	  data[k] *= job.hann[k];
+    }
+
+  for (t = 0; t < nb && !job.real; t++)
+    {
+      data = &in[2 * t * len];
+      dcoffi = job.dcoffi;
+      dcoffq = job.dcoffq;
+
+      /* compute DC offset if required */
+      if (job.dcoffset)
+	average(data, len, &dcoffi, &dcoffq);
+
+      /* deal with nonzero DC offsets if provided by user or if option -D was invoked */
+      if (dcoffi != 0 || dcoffq != 0)
+	for (k = 0; k < 2*len; k += 2)
+	  {
+	    data[k]   -= dcoffi;
+	    data[k+1] -= dcoffq;
+	  }
+
+      if (job.invert) swap_iandq(data,len);
+      if (job.hanning) vector_window(data,len,job.hann);
+    }
+
+  /* zero padding: spread the blocks out to the transform length, last first */
+  if (len < fftlen)
+    for (t = nb - 1; t >= 0; t--)
+      {
+	memmove(&in[ncomp * t * fftlen], &in[ncomp * t * len], ncomp * len * sizeof(float));
+	zerofill(&in[ncomp * (t * fftlen + len)], ncomp * (fftlen - len));
+      }
+
+  /* filterbank: weight and sum ntaps blocks into each transform */
+  if (job.pfb)
+    for (t = 0; t < n; t++)
+      {
+	for (p = 0; p < job.pfb->ntaps; p++)
+	  ws->blk[p] = &in[ncomp * (t + p) * fftlen];
+	pfb_fold(job.pfb, ws->blk, &ws->fftinbuf[ncomp * t * fftlen], ncomp);
+      }
+
+  /* zoom: mix, filter and decimate each transform */
+  if (job.zoom)
+    for (t = 0; t < n; t++)
+      zoom_decimate(&ws->fftinbuf[2 * t * fftlen], &ws->zoombuf[2 * t * job.outlen]);
+
+  /* transform the batch */
+  if (job.zoom)
+    fftwf_execute_dft(w->p, (fftwf_complex *)ws->zoombuf, (fftwf_complex *)ws->fftoutbuf);
+  else if (job.real)
+    fftwf_execute_dft_r2c(w->p, ws->fftinbuf, (fftwf_complex *)ws->fftoutbuf);
+  else
+    fftwf_execute_dft(w->p, (fftwf_complex *)ws->fftinbuf, (fftwf_complex *)ws->fftoutbuf);
+
+  return 0;
+}
+
+/******************************************************************************/
+/*	unpack_data							      */
+/******************************************************************************/
+static void unpack_data(struct SPEC_STREAM *st, char *buffer, char *rcp, float *in, long bufsize, long nout)
+{
+  /* unpacks bufsize bytes of stream st's data and adds them, downsampled,
+     to the nout complex samples of in; modes 16 and 32 are copied to in
+     as they are.  rcp holds the unpacked bytes.
+  */
+  long i,j,k,l;
+  short x;
+
+  /* unpack */
+  switch (st->mode)
+    {
+    case 1:
+      unpack_pfs_2c2b(buffer, rcp, bufsize);
+      break;
+    case 2:
+      unpack_pfs_2c4b(buffer, rcp, bufsize);
+      break;
+    case 3:
+      unpack_pfs_2c8b(buffer, rcp, bufsize);
+      break;
+    case 5:
+      if (st->chan == 2) unpack_pfs_4c2b_lcp (buffer, rcp, bufsize);
+      else 		 unpack_pfs_4c2b_rcp (buffer, rcp, bufsize);
+      break;
+    case 6:
+      if (st->chan == 2) unpack_pfs_4c4b_lcp (buffer, rcp, bufsize);
+      else 		 unpack_pfs_4c4b_rcp (buffer, rcp, bufsize);
+      break;
+    case 7:
+      if (st->chan == 2) unpack_pfs_4c8b_lcp (buffer, rcp, bufsize);
+      else 		 unpack_pfs_4c8b_rcp (buffer, rcp, bufsize);
+      break;
+    case 8:
+      memcpy (rcp, buffer, bufsize);
+      break;
+    case 16:
+      /* the old pfs_fft loop reused its transform counter here and so
+	 summed one transform whatever -n; mode 16 sums now hold -n */
+      for (i = 0, j = 0; i < bufsize; i+=sizeof(short), j++)
+	{
+	  memcpy(&x,&buffer[i],sizeof(short));
+	  in[j] = (float) x;
+	}
+      break;
+    case 32:
+      memcpy(in,buffer,bufsize);
+      break;
+    default:
+      fprintf(stderr,"Mode not implemented yet\n");
+      exit(-1);
+    }
+
+  /* downsample, blocks are contiguous in both arrays */
+  if (st->mode != 16 && st->mode != 32)
+    for (k = 0, l = 0; k < 2*nout; k += 2, l += 2*job.downsample)
+      {
+	for (j = 0; j < 2*job.downsample; j+=2)
+	  {
+	    in[k]   += (float) rcp[l+j];
+	    in[k+1] += (float) rcp[l+j+1];
+	  }
+      }
+
+  return;
+}
+
+/******************************************************************************/
+/*	long_setup							      */
+/******************************************************************************/
+static void long_setup(struct SPEC *sp, double budget)
+{
+  /* switches to four-step transforms: checks what they support, and maps
+     the transform and the spectra, in memory if they take at most half
+     the budget, else on scratch files */
+  struct SPEC_STREAM *st;
+  long long fftlen = job.fftlen;
+  double bytes = (2.0 + job.nacc) * sizeof(float) * fftlen;
+  long piece, most = 0;
+  int n1, n2, s;
+
+  if (sp->real || sp->zoom || sp->pfbtaps || sp->skthresh != 0 || sp->degree ||
+      job.combine == SPEC_CROSS || job.combine == SPEC_STOKES)
+    {
+      fprintf(stderr,"Cannot have -R, -z, -B, -K, -C, -k cross or -k stokes with FFT length %lld yet\n",fftlen);
+      exit(1);
+    }
+  if (bigfft_split(fftlen, &n1, &n2) < 0)
+    {
+      fprintf(stderr,"FFT length %lld has no factor near its square root, try -L res\n",fftlen);
+      exit(1);
+    }
+
+  sp->longfft = 1;
+  if (bytes > budget / 2)
+    {
+      sp->longfft = 2;
+      job.scratch = sp->scratchdir;
+      if (job.scratch == NULL && (job.scratch = getenv("TMPDIR")) == NULL)
+	job.scratch = "/tmp";
+    }
+  job.bigdata  = bigfft_map(2 * fftlen, job.scratch);
+  job.bigtotal = bigfft_map(job.nacc * fftlen, job.scratch);
+  for (s = 0; s < sp->nstreams; s++)
+    {
+      st = &sp->stream[s];
+      piece = (long) (LONGPIECE * (double) job.downsample * 4 / st->smpwd);
+      if (piece > most) most = piece;
+    }
+  job.bigbuf = (char *) malloc(most);
+  job.bigrcp = (char *) malloc(2 * LONGPIECE * job.downsample);
+  if (!job.bigdata || !job.bigtotal)
+    {
+      perror(job.scratch ? job.scratch : "mmap");
+      exit(1);
+    }
+  if (!job.bigbuf || !job.bigrcp)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  job.batch = 1;
+  return;
+}
+
+/******************************************************************************/
+/*	long_read							      */
+/******************************************************************************/
+static int long_read(int s)
+{
+  /* reads the next transform of stream s into the four-step array, a
+     piece at a time, then removes the DC offset, inverts and windows it
+     as read_batch does.  returns -1 at EOF.
+  */
+  struct SPEC_STREAM *st = &job.stream[s];
+  double dcoffi = job.dcoffi, dcoffq = job.dcoffq;
+  double si = 0, sq = 0, scale;
+  long long done, k;
+  long nbytes;
+  float *in, w, tmp;
+  int q;
+
+  for (done = 0; done < job.datalen; done += q)
+    {
+      q = job.datalen - done < LONGPIECE ? job.datalen - done : LONGPIECE;
+      nbytes = (long) (q * (double) job.downsample * 4 / st->smpwd);
+      if (multi_read(st->mf, job.bigbuf, nbytes) != nbytes)
+	return -1;
+      in = &job.bigdata[2 * done];
+      zerofill(in, 2 * q);
+      unpack_data(st, job.bigbuf, job.bigrcp, in, nbytes, q);
+      if (job.dcoffset)
+	for (k = 0; k < 2*q; k += 2)
+	  {
+	    si += in[k];
+	    sq += in[k+1];
+	  }
+    }
+
+  /* DC offset, given or measured, IQ swap and Hanning window in one pass */
+  if (job.dcoffset)
+    {
+      dcoffi = si / job.datalen;
+      dcoffq = sq / job.datalen;
+    }
+  scale = 1.0 / (double) (job.datalen - 1);
+  if (dcoffi != 0 || dcoffq != 0 || job.invert || job.hanning)
+    for (k = 0; k < job.datalen; k++)
+      {
+	in = &job.bigdata[2 * k];
+	in[0] -= dcoffi;
+	in[1] -= dcoffq;
+	if (job.invert)
+	  {
+	    tmp = in[0];
+	    in[0] = in[1];
+	    in[1] = tmp;
+	  }
+	if (job.hanning)
+	  {
+	    w = (float) (0.5 - 0.5 * cos(2 * M_PI * (double) k * scale));
+	    in[0] *= w;
+	    in[1] *= w;
+	  }
+      }
+
+  /* zero padding */
+  for (k = 2LL * job.datalen; k < 2LL * job.fftlen; k++)
+    job.bigdata[k] = 0;
+  return 0;
+}
+
+/******************************************************************************/
+/*	long_sum							      */
+/******************************************************************************/
+static float *long_sum(struct SPEC *sp)
+{
+  /* the next -n sum of four-step transforms, each stream's power into
+     its own spectrum; NULL if the data ran out first */
+  long long t;
+  int s;
+
+  memset(job.bigtotal, 0, (size_t) job.nacc * job.fftlen * sizeof(float));
+  for (t = 0; t < job.sum; t++)
+    for (s = 0; s < job.nstreams; s++)
+      {
+	if (long_read(s) < 0)
+	  return NULL;
+	bigfft_execute(job.big, job.bigdata);
+	bigfft_power(job.big, job.bigdata, job.swap, &job.bigtotal[(long long) s * job.fftlen]);
+      }
+  return job.bigtotal;
+}
+
+/******************************************************************************/
+/*	detect_batch							      */
+/******************************************************************************/
+static void detect_batch(struct WORKER *w, int n, float *acc)
+{
+  /*
+     detects, swaps and sums the n transforms of each stream in one pass,
+     into the stream's spectrum in acc, then adds the cross spectra of
+     each pair, real part and imaginary part, after them.  with -K the
+     squared powers of each stream follow the nacc spectra
+  */
+  int len = job.outlen;
+  float *data, *re, *sq;
+  int s,a,b,t;
+
+  for (s = 0; s < job.nstreams; s++)
+    for (t = 0; t < n; t++)
+      {
+	data = &w->s[s].fftoutbuf[2 * t * len];
+	sq = job.nsq ? &acc[(job.nacc + s) * len] : NULL;
+	if (job.zoom)
+	  zoom_power(data,len,job.k0,job.corr,&acc[s * len],sq);
+	else if (job.real)
+	  real_power(data,len,job.shift,&acc[s * len],sq);
+	else if (sq)
+	  fft_power_sum2(data,len,job.swap,&acc[s * len],sq);
+	else
+	  fft_power_sum(data,len,job.swap,&acc[s * len]);
+      }
+
+  if (job.combine != SPEC_CROSS && job.combine != SPEC_STOKES)
+    return;
+  re = &acc[job.nstreams * len];
+  for (a = 0; a < job.nstreams; a++)
+    for (b = a + 1; b < job.nstreams; b++, re += 2 * len)
+      for (t = 0; t < n; t++)
+	fft_cross_sum(&w->s[a].fftoutbuf[2 * t * len], &w->s[b].fftoutbuf[2 * t * len],
+		      len, job.swap, re, re + len);
+  return;
+}
+
+/******************************************************************************/
+/*    average         							      */
+/******************************************************************************/
+static void average(float *inbuf, int nsamples, double *i, double *q)
+{
+  int k;
+
+  *i = 0;
+  *q = 0;
+
+  /* sum Is and Qs */
+  for (k = 0; k < 2*nsamples; k += 2)
+    {
+      *i  += inbuf[k];
+      *q  += inbuf[k+1];
+    }
+
+  /* divide by nsamples to get the average value */
+  *i = *i / nsamples;
+  *q = *q / nsamples;
+
+  return;
+}
+/******************************************************************************/
+/*	vector_window							      */
+/******************************************************************************/
+static void vector_window(float *data, int len, float *weight)
+{
+  /* Hanning windows the data array of length 'len' (complex samples)
+     with the weights from fft_hann()
+  */
+  int    i,j,k;
+
+  for (i=0, j=0, k=1; i<len; i++, j+=2, k+=2)
+  {
+    data[j] *= weight[i];
+    data[k] *= weight[i];
+  }
+  return;
+}
+
+/******************************************************************************/
+/*	chebyshev_window						      */
+/******************************************************************************/
+static void chebyshev_window(float *data, int len, double *weight)
+{
+  /* Applies Chebyshev window the data array of length 'len' (floating point samples)
+     with the weights from chebyshev_table()
+  */
+  int    i;
+
+  for (i=0; i<len; i++)
+    data[i] /= weight[i];
+  return;
+}
+
+/******************************************************************************/
+/*	chebyshev_table							      */
+/******************************************************************************/
+static double *chebyshev_table(int len, int first, int fulllen, double *chebcoeff, int degree)
+{
+  /* Evaluates the Chebyshev window once for bins first to first+len-1
+     of a spectrum of fulllen bins
+  */
+  double x;
+  double *weight;		/* calculated weights */
+  int    i;
+
+  if ((weight = (double *) malloc(len * sizeof(double))) == NULL)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+  for (i=0; i<len; i++)
+  {
+    x = -0.5 + (double) (first + i) / (double) fulllen;
+    weight[i] = chebeval(x, chebcoeff, degree);
+  }
+  return weight;
+}
+
+/******************************************************************************/
+/*	chebeval							      */
+/******************************************************************************/
+static double chebeval(double x, double c[], int degree)
+{
+  /*
+     Evaluate a Chebyshev series at points x.
+     Expects an array `c` of length at least degree + 1 = n + 1
+     This function returns the value:
+     p(x) = c_0 * T_0(x) + c_1 * T_1(x) + ... + c_n * T_n(x)
+  */
+  double x2;
+  double c0, c1;
+  double tmp;
+  int i;
+
+  x2 = 2*x;
+  c0 = c[degree-1];
+  c1 = c[degree];
+  for (i = 2; i <= degree; i++)
+    {
+      tmp = c0;
+      c0 = c[degree-i] - c1;
+      c1 = tmp + c1*x2;
+    }
+  return c0 + c1*x;
+}
+
+/******************************************************************************/
+/*	read cheb coeffs						      */
+/******************************************************************************/
+static int read_cheb_coeffs(char *chebfile, double *chebcoeff)
+{
+  int degree = 0;
+  FILE   *fpcheb;		/* pointer to file of Cheb coefficients */
+
+  /* open the Cheb coeff file */
+  fpcheb=fopen(chebfile,"r");
+  if (fpcheb == NULL)
+    {
+      perror("read_cheb_coeff: cheb coefficients file open error");
+      exit(1);
+    }
+
+  /* read coefficients */
+  while (fscanf(fpcheb, "%lf", &chebcoeff[degree++]) == 1)
+    continue;
+
+  degree = degree - 1; /* EOF does not count */
+  degree = degree - 1; /* number of coeffs = degree + 1 */
+
+  return degree;
+}
+
+/******************************************************************************/
+/*	zoom_setup							      */
+/******************************************************************************/
+static int zoom_setup(float binmin, float binmax)
+{
+  /* chooses the decimation for the band [binmin,binmax] (in bins from
+     zero frequency) and computes the filter taps and the correction of
+     the filter response.  returns 0 if zooming would not gain anything.
+  */
+  int N = job.fftlen;
+  double h, sum, c, x, arg;
+  int M, D, L, i, l, j;
+
+  /* smallest zoom length, dividing fftlen, that holds the band with margin */
+  for (M = (int) ceil(ZOOMOVER * (binmax - binmin + 1)); M < N; M++)
+    if (M >= 32 && N % M == 0)
+      break;
+  D = N / M;
+  if (D < ZOOMMIN || job.real)
+    return 0;
+
+  L = ZOOMTAPS * D + 1;
+  job.zoom = D;
+  job.outlen = M;
+  job.k0 = (int) rint((binmin + binmax) / 2);
+  job.ntaps = L;
+  job.taps = (float *) malloc(2 * L * sizeof(float));
+  job.corr = (float *) malloc(M * sizeof(float));
+  if (!job.taps || !job.corr)
+    {
+      fprintf(stderr,"Malloc error\n");
+      exit(1);
+    }
+
+  /* low pass at half the decimated rate, DC gain 1 */
+  c = (L - 1) / 2.0;
+  for (l = 0, sum = 0; l < L; l++)
+    {
+      x = (l - c) / D;
+      h = x == 0 ? 1 : sin(M_PI * x) / (M_PI * x);
+      h *= 0.42 - 0.5 * cos(2 * M_PI * l / (L - 1)) + 0.08 * cos(4 * M_PI * l / (L - 1));
+      job.taps[2*l] = h;
+      sum += h;
+    }
+
+  /* response at each output bin, then fold the mixing into the taps */
+  for (i = 0; i < M; i++)
+    {
+      j = i - M/2;
+      for (l = 0, h = 0; l < L; l++)
+	h += job.taps[2*l] / sum * cos(2 * M_PI * j * (l - c) / N);
+      job.corr[i] = (double) D * D / (h * h);
+    }
+  for (l = 0; l < L; l++)
+    {
+      h = job.taps[2*l] / sum;
+      arg = -2 * M_PI * job.k0 * (l - c) / N;
+      job.taps[2*l]   = h * cos(arg);
+      job.taps[2*l+1] = h * sin(arg);
+    }
+
+  return 1;
+}
+
+/******************************************************************************/
+/*	zoom_decimate							      */
+/******************************************************************************/
+static void zoom_decimate(float *in, float *out)
+{
+  /* filters the fftlen complex samples in, circularly, keeping every
+     D-th output; the mixing to the band center is in the taps, its
+     remaining phase ramp is a shift of the output bins, see zoom_power
+  */
+  int N = job.fftlen;
+  int D = job.zoom;
+  int L = job.ntaps;
+  float *g = job.taps;
+  float re, im;
+  int m, l, n;
+
+  for (m = 0; m < job.outlen; m++)
+    {
+      re = im = 0;
+      n = m * D - (L - 1) / 2;
+      if (n < 0) n += N;
+      for (l = 0; l < L; l++, n++)
+	{
+	  if (n == N) n = 0;
+	  re += g[2*l] * in[2*n]   - g[2*l+1] * in[2*n+1];
+	  im += g[2*l] * in[2*n+1] + g[2*l+1] * in[2*n];
+	}
+      out[2*m]   = re;
+      out[2*m+1] = im;
+    }
+  return;
+}
+
+/******************************************************************************/
+/*	zoom_power							      */
+/******************************************************************************/
+static void zoom_power(float *data, int len, int k0, float *corr, float *sum, float *sum2)
+{
+  /* detects the zoomed transform of len complex samples and adds it to
+     sum with bin k0 of the full spectrum at len/2, correcting for the
+     filter, and its square to sum2 unless NULL
+  */
+  float p;
+  int i,k;
+
+  k = ((k0 - len/2) % len + len) % len;
+  for (i=0; i<len; i++)
+    {
+      p = (data[2*k]*data[2*k] + data[2*k+1]*data[2*k+1]) * corr[i];
+      sum[i] += p;
+      if (sum2) sum2[i] += p*p;
+      if (++k == len) k = 0;
+    }
+
+  return;
+}
+
+/******************************************************************************/
+/*	real_power							      */
+/******************************************************************************/
+static void real_power(float *data, int len, int shift, float *sum, float *sum2)
+{
+  /* detects the r2c transform of len real samples, held in the first
+     len/2+1 complex samples of data, and adds it to sum over all len
+     bins with the negative frequencies mirrored, zero frequency at
+     len/2, and the spectrum moved up by shift bins.  the squares go to
+     sum2 unless NULL
+  */
+  float p;
+  int i,k,m;
+
+  k = ((-len/2 - shift) % len + len) % len;
+  for (i=0; i<len; i++)
+    {
+      m = k <= len/2 ? k : len-k;
+      p = data[2*m]*data[2*m] + data[2*m+1]*data[2*m+1];
+      sum[i] += p;
+      if (sum2) sum2[i] += p*p;
+      if (++k == len) k = 0;
+    }
+
+  return;
+}
+
+/******************************************************************************/
+/*	swap_iandq							      */
+/******************************************************************************/
+static void swap_iandq(float *data, int len)
+{
+  /* swaps the i and q components of each complex word to reverse the "phase"
+     direction, the data array is len complex samples long or 2*len samples long
+  */
+
+  int i,j;
+  float temp;
+
+  for (i=0, j=1; i < 2*len; i+=2, j+=2)
+    {
+      temp    = data[i];
+      data[i] = data[j];
+      data[j] = temp;
+    }
+
+  return;
+}
+
+/******************************************************************************/
+/*	zerofill							      */
+/******************************************************************************/
+static void zerofill(float *data, int len)
+{
+  /* zero fills array of floats of size len */
+
+  int i;
+
+  for (i=0; i<len; i++)
+    data[i] = 0.0;
+
+  return;
+}
@@ -1,5 +1,6 @@
 #include "unpack.h"
 #include "string.h"
+#include <math.h>
 
 #define DBG1
 
@@ -437,3 +438,146 @@ void unpack_pfs_4c8b_lcp_sb (unsigned char *buf, char *lcp, int bufsize)
 }
 
 
+
+/*
+  The routines below run in the opposite direction: they repack raw
+  PFS words into a smaller raw format that the unpacking routines above
+  read back.  Polarization splitting turns 4-channel data into two
+  2-channel streams (4c2b -> 2c2b, 4c4b -> 2c4b), and requantization
+  turns 2c8b data into 2c4b or 2c2b data.
+*/
+
+/******************************************************************************/
+/*	split_pfs_4c2b							      */
+/******************************************************************************/
+void split_pfs_4c2b (unsigned char *buf, unsigned char *rcp, unsigned char *lcp, int bufsize)
+{
+  /*
+    splits 4-channel, 2-bit data into two 2-channel, 2-bit (mode 1) streams
+    input array buf is of size bufsize bytes, a multiple of 8
+    output arrays rcp and lcp each contain bufsize/2 bytes
+  */
+
+  /* each nibble holds one complex sample, in the same bit order in both */
+  /* formats, so nibbles move without being decoded */
+
+  int i;
+
+  for (i = 0; i < bufsize; i += 8)
+  {
+      *rcp++ = (buf[i+3] << 4) | (buf[i+2] & 0x0F);
+      *rcp++ = (buf[i+1] << 4) | (buf[i+0] & 0x0F);
+      *rcp++ = (buf[i+7] << 4) | (buf[i+6] & 0x0F);
+      *rcp++ = (buf[i+5] << 4) | (buf[i+4] & 0x0F);
+
+      *lcp++ = (buf[i+3] & 0xF0) | (buf[i+2] >> 4);
+      *lcp++ = (buf[i+1] & 0xF0) | (buf[i+0] >> 4);
+      *lcp++ = (buf[i+7] & 0xF0) | (buf[i+6] >> 4);
+      *lcp++ = (buf[i+5] & 0xF0) | (buf[i+4] >> 4);
+  }
+
+  return;
+}
+
+/******************************************************************************/
+/*	split_pfs_4c4b							      */
+/******************************************************************************/
+void split_pfs_4c4b (unsigned char *buf, unsigned char *rcp, unsigned char *lcp, int bufsize)
+{
+  /*
+    splits 4-channel, 4-bit data into two 2-channel, 4-bit (mode 2) streams
+    input array buf is of size bufsize bytes, a multiple of 8
+    output arrays rcp and lcp each contain bufsize/2 bytes
+  */
+
+  int i;
+
+  for (i = 0; i < bufsize; i += 8)
+  {
+      *rcp++ = buf[i+2];
+      *rcp++ = buf[i+0];
+      *rcp++ = buf[i+6];
+      *rcp++ = buf[i+4];
+
+      *lcp++ = buf[i+3];
+      *lcp++ = buf[i+1];
+      *lcp++ = buf[i+7];
+      *lcp++ = buf[i+5];
+  }
+
+  return;
+}
+
+/******************************************************************************/
+/*	requant_pfs_2c8b_2c4b						      */
+/******************************************************************************/
+void requant_pfs_2c8b_2c4b (unsigned char *buf, unsigned char *outbuf, int bufsize, float step)
+{
+  /*
+    requantizes 2-channel, 8-bit data to 2-channel, 4-bit (mode 2) data
+    with 16 uniform levels spaced by step (8-bit counts)
+    input array buf is of size bufsize bytes, a multiple of 8
+    output array outbuf contains bufsize/2 bytes
+  */
+
+  unsigned char code[256];
+  int i, k;
+
+  /* level 2k+1 (in units of step/2) is coded as 7-k, see unpack_pfs_2c4b */
+  for (i = 0; i < 256; i++)
+    {
+      k = (int) floor((i - 128) / step);
+      if (k < -8) k = -8;
+      if (k >  7) k =  7;
+      code[i] = 7 - k;
+    }
+
+  for (i = 0; i < bufsize; i += 8)
+  {
+      *outbuf++ = code[buf[i+2]] | (code[buf[i+3]] << 4);
+      *outbuf++ = code[buf[i+0]] | (code[buf[i+1]] << 4);
+      *outbuf++ = code[buf[i+6]] | (code[buf[i+7]] << 4);
+      *outbuf++ = code[buf[i+4]] | (code[buf[i+5]] << 4);
+  }
+
+  return;
+}
+
+/******************************************************************************/
+/*	requant_pfs_2c8b_2c2b						      */
+/******************************************************************************/
+void requant_pfs_2c8b_2c2b (unsigned char *buf, unsigned char *outbuf, int bufsize, float thresh)
+{
+  /*
+    requantizes 2-channel, 8-bit data to 2-channel, 2-bit (mode 1) data
+    with thresholds at 0 and +-thresh (8-bit counts)
+    input array buf is of size bufsize bytes, a multiple of 16
+    output array outbuf contains bufsize/4 bytes
+  */
+
+  unsigned char code[256];
+  int i, k;
+
+  /* level 2k+1 is coded as 1-k, see unpack_pfs_2c2b */
+  for (i = 0; i < 256; i++)
+    {
+      k = (int) floor((i - 128) / thresh);
+      if (k < -2) k = -2;
+      if (k >  1) k =  1;
+      code[i] = 1 - k;
+    }
+
+#define NIBBLE(a,b) (code[a] | (code[b] << 2))
+
+  for (i = 0; i < bufsize; i += 16)
+  {
+      *outbuf++ = (NIBBLE(buf[i+4], buf[i+5]) << 4) | NIBBLE(buf[i+6], buf[i+7]);
+      *outbuf++ = (NIBBLE(buf[i+0], buf[i+1]) << 4) | NIBBLE(buf[i+2], buf[i+3]);
+      *outbuf++ = (NIBBLE(buf[i+12],buf[i+13])<< 4) | NIBBLE(buf[i+14],buf[i+15]);
+      *outbuf++ = (NIBBLE(buf[i+8], buf[i+9]) << 4) | NIBBLE(buf[i+10],buf[i+11]);
+  }
+
+#undef NIBBLE
+
+  return;
+}
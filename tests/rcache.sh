@@ -0,0 +1,55 @@
+#!/bin/bash
+#run as : ./rcache.sh
+# checks the result cache of pfs_stats, pfs_hist and pfs_fft
+
+export PFS_CACHE=$(mktemp -d)
+failed=0
+
+check() { # name, then 0 if the test passed
+    if [ $2 -eq 0 ]; then echo " $1 PASSED "; else echo " $1 FAILED "; failed=1; fi
+}
+
+# mode 3 data, 1 MB of random bytes
+head -c 1048576 /dev/urandom > rcache.bin
+
+# Test 1: a hit is byte-identical to a run without the cache
+
+pfs_stats -m 3 -a rcache.bin > result.1
+pfs_stats -m 3 -a rcache.bin > result.2
+pfs_stats -N -m 3 -a rcache.bin > result.3
+pfs_fft -m 3 -f 1 -r 1000 -n 8 -o result.4 rcache.bin 2> /dev/null
+pfs_fft -m 3 -f 1 -r 1000 -n 8 -o result.5 rcache.bin 2> result.err
+pfs_fft -N -m 3 -f 1 -r 1000 -n 8 -o result.6 rcache.bin 2> /dev/null
+cmp -s result.1 result.3 && cmp -s result.2 result.3 && cmp -s result.5 result.6 \
+    && grep -q "result cache" result.err
+check "Cache hit" $?
+
+# Test 2: touching the input is a miss
+
+pfs_hist -m 3 rcache.bin > result.1
+sleep 1; touch rcache.bin
+n=$(ls $PFS_CACHE | grep -c pfs_hist)
+pfs_hist -m 3 rcache.bin > result.2
+[ $(ls $PFS_CACHE | grep -c pfs_hist) -eq $((n+1)) ] && cmp -s result.1 result.2
+check "Changed input" $?
+
+# Test 3: appended stdout replays only this run's output
+
+echo "previous line" > result.1
+pfs_stats -m 3 rcache.bin >> result.1
+echo "other line" > result.2
+pfs_stats -m 3 rcache.bin >> result.2
+pfs_stats -N -m 3 rcache.bin > result.3
+(echo "other line"; cat result.3) | cmp -s - result.2
+check "Appended output" $?
+
+# Test 4: trimming leaves other files in the cache directory alone
+
+head -c 3000000 /dev/zero > $PFS_CACHE/foreign.dat
+PFS_CACHE_MB=0.001 pfs_stats -m 3 -e rcache.bin > result.1
+[ -f $PFS_CACHE/foreign.dat ] && [ $(cat $PFS_CACHE/pfs_* | wc -c) -le 1048 ]
+check "Cache trimming" $?
+
+# clean up
+rm -rf $PFS_CACHE rcache.bin result*
+exit $failed